@@ -32,7 +32,6 @@ nemo_centered_placement_grid_new (NemoIconContainer *container, gboolean horizon
     gint width, height;
     gint num_columns;
     gint num_rows;
-    gint i;
     gint snap_x, snap_y;
     gint icon_size;
 
@@ -67,12 +66,7 @@ nemo_centered_placement_grid_new (NemoIconContainer *container, gboolean horizon
 
     grid->borders = gtk_border_new ();
 
-    grid->grid_memory = g_new0 (int, (num_rows * num_columns));
-    grid->icon_grid = g_new0 (int *, num_columns);
-    
-    for (i = 0; i < num_columns; i++) {
-        grid->icon_grid[i] = grid->grid_memory + (i * num_rows);
-    }
+    grid->bits = nemo_placement_bits_new (num_rows * num_columns);
 
     grid->borders->left = (width - (num_columns * snap_x)) / 2;
     grid->borders->right = (width - (num_columns * snap_x)) / 2;
@@ -89,12 +83,42 @@ nemo_centered_placement_grid_free (NemoCenteredPlacementGrid *grid)
         return;
     }
 
-    g_free (grid->icon_grid);
-    g_free (grid->grid_memory);
+    g_free (grid->bits);
     gtk_border_free (grid->borders);
     g_free (grid);
 }
 
+/* Cells are numbered in the order icons are laid down - row by row for
+ * horizontal layouts, column by column otherwise - so the "next" grid
+ * position is always the next bit.
+ */
+static inline gint
+grid_position_to_index (NemoCenteredPlacementGrid *grid,
+                        gint                       grid_x,
+                        gint                       grid_y)
+{
+    if (grid->horizontal) {
+        return grid_y * grid->num_columns + grid_x;
+    } else {
+        return grid_x * grid->num_rows + grid_y;
+    }
+}
+
+static inline void
+grid_index_to_position (NemoCenteredPlacementGrid *grid,
+                        gint                       index,
+                        gint                      *grid_x,
+                        gint                      *grid_y)
+{
+    if (grid->horizontal) {
+        *grid_x = index % grid->num_columns;
+        *grid_y = index / grid->num_columns;
+    } else {
+        *grid_x = index / grid->num_rows;
+        *grid_y = index % grid->num_rows;
+    }
+}
+
 static gboolean
 nemo_centered_placement_grid_position_is_free (NemoCenteredPlacementGrid *grid,
                                                gint                       grid_x,
@@ -103,7 +127,7 @@ nemo_centered_placement_grid_position_is_free (NemoCenteredPlacementGrid *grid,
     g_assert (grid_x >= 0 && grid_x < grid->num_columns);
     g_assert (grid_y >= 0 && grid_y < grid->num_rows);
 
-    return grid->icon_grid[grid_x][grid_y] == 0;
+    return !nemo_placement_bits_get (grid->bits, grid_position_to_index (grid, grid_x, grid_y));
 }
 
 static void
@@ -111,10 +135,13 @@ nemo_centered_placement_grid_mark (NemoCenteredPlacementGrid *grid,
                                    gint                       grid_x,
                                    gint                       grid_y)
 {
+    gint index;
+
     g_assert (grid_x >= 0 && grid_x < grid->num_columns);
     g_assert (grid_y >= 0 && grid_y < grid->num_rows);
 
-    grid->icon_grid[grid_x][grid_y] = 1;
+    index = grid_position_to_index (grid, grid_x, grid_y);
+    nemo_placement_bits_set_range (grid->bits, index, index + 1, TRUE);
 }
 
 static void
@@ -122,10 +149,13 @@ nemo_centered_placement_grid_unmark (NemoCenteredPlacementGrid *grid,
                                      gint                       grid_x,
                                      gint                       grid_y)
 {
+    gint index;
+
     g_assert (grid_x >= 0 && grid_x < grid->num_columns);
     g_assert (grid_y >= 0 && grid_y < grid->num_rows);
 
-    grid->icon_grid[grid_x][grid_y] = 0;
+    index = grid_position_to_index (grid, grid_x, grid_y);
+    nemo_placement_bits_set_range (grid->bits, index, index + 1, FALSE);
 }
 
 static void
@@ -396,6 +426,38 @@ nemo_centered_placement_grid_get_next_position_rect (NemoCenteredPlacementGrid *
     }
 }
 
+/**
+ * nemo_centered_placement_grid_get_next_free_position_rect:
+ *
+ * Equivalent to calling nemo_centered_placement_grid_get_next_position_rect()
+ * until it reports a free position, but skips occupied cells a word at a time.
+ * As there, the last grid position is always considered free.
+ */
+void
+nemo_centered_placement_grid_get_next_free_position_rect (NemoCenteredPlacementGrid *grid,
+                                                          GdkRectangle              *in_rect,
+                                                          GdkRectangle              *out_rect)
+{
+    gint index_x, index_y, index, last;
+
+    index_x = (in_rect->x - grid->borders->left) / grid->real_snap_x;
+    index_y = (in_rect->y - grid->borders->top) / grid->real_snap_y;
+
+    index_x = CLAMP (index_x, 0, grid->num_columns - 1);
+    index_y = CLAMP (index_y, 0, grid->num_rows - 1);
+
+    last = grid->num_columns * grid->num_rows - 1;
+    index = MIN (grid_position_to_index (grid, index_x, index_y) + 1, last);
+    index = nemo_placement_bits_find (grid->bits, index, last, FALSE);
+
+    grid_index_to_position (grid, index, &index_x, &index_y);
+
+    out_rect->x = index_x * grid->real_snap_x + grid->borders->left;
+    out_rect->y = index_y * grid->real_snap_y + grid->borders->top;
+    out_rect->width = grid->real_snap_x;
+    out_rect->height = grid->real_snap_y;
+}
+
 void
 nemo_centered_placement_grid_get_current_position_rect (NemoCenteredPlacementGrid *grid,
                                                         gint                       x,
@@ -27,6 +27,7 @@
 #include "nemo-generated.h"
 
 #include "nemo-file-operations.h"
+#include "nemo-thumbnail-stats.h"
 
 #define DEBUG_FLAG NEMO_DEBUG_DBUS
 #include "nemo-debug.h"
@@ -38,6 +39,7 @@ struct _NemoDBusManager {
 
   GDBusObjectManagerServer *object_manager;
   NemoDBusFileOperations *file_operations;
+  NemoDBusDebug *debug;
 };
 
 struct _NemoDBusManagerClass {
@@ -57,6 +59,12 @@ nemo_dbus_manager_dispose (GObject *object)
     self->file_operations = NULL;
   }
 
+  if (self->debug) {
+    g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (self->debug));
+    g_object_unref (self->debug);
+    self->debug = NULL;
+  }
+
   if (self->object_manager) {
     g_object_unref (self->object_manager);
     self->object_manager = NULL;
@@ -159,6 +167,19 @@ handle_empty_trash (NemoDBusFileOperations *object,
   return TRUE; /* invocation was handled */
 }
 
+static gboolean
+handle_get_thumbnail_stats (NemoDBusDebug *object,
+			    GDBusMethodInvocation *invocation)
+{
+  gchar *stats;
+
+  stats = nemo_thumbnail_stats_dump ();
+  nemo_dbus_debug_complete_get_thumbnail_stats (object, invocation, stats);
+  g_free (stats);
+
+  return TRUE; /* invocation was handled */
+}
+
 static void
 nemo_dbus_manager_init (NemoDBusManager *self)
 {
@@ -189,6 +210,16 @@ nemo_dbus_manager_init (NemoDBusManager *self)
   g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (self->file_operations), connection,
 				    "/org/Nemo", NULL);
 
+  self->debug = nemo_dbus_debug_skeleton_new ();
+
+  g_signal_connect (self->debug,
+		    "handle-get-thumbnail-stats",
+		    G_CALLBACK (handle_get_thumbnail_stats),
+		    self);
+
+  g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (self->debug), connection,
+				    "/org/Nemo", NULL);
+
   g_dbus_object_manager_server_set_connection (self->object_manager, connection);
 }
 
@@ -32,6 +32,7 @@
 #include "nemo-signaller.h"
 #include "nemo-global-preferences.h"
 #include "nemo-link.h"
+#include "nemo-thumbnail-cache.h"
 #include <eel/eel-glib-extensions.h>
 #include <gtk/gtk.h>
 #include <stdio.h>
@@ -70,6 +71,11 @@ struct ThumbnailState {
 	NemoFile *file;
 	gboolean trying_original;
 	gboolean tried_original;
+
+	/* Key of the decoded result in the shared thumbnail cache */
+	char *cache_path;
+	time_t cache_mtime;
+	int cache_size;
 };
 
 struct MountState {
@@ -3710,11 +3716,30 @@ static void
 thumbnail_state_free (ThumbnailState *state)
 {
 	g_object_unref (state->cancellable);
+	g_free (state->cache_path);
 	g_free (state);
 }
 
 extern int cached_thumbnail_size;
 
+static int
+get_max_thumbnail_size (void)
+{
+	/* cf. nemo_file_get_icon() */
+	return NEMO_ICON_SIZE_LARGEST * cached_thumbnail_size / NEMO_ICON_SIZE_STANDARD;
+}
+
+static char *
+get_thumbnail_cache_path (NemoFile *file,
+			  gboolean  original)
+{
+	if (original) {
+		return nemo_file_get_uri (file);
+	}
+
+	return g_strdup (file->details->thumbnail_path);
+}
+
 /* scale very large images down to the max. size we need */
 static void
 thumbnail_loader_size_prepared (GdkPixbufLoader *loader,
@@ -3727,8 +3752,7 @@ thumbnail_loader_size_prepared (GdkPixbufLoader *loader,
 
 	aspect_ratio = ((double) width) / height;
 
-	/* cf. nemo_file_get_icon() */
-	max_thumbnail_size = NEMO_ICON_SIZE_LARGEST * cached_thumbnail_size / NEMO_ICON_SIZE_STANDARD;
+	max_thumbnail_size = GPOINTER_TO_INT (user_data);
 	if (MAX (width, height) > max_thumbnail_size) {
 		if (width > height) {
 			width = max_thumbnail_size;
@@ -3742,9 +3766,11 @@ thumbnail_loader_size_prepared (GdkPixbufLoader *loader,
 	}
 }
 
+/* Thumbnail loader thread */
 static GdkPixbuf *
 get_pixbuf_for_content (goffset file_len,
-			char *file_contents)
+			const char *file_contents,
+			int max_thumbnail_size)
 {
 	gboolean res;
 	GdkPixbuf *pixbuf, *pixbuf2;
@@ -3755,18 +3781,20 @@ get_pixbuf_for_content (goffset file_len,
 	loader = gdk_pixbuf_loader_new ();
 	g_signal_connect (loader, "size-prepared",
 			  G_CALLBACK (thumbnail_loader_size_prepared),
-			  NULL);
+			  GINT_TO_POINTER (max_thumbnail_size));
 
 	/* For some reason we have to write in chunks, or gdk-pixbuf fails */
 	res = TRUE;
 	while (res && file_len > 0) {
 		chunk_len = (file_len > chunk_len) ? chunk_len : file_len;
-		res = gdk_pixbuf_loader_write (loader, (guchar *) file_contents, chunk_len, NULL);
+		res = gdk_pixbuf_loader_write (loader, (const guchar *) file_contents, chunk_len, NULL);
 		file_contents += chunk_len;
 		file_len -= chunk_len;
 	}
 	if (res) {
 		res = gdk_pixbuf_loader_close (loader, NULL);
+	} else {
+		gdk_pixbuf_loader_close (loader, NULL);
 	}
 	if (res) {
 		pixbuf = g_object_ref (gdk_pixbuf_loader_get_pixbuf (loader));
@@ -3781,6 +3809,83 @@ get_pixbuf_for_content (goffset file_len,
 	return pixbuf;
 }
 
+typedef struct {
+	GFile *location;
+	gboolean map_file;
+	int max_thumbnail_size;
+} ThumbnailLoadData;
+
+static void
+thumbnail_load_data_free (ThumbnailLoadData *data)
+{
+	g_object_unref (data->location);
+	g_free (data);
+}
+
+/* Thumbnail loader thread
+ *
+ * Reads and decodes the image off the main loop, so that only the finished
+ * pixbuf reaches the main thread.
+ */
+static void
+thumbnail_load_thread (GTask        *task,
+		       gpointer      source_object,
+		       gpointer      task_data,
+		       GCancellable *cancellable)
+{
+	ThumbnailLoadData *data = task_data;
+	GdkPixbuf *pixbuf;
+	GMappedFile *mapped;
+	char *path, *file_contents;
+	gsize file_size;
+
+	pixbuf = NULL;
+	path = data->map_file ? g_file_get_path (data->location) : NULL;
+
+	if (path != NULL) {
+		mapped = g_mapped_file_new (path, FALSE, NULL);
+		if (mapped != NULL) {
+			pixbuf = get_pixbuf_for_content (g_mapped_file_get_length (mapped),
+							 g_mapped_file_get_contents (mapped),
+							 data->max_thumbnail_size);
+			g_mapped_file_unref (mapped);
+		}
+		g_free (path);
+	} else if (g_file_load_contents (data->location, cancellable,
+					 &file_contents, &file_size,
+					 NULL, NULL)) {
+		pixbuf = get_pixbuf_for_content (file_size, file_contents,
+						 data->max_thumbnail_size);
+		g_free (file_contents);
+	}
+
+	g_task_return_pointer (task, pixbuf, g_object_unref);
+}
+
+static void thumbnail_read_callback (GObject      *source_object,
+				     GAsyncResult *res,
+				     gpointer      user_data);
+
+static void
+thumbnail_load_async (ThumbnailState *state,
+		      GFile          *location)
+{
+	ThumbnailLoadData *data;
+	GTask *task;
+
+	data = g_new0 (ThumbnailLoadData, 1);
+	data->location = g_object_ref (location);
+	data->max_thumbnail_size = state->cache_size;
+	/* Thumbnails are replaced atomically by the thumbnail factory, so they
+	 * are safe to mmap.  Originals may be rewritten in place under us,
+	 * which would fault on a truncated mapping, so those are read. */
+	data->map_file = !state->trying_original;
+
+	task = g_task_new (NULL, state->cancellable, thumbnail_read_callback, state);
+	g_task_set_task_data (task, data, (GDestroyNotify) thumbnail_load_data_free);
+	g_task_run_in_thread (task, thumbnail_load_thread);
+	g_object_unref (task);
+}
 
 static void
 thumbnail_read_callback (GObject *source_object,
@@ -3788,9 +3893,6 @@ thumbnail_read_callback (GObject *source_object,
 			 gpointer user_data)
 {
 	ThumbnailState *state;
-	gsize file_size;
-	char *file_contents;
-	gboolean result;
 	NemoDirectory *directory;
 	GdkPixbuf *pixbuf;
 	GFile *location;
@@ -3799,32 +3901,32 @@ thumbnail_read_callback (GObject *source_object,
 
 	if (state->directory == NULL) {
 		/* Operation was cancelled. Bail out */
+		pixbuf = g_task_propagate_pointer (G_TASK (res), NULL);
+		g_clear_object (&pixbuf);
 		thumbnail_state_free (state);
 		return;
 	}
 
 	directory = nemo_directory_ref (state->directory);
 
-	result = g_file_load_contents_finish (G_FILE (source_object),
-					      res,
-					      &file_contents, &file_size,
-					      NULL, NULL);
+	pixbuf = g_task_propagate_pointer (G_TASK (res), NULL);
 
-	pixbuf = NULL;
-	if (result) {
-		pixbuf = get_pixbuf_for_content (file_size, file_contents);
-		g_free (file_contents);
+	if (pixbuf != NULL) {
+		nemo_thumbnail_cache_insert (state->cache_path,
+					     state->cache_mtime,
+					     state->cache_size,
+					     pixbuf);
 	}
 	
 	if (pixbuf == NULL && state->trying_original) {
 		state->trying_original = FALSE;
 
+		g_free (state->cache_path);
+		state->cache_path = get_thumbnail_cache_path (state->file, FALSE);
+
 		location = g_file_new_for_path (state->file->details->thumbnail_path);
 
-		g_file_load_contents_async (location,
-					    state->cancellable,
-					    thumbnail_read_callback,
-					    state);
+		thumbnail_load_async (state, location);
 		g_object_unref (location);
 	} else {
 		state->directory->details->thumbnail_state = NULL;
@@ -3845,6 +3947,8 @@ thumbnail_start (NemoDirectory *directory,
 {
 	GFile *location;
 	ThumbnailState *state;
+	GdkPixbuf *pixbuf;
+	char *cache_path;
 
 	if (directory->details->thumbnail_state != NULL) {
 		*doing_io = TRUE;
@@ -3856,9 +3960,23 @@ thumbnail_start (NemoDirectory *directory,
 		       REQUEST_THUMBNAIL)) {
 		return;
 	}
+
+	/* Another view or tab may already have decoded this one */
+	cache_path = get_thumbnail_cache_path (file, file->details->thumbnail_wants_original);
+	pixbuf = nemo_thumbnail_cache_lookup (cache_path,
+					      file->details->mtime,
+					      get_max_thumbnail_size ());
+	if (pixbuf != NULL) {
+		g_free (cache_path);
+		thumbnail_got_pixbuf (directory, file, pixbuf,
+				      file->details->thumbnail_wants_original);
+		return;
+	}
+
 	*doing_io = TRUE;
 
 	if (!async_job_start (directory, "thumbnail")) {
+		g_free (cache_path);
 		return;
 	}
 	
@@ -3866,6 +3984,9 @@ thumbnail_start (NemoDirectory *directory,
 	state->directory = directory;
 	state->file = file;
 	state->cancellable = g_cancellable_new ();
+	state->cache_path = cache_path;
+	state->cache_mtime = file->details->mtime;
+	state->cache_size = get_max_thumbnail_size ();
 
 	if (file->details->thumbnail_wants_original) {
 		state->tried_original = TRUE;
@@ -3877,10 +3998,7 @@ thumbnail_start (NemoDirectory *directory,
 	
 	directory->details->thumbnail_state = state;
 
-	g_file_load_contents_async (location,
-				    state->cancellable,
-				    thumbnail_read_callback,
-				    state);
+	thumbnail_load_async (state, location);
 	g_object_unref (location);
 }
 
@@ -29,6 +29,7 @@
 #include "nemo-file-attributes.h"
 #include "nemo-file-private.h"
 #include "nemo-file-utilities.h"
+#include "nemo-filename-index.h"
 #include "nemo-search-directory.h"
 #include "nemo-global-preferences.h"
 #include "nemo-lib-self-check-functions.h"
@@ -950,6 +951,8 @@ nemo_directory_notify_files_added (GList *files)
 	for (p = files; p != NULL; p = p->next) {
 		location = p->data;
 
+		nemo_filename_index_note_changed (location);
+
 		/* See if the directory is already known. */
 		directory = get_parent_directory_if_exists (location);
 		if (directory == NULL) {
@@ -1135,6 +1138,8 @@ nemo_directory_notify_files_removed (GList *files)
 	for (p = files; p != NULL; p = p->next) {
 		location = p->data;
 
+		nemo_filename_index_note_changed (location);
+
 		/* Update file count for parent directory if anyone might care. */
 		directory = get_parent_directory_if_exists (location);
 		if (directory != NULL) {
@@ -1348,6 +1353,9 @@ nemo_directory_notify_files_moved (GList *file_pairs)
 		from_location = pair->from;
 		to_location = pair->to;
 
+		nemo_filename_index_note_changed (from_location);
+		nemo_filename_index_note_changed (to_location);
+
 		/* Handle overwriting a file. */
 		file = nemo_file_get_existing (to_location);
 		if (file != NULL) {
@@ -0,0 +1,831 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-document-text.c: Text of zipped XML documents, for content search.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#include <config.h>
+#include "nemo-document-text.h"
+
+#include <string.h>
+
+#define ZIP_LOCAL_SIGNATURE   0x04034b50
+#define ZIP_CENTRAL_SIGNATURE 0x02014b50
+#define ZIP_END_SIGNATURE     0x06054b50
+
+#define ZIP_LOCAL_SIZE   30
+#define ZIP_CENTRAL_SIZE 46
+#define ZIP_END_SIZE     22
+#define ZIP_MAX_COMMENT  65535
+
+#define ZIP_FLAG_ENCRYPTED 0x0001
+
+#define ZIP_METHOD_STORED   0
+#define ZIP_METHOD_DEFLATED 8
+
+/* A central directory bigger than this isn't a document */
+#define MAX_DIRECTORY_SIZE (16 * 1024 * 1024)
+
+#define CHUNK_SIZE 65536
+
+/* Longer tags are read to the end but only this much is kept - enough
+ * for the name, which is all that's looked at */
+#define MAX_TAG_KEPT 64
+#define MAX_ENTITY_LENGTH 10
+
+static const struct {
+    const gchar *program;
+    NemoDocumentFormat format;
+} helper_programs[] = {
+    { "nemo-odf-to-txt", NEMO_DOCUMENT_FORMAT_ODF },
+    { "nemo-mso-to-txt", NEMO_DOCUMENT_FORMAT_OOXML },
+    { "nemo-epub2text",  NEMO_DOCUMENT_FORMAT_EPUB },
+};
+
+/* Office Open XML parts with text in them, by prefix */
+static const gchar *ooxml_parts[] = {
+    "word/document",
+    "word/header",
+    "word/footer",
+    "word/footnotes",
+    "word/endnotes",
+    "word/comments",
+    "xl/sharedStrings",
+    "ppt/slides/slide",
+    "ppt/notesSlides/notesSlide",
+    "docProps/core",
+    NULL
+};
+
+/* EPUB chapters that are left out, by prefix of their file name */
+static const gchar *epub_skipped[] = {
+    "titlepage",
+    "toc",
+    "copyright",
+    NULL
+};
+
+typedef struct {
+    gchar *name;
+    guint16 method;
+    guint32 compressed_size;
+    guint32 local_offset;
+    gboolean is_metadata; /* each element is a separate value */
+} ZipMember;
+
+typedef enum {
+    MARKUP_TEXT,
+    MARKUP_TAG,
+    MARKUP_ENTITY
+} MarkupState;
+
+#define NEMO_TYPE_DOCUMENT_TEXT_STREAM (nemo_document_text_stream_get_type ())
+G_DECLARE_FINAL_TYPE (NemoDocumentTextStream, nemo_document_text_stream, NEMO, DOCUMENT_TEXT_STREAM, GInputStream)
+
+struct _NemoDocumentTextStream {
+    GInputStream parent;
+
+    GInputStream *base;
+    NemoDocumentFormat format;
+
+    GPtrArray *members; /* ZipMembers to read, in archive order */
+    guint next_member;
+
+    /* The member being read */
+    gboolean in_member;
+    guint32 remaining; /* compressed bytes not read yet */
+    GConverter *inflater; /* NULL for stored members */
+    gboolean break_every_tag;
+    guchar *in_buffer;
+    gsize in_length;
+    gsize in_position;
+    guchar *out_buffer;
+
+    /* Markup stripping */
+    MarkupState state;
+    GString *token; /* the tag or entity being read */
+    gchar quote; /* inside a quoted attribute value of the tag */
+    const gchar *skip_until; /* contents of a script or style element */
+    gchar last;
+
+    /* Text waiting to be read */
+    GString *text;
+    gsize text_position;
+};
+
+G_DEFINE_TYPE (NemoDocumentTextStream, nemo_document_text_stream, G_TYPE_INPUT_STREAM)
+
+static guint16
+read_le16 (const guchar *p)
+{
+    return (guint16) p[0] | ((guint16) p[1] << 8);
+}
+
+static guint32
+read_le32 (const guchar *p)
+{
+    return (guint32) p[0] | ((guint32) p[1] << 8) | ((guint32) p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+static void
+zip_member_free (ZipMember *member)
+{
+    g_free (member->name);
+    g_free (member);
+}
+
+gboolean
+nemo_document_format_for_program (const gchar        *program,
+                                  NemoDocumentFormat *format)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (helper_programs); i++) {
+        if (g_strcmp0 (program, helper_programs[i].program) == 0) {
+            *format = helper_programs[i].format;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+has_prefix_in (const gchar  *name,
+               const gchar **prefixes)
+{
+    gint i;
+
+    for (i = 0; prefixes[i] != NULL; i++) {
+        if (g_str_has_prefix (name, prefixes[i])) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Whether the member has text we want, and if so whether it's metadata */
+static gboolean
+member_wanted (NemoDocumentFormat  format,
+               const gchar        *name,
+               gboolean           *is_metadata)
+{
+    *is_metadata = FALSE;
+
+    switch (format) {
+        case NEMO_DOCUMENT_FORMAT_ODF:
+            if (strcmp (name, "meta.xml") == 0) {
+                *is_metadata = TRUE;
+                return TRUE;
+            }
+
+            return strcmp (name, "content.xml") == 0;
+        case NEMO_DOCUMENT_FORMAT_OOXML:
+            if (!g_str_has_suffix (name, ".xml") || !has_prefix_in (name, ooxml_parts)) {
+                return FALSE;
+            }
+
+            *is_metadata = g_str_has_prefix (name, "docProps/");
+            return TRUE;
+        case NEMO_DOCUMENT_FORMAT_EPUB:
+        {
+            const gchar *basename = strrchr (name, '/');
+            gchar *lower;
+            gboolean wanted;
+
+            basename = basename != NULL ? basename + 1 : name;
+            lower = g_ascii_strdown (basename, -1);
+
+            wanted = (g_str_has_suffix (lower, ".xhtml") ||
+                      g_str_has_suffix (lower, ".html") ||
+                      g_str_has_suffix (lower, ".htm")) &&
+                     !has_prefix_in (lower, epub_skipped);
+
+            g_free (lower);
+            return wanted;
+        }
+        default:
+            return FALSE;
+    }
+}
+
+static gboolean
+read_exactly (GInputStream  *stream,
+              goffset        offset,
+              guchar        *buffer,
+              gsize          count,
+              GCancellable  *cancellable,
+              GError       **error)
+{
+    gsize n_read;
+
+    if (!g_seekable_seek (G_SEEKABLE (stream), offset, G_SEEK_SET, cancellable, error) ||
+        !g_input_stream_read_all (stream, buffer, count, &n_read, cancellable, error)) {
+        return FALSE;
+    }
+
+    if (n_read < count) {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated ZIP archive");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Finds the members we want from the archive's central directory */
+static gboolean
+read_directory (NemoDocumentTextStream  *self,
+                GCancellable            *cancellable,
+                GError                 **error)
+{
+    guchar *tail = NULL, *directory = NULL, *end = NULL, *p;
+    goffset size;
+    gsize tail_length;
+    gssize j;
+    guint32 directory_size, directory_offset;
+    guint16 n_entries, i;
+    gboolean ret = FALSE;
+
+    if (!g_seekable_seek (G_SEEKABLE (self->base), 0, G_SEEK_END, cancellable, error)) {
+        return FALSE;
+    }
+
+    size = g_seekable_tell (G_SEEKABLE (self->base));
+
+    if (size < ZIP_END_SIZE) {
+        goto invalid;
+    }
+
+    /* The end record is followed by a comment of up to 64k */
+    tail_length = (gsize) MIN (size, ZIP_END_SIZE + ZIP_MAX_COMMENT);
+    tail = g_malloc (tail_length);
+
+    if (!read_exactly (self->base, size - tail_length, tail, tail_length, cancellable, error)) {
+        goto out;
+    }
+
+    for (j = tail_length - ZIP_END_SIZE; j >= 0; j--) {
+        if (read_le32 (tail + j) == ZIP_END_SIGNATURE) {
+            end = tail + j;
+            break;
+        }
+    }
+
+    if (end == NULL) {
+        goto invalid;
+    }
+
+    n_entries = read_le16 (end + 10);
+    directory_size = read_le32 (end + 12);
+    directory_offset = read_le32 (end + 16);
+
+    /* ZIP64 - nothing a document needs */
+    if (n_entries == 0xffff || directory_offset == 0xffffffff) {
+        goto invalid;
+    }
+
+    if (directory_size > MAX_DIRECTORY_SIZE || (goffset) directory_offset + directory_size > size) {
+        goto invalid;
+    }
+
+    directory = g_malloc (directory_size);
+
+    if (!read_exactly (self->base, directory_offset, directory, directory_size, cancellable, error)) {
+        goto out;
+    }
+
+    p = directory;
+
+    for (i = 0; i < n_entries; i++) {
+        guint16 flags, name_length, extra_length, comment_length;
+        gboolean is_metadata;
+        gchar *name;
+
+        if (p + ZIP_CENTRAL_SIZE > directory + directory_size || read_le32 (p) != ZIP_CENTRAL_SIGNATURE) {
+            goto invalid;
+        }
+
+        flags = read_le16 (p + 8);
+        name_length = read_le16 (p + 28);
+        extra_length = read_le16 (p + 30);
+        comment_length = read_le16 (p + 32);
+
+        if (p + ZIP_CENTRAL_SIZE + name_length > directory + directory_size) {
+            goto invalid;
+        }
+
+        name = g_strndup ((const gchar *) p + ZIP_CENTRAL_SIZE, name_length);
+
+        if (!(flags & ZIP_FLAG_ENCRYPTED) && member_wanted (self->format, name, &is_metadata)) {
+            ZipMember *member = g_new0 (ZipMember, 1);
+
+            member->name = name;
+            member->method = read_le16 (p + 10);
+            member->compressed_size = read_le32 (p + 20);
+            member->local_offset = read_le32 (p + 42);
+            member->is_metadata = is_metadata;
+
+            g_ptr_array_add (self->members, member);
+        } else {
+            g_free (name);
+        }
+
+        p += ZIP_CENTRAL_SIZE + name_length + extra_length + comment_length;
+    }
+
+    ret = TRUE;
+    goto out;
+
+invalid:
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Not a ZIP archive");
+
+out:
+    g_free (tail);
+    g_free (directory);
+
+    return ret;
+}
+
+static void
+append_break (NemoDocumentTextStream *self,
+              gchar                   c)
+{
+    if (self->last == '\0' || self->last == '\n' || self->last == c) {
+        return;
+    }
+
+    g_string_append_c (self->text, c);
+    self->last = c;
+}
+
+static void
+append_text (NemoDocumentTextStream *self,
+             const gchar            *text,
+             gsize                   length)
+{
+    if (length == 0) {
+        return;
+    }
+
+    g_string_append_len (self->text, text, length);
+    self->last = text[length - 1];
+}
+
+static void
+handle_entity (NemoDocumentTextStream *self)
+{
+    const gchar *entity = self->token->str;
+    gunichar c = 0;
+
+    if (entity[0] == '#') {
+        gchar *end;
+
+        if (entity[1] == 'x' || entity[1] == 'X') {
+            c = (gunichar) g_ascii_strtoull (entity + 2, &end, 16);
+        } else {
+            c = (gunichar) g_ascii_strtoull (entity + 1, &end, 10);
+        }
+
+        if (*end != '\0' || !g_unichar_validate (c)) {
+            c = 0;
+        }
+    } else if (strcmp (entity, "amp") == 0) {
+        c = '&';
+    } else if (strcmp (entity, "lt") == 0) {
+        c = '<';
+    } else if (strcmp (entity, "gt") == 0) {
+        c = '>';
+    } else if (strcmp (entity, "quot") == 0) {
+        c = '"';
+    } else if (strcmp (entity, "apos") == 0) {
+        c = '\'';
+    } else if (strcmp (entity, "nbsp") == 0) {
+        c = ' ';
+    }
+
+    if (c != 0) {
+        gchar utf8[6];
+
+        append_text (self, utf8, g_unichar_to_utf8 (c, utf8));
+    } else {
+        /* Not one we know - leave it as it was written */
+        append_text (self, "&", 1);
+        append_text (self, self->token->str, self->token->len);
+        append_text (self, ";", 1);
+    }
+}
+
+static gboolean
+name_in (const gchar  *name,
+         const gchar **names)
+{
+    return g_strv_contains (names, name);
+}
+
+static void
+handle_tag (NemoDocumentTextStream *self)
+{
+    static const gchar *block_elements[] = {
+        "p", "h", "h1", "h2", "h3", "h4", "h5", "h6", "div", "li", "tr", "dt", "dd",
+        "blockquote", "pre", "title", "si", "list-item", "table-row", NULL
+    };
+    static const gchar *cell_elements[] = {
+        "td", "th", "table-cell", NULL
+    };
+    static const gchar *skipped_elements[] = {
+        "script", "style", NULL
+    };
+    gchar *tag = self->token->str;
+    gboolean closing, empty;
+    gchar *name, *local;
+    gsize name_length;
+
+    /* Comments, declarations and processing instructions */
+    if (tag[0] == '!' || tag[0] == '?') {
+        return;
+    }
+
+    closing = tag[0] == '/';
+    empty = self->token->len > 0 && tag[self->token->len - 1] == '/';
+
+    name = closing ? tag + 1 : tag;
+    name_length = strcspn (name, " \t\r\n/");
+    name[name_length] = '\0';
+
+    local = strrchr (name, ':');
+    local = local != NULL ? local + 1 : name;
+
+    if (self->skip_until != NULL) {
+        if (closing && g_ascii_strcasecmp (local, self->skip_until) == 0) {
+            self->skip_until = NULL;
+        }
+
+        return;
+    }
+
+    if (!closing && !empty) {
+        gint i;
+
+        for (i = 0; skipped_elements[i] != NULL; i++) {
+            if (g_ascii_strcasecmp (local, skipped_elements[i]) == 0) {
+                self->skip_until = skipped_elements[i];
+                return;
+            }
+        }
+    }
+
+    if (self->format == NEMO_DOCUMENT_FORMAT_ODF && strcmp (local, "s") == 0) {
+        /* text:s - a run of spaces */
+        append_text (self, " ", 1);
+    } else if (strcmp (local, "tab") == 0) {
+        append_text (self, "\t", 1);
+    } else if (strcmp (local, "br") == 0 || strcmp (local, "cr") == 0 || strcmp (local, "line-break") == 0) {
+        append_text (self, "\n", 1);
+    } else if (closing || empty) {
+        if (self->break_every_tag || name_in (local, block_elements)) {
+            append_break (self, '\n');
+        } else if (name_in (local, cell_elements)) {
+            append_break (self, '\t');
+        }
+    }
+}
+
+static void
+strip_markup (NemoDocumentTextStream *self,
+              const gchar            *data,
+              gsize                   length)
+{
+    const gchar *end = data + length;
+    const gchar *run = NULL; /* start of plain text not yet appended */
+    const gchar *p;
+
+    for (p = data; p < end; p++) {
+        gchar c = *p;
+
+reprocess:
+        switch (self->state) {
+            case MARKUP_TEXT:
+                if (c == '<' || c == '&') {
+                    if (run != NULL) {
+                        append_text (self, run, p - run);
+                        run = NULL;
+                    }
+
+                    g_string_truncate (self->token, 0);
+                    self->quote = '\0';
+                    self->state = c == '<' ? MARKUP_TAG : MARKUP_ENTITY;
+                } else if (run == NULL && self->skip_until == NULL) {
+                    run = p;
+                }
+                break;
+            case MARKUP_TAG:
+                if (self->quote != '\0') {
+                    if (c == self->quote) {
+                        self->quote = '\0';
+                    }
+                } else if (c == '"' || c == '\'') {
+                    self->quote = c;
+                } else if (c == '>') {
+                    handle_tag (self);
+                    self->state = MARKUP_TEXT;
+                    break;
+                }
+
+                if (self->token->len < MAX_TAG_KEPT) {
+                    g_string_append_c (self->token, c);
+                } else if (c == '/') {
+                    /* Only the last character matters past the name */
+                    self->token->str[MAX_TAG_KEPT - 1] = '/';
+                } else {
+                    self->token->str[MAX_TAG_KEPT - 1] = ' ';
+                }
+                break;
+            case MARKUP_ENTITY:
+                if (c == ';') {
+                    if (self->skip_until == NULL) {
+                        handle_entity (self);
+                    }
+
+                    self->state = MARKUP_TEXT;
+                } else if (self->token->len >= MAX_ENTITY_LENGTH || g_ascii_isspace (c) || c == '<' || c == '&') {
+                    /* A stray ampersand */
+                    if (self->skip_until == NULL) {
+                        append_text (self, "&", 1);
+                        append_text (self, self->token->str, self->token->len);
+                    }
+
+                    self->state = MARKUP_TEXT;
+                    goto reprocess;
+                } else {
+                    g_string_append_c (self->token, c);
+                }
+                break;
+            default:
+                g_assert_not_reached ();
+        }
+    }
+
+    if (run != NULL) {
+        append_text (self, run, end - run);
+    }
+}
+
+static void
+finish_member (NemoDocumentTextStream *self)
+{
+    self->in_member = FALSE;
+    g_clear_object (&self->inflater);
+
+    append_break (self, '\n');
+}
+
+static gboolean
+open_member (NemoDocumentTextStream  *self,
+             ZipMember               *member,
+             GCancellable            *cancellable,
+             GError                 **error)
+{
+    guchar header[ZIP_LOCAL_SIZE];
+
+    if (member->method != ZIP_METHOD_STORED && member->method != ZIP_METHOD_DEFLATED) {
+        return TRUE;
+    }
+
+    if (!read_exactly (self->base, member->local_offset, header, ZIP_LOCAL_SIZE, cancellable, error)) {
+        return FALSE;
+    }
+
+    if (read_le32 (header) != ZIP_LOCAL_SIGNATURE) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Damaged ZIP member '%s'", member->name);
+        return FALSE;
+    }
+
+    /* The sizes here can be left out, so the directory's are used */
+    if (!g_seekable_seek (G_SEEKABLE (self->base),
+                          (goffset) member->local_offset + ZIP_LOCAL_SIZE + read_le16 (header + 26) + read_le16 (header + 28),
+                          G_SEEK_SET, cancellable, error)) {
+        return FALSE;
+    }
+
+    self->in_member = TRUE;
+    self->remaining = member->compressed_size;
+    self->in_length = self->in_position = 0;
+    self->break_every_tag = member->is_metadata;
+
+    self->state = MARKUP_TEXT;
+    self->skip_until = NULL;
+
+    if (member->method == ZIP_METHOD_DEFLATED) {
+        self->inflater = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+    }
+
+    return TRUE;
+}
+
+static gboolean
+read_compressed (NemoDocumentTextStream  *self,
+                 GCancellable            *cancellable,
+                 GError                 **error)
+{
+    gssize n_read;
+
+    n_read = g_input_stream_read (self->base, self->in_buffer, MIN (self->remaining, CHUNK_SIZE),
+                                  cancellable, error);
+
+    if (n_read < 0) {
+        return FALSE;
+    }
+
+    self->in_length = n_read;
+    self->in_position = 0;
+    /* A short archive ends the member */
+    self->remaining = n_read > 0 ? self->remaining - n_read : 0;
+
+    return TRUE;
+}
+
+/* Adds the text of the next chunk of the current member */
+static gboolean
+read_member_chunk (NemoDocumentTextStream  *self,
+                   GCancellable            *cancellable,
+                   GError                 **error)
+{
+    GConverterResult result;
+    gsize n_read = 0, n_written = 0;
+
+    if (self->in_position == self->in_length && self->remaining > 0) {
+        if (!read_compressed (self, cancellable, error)) {
+            return FALSE;
+        }
+    }
+
+    if (self->inflater == NULL) {
+        strip_markup (self, (const gchar *) self->in_buffer, self->in_length);
+        self->in_position = self->in_length;
+
+        if (self->remaining == 0) {
+            finish_member (self);
+        }
+
+        return TRUE;
+    }
+
+    result = g_converter_convert (self->inflater,
+                                  self->in_buffer + self->in_position,
+                                  self->in_length - self->in_position,
+                                  self->out_buffer, CHUNK_SIZE,
+                                  self->remaining == 0 ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS,
+                                  &n_read, &n_written, NULL);
+
+    /* A damaged member only loses the rest of its own text */
+    if (result == G_CONVERTER_ERROR) {
+        finish_member (self);
+        return TRUE;
+    }
+
+    self->in_position += n_read;
+    strip_markup (self, (const gchar *) self->out_buffer, n_written);
+
+    if (result == G_CONVERTER_FINISHED || (n_read == 0 && n_written == 0 && self->remaining == 0)) {
+        finish_member (self);
+    }
+
+    return TRUE;
+}
+
+static gssize
+nemo_document_text_stream_read (GInputStream  *stream,
+                                void          *buffer,
+                                gsize          count,
+                                GCancellable  *cancellable,
+                                GError       **error)
+{
+    NemoDocumentTextStream *self = NEMO_DOCUMENT_TEXT_STREAM (stream);
+    gsize n;
+
+    while (self->text_position == self->text->len) {
+        g_string_truncate (self->text, 0);
+        self->text_position = 0;
+
+        if (self->in_member) {
+            if (!read_member_chunk (self, cancellable, error)) {
+                return -1;
+            }
+        } else if (self->next_member < self->members->len) {
+            if (!open_member (self, g_ptr_array_index (self->members, self->next_member++), cancellable, error)) {
+                return -1;
+            }
+        } else {
+            return 0;
+        }
+    }
+
+    n = MIN (count, self->text->len - self->text_position);
+    memcpy (buffer, self->text->str + self->text_position, n);
+    self->text_position += n;
+
+    return n;
+}
+
+static gboolean
+nemo_document_text_stream_close (GInputStream  *stream,
+                                 GCancellable  *cancellable,
+                                 GError       **error)
+{
+    NemoDocumentTextStream *self = NEMO_DOCUMENT_TEXT_STREAM (stream);
+
+    return g_input_stream_close (self->base, cancellable, error);
+}
+
+static void
+nemo_document_text_stream_finalize (GObject *object)
+{
+    NemoDocumentTextStream *self = NEMO_DOCUMENT_TEXT_STREAM (object);
+
+    g_clear_object (&self->base);
+    g_clear_object (&self->inflater);
+    g_ptr_array_unref (self->members);
+    g_string_free (self->token, TRUE);
+    g_string_free (self->text, TRUE);
+    g_free (self->in_buffer);
+    g_free (self->out_buffer);
+
+    G_OBJECT_CLASS (nemo_document_text_stream_parent_class)->finalize (object);
+}
+
+static void
+nemo_document_text_stream_init (NemoDocumentTextStream *self)
+{
+    self->members = g_ptr_array_new_with_free_func ((GDestroyNotify) zip_member_free);
+    self->token = g_string_sized_new (MAX_TAG_KEPT);
+    self->text = g_string_sized_new (CHUNK_SIZE);
+    self->in_buffer = g_malloc (CHUNK_SIZE);
+    self->out_buffer = g_malloc (CHUNK_SIZE);
+}
+
+static void
+nemo_document_text_stream_class_init (NemoDocumentTextStreamClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+    GInputStreamClass *stream_class = G_INPUT_STREAM_CLASS (klass);
+
+    object_class->finalize = nemo_document_text_stream_finalize;
+
+    stream_class->read_fn = nemo_document_text_stream_read;
+    stream_class->close_fn = nemo_document_text_stream_close;
+}
+
+/**
+ * nemo_document_text_stream_new:
+ * @file: a local document
+ * @format: what kind of document it is
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for an error
+ *
+ * Opens @file and reads its table of contents.  The text itself is
+ * only extracted as the returned stream is read.
+ *
+ * Returns: (transfer full) (nullable): a stream of UTF-8 text, or %NULL
+ * if @file isn't a ZIP archive.
+ */
+GInputStream *
+nemo_document_text_stream_new (GFile               *file,
+                               NemoDocumentFormat   format,
+                               GCancellable        *cancellable,
+                               GError             **error)
+{
+    NemoDocumentTextStream *self;
+    GFileInputStream *base;
+
+    base = g_file_read (file, cancellable, error);
+
+    if (base == NULL) {
+        return NULL;
+    }
+
+    self = g_object_new (NEMO_TYPE_DOCUMENT_TEXT_STREAM, NULL);
+    self->base = G_INPUT_STREAM (base);
+    self->format = format;
+
+    if (!read_directory (self, cancellable, error)) {
+        g_object_unref (self);
+        return NULL;
+    }
+
+    return G_INPUT_STREAM (self);
+}
@@ -0,0 +1,50 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-document-text.h: Text of zipped XML documents, for content search.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#ifndef NEMO_DOCUMENT_TEXT_H
+#define NEMO_DOCUMENT_TEXT_H
+
+#include <gio/gio.h>
+
+/* OpenDocument, Office Open XML and EPUB files are ZIP archives of XML.
+ * The stream returned here inflates the members holding the document's text
+ * one after another and strips the markup as it goes, so neither a member
+ * nor the text is ever held whole.
+ *
+ * This only depends on GIO - it's linked into the nemo-odf-to-txt and
+ * nemo-epub2text search helpers as well, and the search engine uses it in
+ * place of running those when they're the configured helper.
+ */
+
+typedef enum {
+    NEMO_DOCUMENT_FORMAT_ODF,
+    NEMO_DOCUMENT_FORMAT_OOXML,
+    NEMO_DOCUMENT_FORMAT_EPUB
+} NemoDocumentFormat;
+
+gboolean      nemo_document_format_for_program (const gchar        *program,
+                                                NemoDocumentFormat *format);
+
+GInputStream *nemo_document_text_stream_new    (GFile              *file,
+                                                NemoDocumentFormat  format,
+                                                GCancellable       *cancellable,
+                                                GError            **error);
+
+#endif /* NEMO_DOCUMENT_TEXT_H */
@@ -36,6 +36,8 @@
 #include <sys/types.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "nemo-file-operations.h"
 
@@ -70,6 +72,19 @@
 #include "nemo-file-undo-operations.h"
 #include "nemo-file-undo-manager.h"
 #include "nemo-job-queue.h"
+#include "nemo-thumbnails.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+/* Only declared with _GNU_SOURCE, but the same on every Linux */
+#ifndef SEEK_DATA
+#define SEEK_DATA 3
+#define SEEK_HOLE 4
+#endif
+#endif
 
 /* TODO: TESTING!!! */
 
@@ -83,7 +98,8 @@ typedef enum {
     OP_KIND_PERMISSIONS,
     OP_KIND_LINK,
     OP_KIND_CREATE,
-    OP_KIND_TRUST
+    OP_KIND_TRUST,
+    OP_KIND_THUMBNAIL
 } OpKind;
 
 typedef struct {
@@ -104,6 +120,8 @@ typedef struct {
 	gboolean delete_all;
 } CommonJob;
 
+typedef struct _ParallelCopy ParallelCopy;
+
 typedef struct {
 	CommonJob common;
 	gboolean is_move;
@@ -117,6 +135,8 @@ typedef struct {
 	gchar *target_name;
 	NemoCopyCallback  done_callback;
 	gpointer done_callback_data;
+	/* Copies small files in folders concurrently, if enabled */
+	ParallelCopy *parallel;
 } CopyMoveJob;
 
 typedef struct {
@@ -171,6 +191,19 @@ typedef struct {
 	guint32 dir_mask;
 } SetPermissionsJob;
 
+typedef struct {
+	CommonJob common;
+	GFile *file;
+	guint64 size_limit;
+	NemoSpeedTradeoffValue show_image_thumbs;
+	GFilesystemPreviewType use_preview;
+	int n_scanned;
+	int n_queued;
+	int n_since_wait;
+	/* Uris that may still be waiting in the thumbnailer, dequeued on cancel */
+	GPtrArray *in_flight;
+} GenerateThumbnailsJob;
+
 typedef struct {
 	int num_files;
 	goffset num_bytes;
@@ -184,6 +217,8 @@ typedef struct {
 	OpKind op;
 	guint64 last_report_time;
 	int last_reported_files_left;
+	/* How the file being copied is copied, if not by g_file_copy () */
+	const char *copy_mode;
 } TransferInfo;
 
 #define SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE 8
@@ -1109,6 +1144,11 @@ generate_initial_job_details (NemoProgressInfo *info,
 
             s = f (_("Waiting to change permissions of files in '%s'"), dest_name);
             break;
+        case OP_KIND_THUMBNAIL:
+            g_return_if_fail (destination != NULL);
+
+            s = f (_("Waiting to generate thumbnails in '%s'"), dest_name);
+            break;
         case OP_KIND_LINK:
             g_return_if_fail (files != NULL);
             g_return_if_fail (destination != NULL);
@@ -3246,6 +3286,22 @@ verify_destination (CommonJob *job,
 	g_object_unref (fsinfo);
 }
 
+static void
+take_copy_details (CommonJob *job,
+		   TransferInfo *transfer_info,
+		   char *details)
+{
+	if (transfer_info->copy_mode != NULL) {
+		char *s;
+
+		s = g_strconcat (details, " \xE2\x80\x94 ", transfer_info->copy_mode, NULL);
+		g_free (details);
+		details = s;
+	}
+
+	nemo_progress_info_take_details (job->progress, details);
+}
+
 static void
 report_copy_progress (CopyMoveJob *copy_job,
 		      SourceInfo *source_info,
@@ -3349,13 +3405,12 @@ report_copy_progress (CopyMoveJob *copy_job,
 		char *s;
 
         if (nemo_progress_info_get_is_paused (job->progress)) {
-            s = g_strdup (_("Paused"));
+            nemo_progress_info_take_details (job->progress, g_strdup (_("Paused")));
         } else {
             /* To translators: %S will expand to a size like "2 bytes" or "3 MB", so something like "4 kb of 4 MB" */
             s = f (_("%S of %S"), transfer_info->num_bytes, total_size);
+            take_copy_details (job, transfer_info, s);
         }
-
-        nemo_progress_info_take_details (job->progress, s);
 	} else {
         if (nemo_progress_info_get_is_paused (job->progress)) {
             nemo_progress_info_take_details (job->progress, g_strdup (_("Paused")));
@@ -3374,7 +3429,7 @@ report_copy_progress (CopyMoveJob *copy_job,
                    transfer_info->num_bytes, total_size,
                    remaining_time,
                    (goffset)transfer_rate);
-            nemo_progress_info_take_details (job->progress, s);
+            take_copy_details (job, transfer_info, s);
         }
     }
 
@@ -3725,6 +3780,39 @@ static void copy_move_file (CopyMoveJob *job,
 			    gboolean *skipped_file,
 			    gboolean readonly_source_fs);
 
+/* Copying a folder can hand its small files to a pool of threads, for when
+ * copying is bound by latency - many small files, or a network destination -
+ * more than by bandwidth.  Only the job thread ever talks to the user or
+ * touches the TransferInfo: a file the pool can't simply copy, because it
+ * already exists or anything else went wrong, is handed back and copied
+ * again with copy_move_file () there, dialogs and all, and the bytes and
+ * files the pool copied are added in whenever the job thread checks on it.
+ * Folders are always created by the job thread before any of their files
+ * are queued, and get their attributes once everything is copied, as a
+ * read-only folder couldn't take files queued for it any more. */
+
+/* Anything bigger is copied by the job thread as before */
+#define PARALLEL_COPY_MAX_SIZE (4 * 1024 * 1024)
+/* The most threads copy-threads can ask for, same as the schema's range */
+#define PARALLEL_COPY_MAX_THREADS 32
+/* Traversal waits for the pool once this many files per thread are queued */
+#define PARALLEL_COPY_BACKLOG_PER_THREAD 64
+/* How often progress is reported while waiting for the pool */
+#define PARALLEL_COPY_WAIT_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+
+static void parallel_copy_queue (CopyMoveJob *copy_job,
+				 GFile *src,
+				 GFile *dest_dir,
+				 gboolean same_fs,
+				 const char *dest_fs_type,
+				 gboolean readonly_source_fs,
+				 SourceInfo *source_info,
+				 TransferInfo *transfer_info);
+static void parallel_copy_defer_attributes (ParallelCopy *parallel,
+					    GFile *src,
+					    GFile *dest,
+					    GFileCopyFlags flags);
+
 typedef enum {
 	CREATE_DEST_DIR_RETRY,
 	CREATE_DEST_DIR_FAILED,
@@ -3850,6 +3938,7 @@ copy_move_directory (CopyMoveJob *copy_job,
 	int response;
 	gboolean skip_error;
 	gboolean local_skipped_file;
+	gboolean parallel;
 	CommonJob *job;
 	GFileCopyFlags flags;
 
@@ -3883,9 +3972,21 @@ copy_move_directory (CopyMoveJob *copy_job,
 	dest_fs_type = NULL;
 
 	skip_error = should_skip_readdir_error (job, src);
+
+	/* Files copied to the desktop may need marking trusted, which only
+	 * copy_move_file () does.  Only native folders are split up - gvfs
+	 * backends do better with one copy at a time. */
+	parallel = copy_job->parallel != NULL &&
+		   g_file_is_native (src) && g_file_is_native (*dest) &&
+		   !(copy_job->desktop_location != NULL &&
+		     g_file_equal (copy_job->desktop_location, *dest));
  retry:
 	error = NULL;
 	enumerator = g_file_enumerate_children (src,
+						parallel ?
+						G_FILE_ATTRIBUTE_STANDARD_NAME ","
+						G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+						G_FILE_ATTRIBUTE_STANDARD_SIZE :
 						G_FILE_ATTRIBUTE_STANDARD_NAME,
 						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
 						job->cancellable,
@@ -3897,9 +3998,18 @@ copy_move_directory (CopyMoveJob *copy_job,
 		       (info = g_file_enumerator_next_file (enumerator, job->cancellable, skip_error?NULL:&error)) != NULL) {
 			src_file = g_file_get_child (src,
 						     g_file_info_get_name (info));
-			copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, NULL, &dest_fs_type,
-					source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
-					readonly_source_fs);
+
+			if (parallel &&
+			    g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+			    g_file_info_get_size (info) <= PARALLEL_COPY_MAX_SIZE &&
+			    !should_skip_file (job, src_file)) {
+				parallel_copy_queue (copy_job, src_file, *dest, same_fs, dest_fs_type,
+						     readonly_source_fs, source_info, transfer_info);
+			} else {
+				copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, NULL, &dest_fs_type,
+						source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
+						readonly_source_fs);
+			}
 			g_object_unref (src_file);
 			g_object_unref (info);
 		}
@@ -3999,10 +4109,14 @@ copy_move_directory (CopyMoveJob *copy_job,
 			flags |= G_FILE_COPY_ALL_METADATA;
 		}
 
-		/* Ignore errors here. Failure to copy metadata is not a hard error */
-		g_file_copy_attributes (src, *dest,
-					flags,
-					job->cancellable, NULL);
+		if (copy_job->parallel != NULL) {
+			parallel_copy_defer_attributes (copy_job->parallel, src, *dest, flags);
+		} else {
+			/* Ignore errors here. Failure to copy metadata is not a hard error */
+			g_file_copy_attributes (src, *dest,
+						flags,
+						job->cancellable, NULL);
+		}
 	}
 
 	if (!job_aborted (job) && copy_job->is_move &&
@@ -4203,6 +4317,570 @@ copy_file_progress_callback (goffset current_num_bytes,
 	}
 }
 
+/* Data is moved this much at a time by copy_file_locally (), with progress
+ * reported and cancellation checked in between */
+#define LOCAL_COPY_CHUNK_SIZE (8 * 1024 * 1024)
+#define LOCAL_COPY_BUFFER_SIZE (256 * 1024)
+
+typedef enum {
+	LOCAL_COPY_UNHANDLED,
+	LOCAL_COPY_DONE,
+	LOCAL_COPY_FAILED
+} LocalCopyResult;
+
+static gboolean
+write_all_at (int fd,
+	      const char *buffer,
+	      gsize len,
+	      goffset offset)
+{
+	while (len > 0) {
+		gssize n = pwrite (fd, buffer, len, offset);
+
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return FALSE;
+		}
+
+		buffer += n;
+		offset += n;
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+/* Copies up to len bytes at offset, returning how many, 0 at the end of the
+ * source or -1 with errno set.  copy_file_range() keeps the data in the
+ * kernel, and may share blocks itself; when it isn't supported between the
+ * two files, *use_range is cleared and this reads and writes instead. */
+static gssize
+copy_chunk (int src_fd,
+	    int dest_fd,
+	    goffset offset,
+	    gsize len,
+	    gboolean *use_range,
+	    char **buffer)
+{
+	gssize n;
+
+#if defined (__linux__) && defined (SYS_copy_file_range)
+	if (*use_range) {
+		gint64 in_offset = offset, out_offset = offset;
+
+		do {
+			n = syscall (SYS_copy_file_range, src_fd, &in_offset, dest_fd, &out_offset, len, 0);
+		} while (n < 0 && errno == EINTR);
+
+		if (n > 0) {
+			return n;
+		}
+
+		/* Anything but a real I/O error means it can't copy between
+		 * these two files - some filesystems even claim there was
+		 * nothing to copy - so carry on without it */
+		if (n < 0 && errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+		    errno != EOPNOTSUPP && errno != ENOTTY) {
+			return -1;
+		}
+
+		*use_range = FALSE;
+	}
+#else
+	*use_range = FALSE;
+#endif
+
+	if (*buffer == NULL) {
+		*buffer = g_malloc (LOCAL_COPY_BUFFER_SIZE);
+	}
+
+	do {
+		n = pread (src_fd, *buffer, MIN (len, LOCAL_COPY_BUFFER_SIZE), offset);
+	} while (n < 0 && errno == EINTR);
+
+	if (n > 0 && !write_all_at (dest_fd, *buffer, n, offset)) {
+		return -1;
+	}
+
+	return n;
+}
+
+/* Copies a plain local file without GIO's read and write loop: as a reflink
+ * sharing the source's blocks where the filesystem can, otherwise with
+ * copy_file_range() so the data stays in the kernel, skipping any holes so
+ * sparse files stay sparse.  Anything else - links, special files, remote
+ * locations and replacing existing files - is left to g_file_copy (). */
+static LocalCopyResult
+copy_file_locally (CommonJob *job,
+		   GFile *src,
+		   GFile *dest,
+		   GFileCopyFlags flags,
+		   GFileProgressCallback progress_callback,
+		   gpointer progress_data,
+		   const char **copy_mode,
+		   GError **error)
+{
+	struct stat st;
+	char *src_path, *dest_path, *buffer;
+	int src_fd, dest_fd, saved_errno;
+	gboolean use_range, sparse;
+	goffset pos;
+
+	/* gvfs locations have a path too, through its FUSE mount, but their
+	 * backend copies them far better than reading and writing it */
+	if ((flags & G_FILE_COPY_OVERWRITE) ||
+	    !g_file_is_native (src) || !g_file_is_native (dest)) {
+		return LOCAL_COPY_UNHANDLED;
+	}
+
+	src_path = g_file_get_path (src);
+	dest_path = g_file_get_path (dest);
+
+	src_fd = -1;
+	dest_fd = -1;
+
+	if (src_path != NULL && dest_path != NULL) {
+		src_fd = open (src_path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+	}
+
+	/* Empty files gain nothing, and files in /proc claim to be empty */
+	if (src_fd >= 0 && fstat (src_fd, &st) == 0 && S_ISREG (st.st_mode) && st.st_size > 0) {
+		/* The real permissions are set with the other attributes below */
+		dest_fd = open (dest_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+				(flags & G_FILE_COPY_TARGET_DEFAULT_PERMS) ? 0666 : 0600);
+	}
+
+	/* g_file_copy () reports these errors its own way */
+	if (dest_fd < 0) {
+		if (src_fd >= 0) {
+			close (src_fd);
+		}
+		g_free (src_path);
+		g_free (dest_path);
+		return LOCAL_COPY_UNHANDLED;
+	}
+
+	buffer = NULL;
+	saved_errno = 0;
+	use_range = TRUE;
+	sparse = FALSE;
+	pos = 0;
+
+#ifdef FICLONE
+	if (ioctl (dest_fd, FICLONE, src_fd) == 0) {
+		*copy_mode = _("Cloned");
+		pos = st.st_size;
+		progress_callback (pos, st.st_size, progress_data);
+	}
+#endif
+
+	while (pos < st.st_size) {
+		goffset data_start, data_end;
+
+		data_start = lseek (src_fd, pos, SEEK_DATA);
+
+		if (data_start < 0) {
+			/* Past the last data, or holes aren't reported here */
+			data_start = errno == ENXIO ? st.st_size : pos;
+		}
+
+		data_end = data_start < st.st_size ? lseek (src_fd, data_start, SEEK_HOLE) : st.st_size;
+
+		if (data_end < 0 || data_end > st.st_size) {
+			data_end = st.st_size;
+		}
+
+		if (data_start > pos) {
+			sparse = TRUE;
+		}
+
+		pos = data_start;
+
+		while (pos < data_end) {
+			gssize n;
+
+			if (g_cancellable_is_cancelled (job->cancellable)) {
+				goto fail;
+			}
+
+			n = copy_chunk (src_fd, dest_fd, pos,
+					MIN (data_end - pos, LOCAL_COPY_CHUNK_SIZE),
+					&use_range, &buffer);
+
+			if (n < 0) {
+				saved_errno = errno;
+				goto fail;
+			}
+
+			if (n == 0) {
+				/* The source was truncated while copying */
+				st.st_size = data_end = pos;
+				break;
+			}
+
+			pos += n;
+
+			if (use_range) {
+				*copy_mode = sparse ? _("Copied in the kernel, skipping holes") :
+						      _("Copied in the kernel");
+			} else {
+				*copy_mode = sparse ? _("Skipping holes") : NULL;
+			}
+
+			progress_callback (pos, st.st_size, progress_data);
+		}
+
+		/* Count skipped holes as copied, so the total still adds up */
+		progress_callback (MIN (data_end, st.st_size), st.st_size, progress_data);
+	}
+
+	/* A hole at the end isn't written, so the size has to be set */
+	if (sparse && ftruncate (dest_fd, st.st_size) < 0) {
+		saved_errno = errno;
+		goto fail;
+	}
+
+	if (close (dest_fd) < 0) {
+		dest_fd = -1;
+		saved_errno = errno;
+		goto fail;
+	}
+
+	close (src_fd);
+	g_free (buffer);
+
+	/* The same attributes, and permissions, g_file_copy () would set.
+	 * Filesystems that can't take some of them don't fail the copy. */
+	g_file_copy_attributes (src, dest, flags, job->cancellable, NULL);
+
+	g_free (src_path);
+	g_free (dest_path);
+
+	return LOCAL_COPY_DONE;
+
+ fail:
+	if (dest_fd >= 0) {
+		close (dest_fd);
+	}
+	close (src_fd);
+	g_unlink (dest_path);
+
+	if (!g_cancellable_set_error_if_cancelled (job->cancellable, error)) {
+		g_set_error_literal (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+				     g_strerror (saved_errno));
+	}
+
+	g_free (buffer);
+	g_free (src_path);
+	g_free (dest_path);
+
+	return LOCAL_COPY_FAILED;
+}
+
+struct _ParallelCopy {
+	CopyMoveJob *job;
+	GThreadPool *pool;
+	int backlog_limit;
+
+	GMutex lock;
+	GCond cond;
+	int outstanding;
+	goffset copied_bytes;
+	GList *done;
+	GList *failed;
+
+	/* DirAttributes, newest first - job thread only */
+	GList *dir_attributes;
+};
+
+typedef struct {
+	ParallelCopy *parallel;
+	GFile *src;
+	GFile *dest_dir;
+	GFile *dest;
+	char *dest_fs_type;
+	gboolean same_fs;
+	gboolean readonly_source_fs;
+	goffset last_size;
+} ParallelCopyTask;
+
+typedef struct {
+	GFile *src;
+	GFile *dest;
+	GFileCopyFlags flags;
+} DirAttributes;
+
+static void
+parallel_copy_task_free (ParallelCopyTask *task)
+{
+	g_object_unref (task->src);
+	g_object_unref (task->dest_dir);
+	g_clear_object (&task->dest);
+	g_free (task->dest_fs_type);
+	g_free (task);
+}
+
+static void
+parallel_copy_progress_callback (goffset current_num_bytes,
+				 goffset total_num_bytes,
+				 gpointer user_data)
+{
+	ParallelCopyTask *task = user_data;
+	ParallelCopy *parallel = task->parallel;
+
+	if (current_num_bytes > task->last_size) {
+		g_mutex_lock (&parallel->lock);
+		parallel->copied_bytes += current_num_bytes - task->last_size;
+		g_mutex_unlock (&parallel->lock);
+
+		task->last_size = current_num_bytes;
+	}
+}
+
+/* Runs on the pool.  Never overwrites anything, so the worst it can do is
+ * fail and leave the file to the job thread. */
+static void
+parallel_copy_task_func (gpointer task_data,
+			 gpointer user_data)
+{
+	ParallelCopyTask *task = task_data;
+	ParallelCopy *parallel = user_data;
+	CommonJob *job = (CommonJob *) parallel->job;
+	LocalCopyResult local_res;
+	GFileCopyFlags flags;
+	const char *copy_mode = NULL;
+	GError *error = NULL;
+	gboolean res = FALSE;
+
+	if (!job_aborted (job)) {
+		flags = G_FILE_COPY_NOFOLLOW_SYMLINKS;
+		if (task->readonly_source_fs) {
+			flags |= G_FILE_COPY_TARGET_DEFAULT_PERMS;
+		}
+
+		task->dest = get_target_file (task->src, task->dest_dir, task->dest_fs_type, task->same_fs);
+
+		local_res = copy_file_locally (job, task->src, task->dest, flags,
+					       parallel_copy_progress_callback, task,
+					       &copy_mode, &error);
+
+		if (local_res == LOCAL_COPY_UNHANDLED) {
+			res = g_file_copy (task->src, task->dest,
+					   flags,
+					   job->cancellable,
+					   parallel_copy_progress_callback,
+					   task,
+					   &error);
+		} else {
+			res = local_res == LOCAL_COPY_DONE;
+		}
+	}
+
+	g_mutex_lock (&parallel->lock);
+
+	if (res) {
+		parallel->done = g_list_prepend (parallel->done, task);
+	} else {
+		/* The copy that counts is the job thread's, if any */
+		parallel->copied_bytes -= task->last_size;
+
+		if (error != NULL && !IS_IO_ERROR (error, CANCELLED)) {
+			parallel->failed = g_list_prepend (parallel->failed, task);
+		} else {
+			parallel_copy_task_free (task);
+		}
+	}
+
+	parallel->outstanding--;
+	g_cond_signal (&parallel->cond);
+
+	g_mutex_unlock (&parallel->lock);
+
+	g_clear_error (&error);
+}
+
+static ParallelCopy *
+parallel_copy_new (CopyMoveJob *job,
+		   int n_threads)
+{
+	ParallelCopy *parallel;
+
+	parallel = g_new0 (ParallelCopy, 1);
+	parallel->job = job;
+	parallel->backlog_limit = n_threads * PARALLEL_COPY_BACKLOG_PER_THREAD;
+	g_mutex_init (&parallel->lock);
+	g_cond_init (&parallel->cond);
+
+	parallel->pool = g_thread_pool_new (parallel_copy_task_func, parallel,
+					    n_threads, FALSE, NULL);
+
+	return parallel;
+}
+
+/* Adds in what the pool has copied since last time, and copies whatever it
+ * handed back.  Returns once no more than wait_for files are outstanding. */
+static void
+parallel_copy_flush (CopyMoveJob *copy_job,
+		     SourceInfo *source_info,
+		     TransferInfo *transfer_info,
+		     int wait_for)
+{
+	ParallelCopy *parallel = copy_job->parallel;
+	CommonJob *job = (CommonJob *) copy_job;
+
+	while (TRUE) {
+		GList *done, *failed, *l;
+		goffset copied_bytes;
+		gboolean retried;
+		int outstanding;
+
+		g_mutex_lock (&parallel->lock);
+
+		if (parallel->outstanding > wait_for &&
+		    parallel->done == NULL && parallel->failed == NULL) {
+			g_cond_wait_until (&parallel->cond, &parallel->lock,
+					   g_get_monotonic_time () + PARALLEL_COPY_WAIT_INTERVAL);
+		}
+
+		done = parallel->done;
+		failed = g_list_reverse (parallel->failed);
+		copied_bytes = parallel->copied_bytes;
+		outstanding = parallel->outstanding;
+
+		parallel->done = NULL;
+		parallel->failed = NULL;
+		parallel->copied_bytes = 0;
+
+		g_mutex_unlock (&parallel->lock);
+
+		transfer_info->num_bytes += copied_bytes;
+
+		/* What copy_move_file () does for each file it copies */
+		for (l = done; l != NULL; l = l->next) {
+			ParallelCopyTask *task = l->data;
+
+			transfer_info->num_files++;
+			nemo_file_changes_queue_file_added (task->dest);
+
+			if (job->undo_info != NULL) {
+				nemo_file_undo_info_ext_add_origin_target_pair (NEMO_FILE_UNDO_INFO_EXT (job->undo_info),
+										task->src, task->dest);
+			}
+		}
+
+		report_copy_progress (copy_job, source_info, transfer_info);
+
+		for (l = failed; l != NULL && !job_aborted (job); l = l->next) {
+			ParallelCopyTask *task = l->data;
+			char *dest_fs_type = g_strdup (task->dest_fs_type);
+			gboolean skipped_file = FALSE;
+
+			copy_move_file (copy_job, task->src, task->dest_dir, task->same_fs, FALSE, NULL,
+					&dest_fs_type, source_info, transfer_info, NULL, NULL, FALSE,
+					&skipped_file, task->readonly_source_fs);
+
+			g_free (dest_fs_type);
+		}
+
+		retried = failed != NULL;
+
+		g_list_free_full (done, (GDestroyNotify) parallel_copy_task_free);
+		g_list_free_full (failed, (GDestroyNotify) parallel_copy_task_free);
+
+		/* Copying what failed may have queued more */
+		if (outstanding <= wait_for && !retried) {
+			break;
+		}
+	}
+}
+
+static void
+parallel_copy_queue (CopyMoveJob *copy_job,
+		     GFile *src,
+		     GFile *dest_dir,
+		     gboolean same_fs,
+		     const char *dest_fs_type,
+		     gboolean readonly_source_fs,
+		     SourceInfo *source_info,
+		     TransferInfo *transfer_info)
+{
+	ParallelCopy *parallel = copy_job->parallel;
+	ParallelCopyTask *task;
+
+	task = g_new0 (ParallelCopyTask, 1);
+	task->parallel = parallel;
+	task->src = g_object_ref (src);
+	task->dest_dir = g_object_ref (dest_dir);
+	task->dest_fs_type = g_strdup (dest_fs_type);
+	task->same_fs = same_fs;
+	task->readonly_source_fs = readonly_source_fs;
+
+	g_mutex_lock (&parallel->lock);
+	parallel->outstanding++;
+	g_mutex_unlock (&parallel->lock);
+
+	g_thread_pool_push (parallel->pool, task, NULL);
+
+	parallel_copy_flush (copy_job, source_info, transfer_info, parallel->backlog_limit);
+}
+
+static void
+parallel_copy_defer_attributes (ParallelCopy *parallel,
+				GFile *src,
+				GFile *dest,
+				GFileCopyFlags flags)
+{
+	DirAttributes *attributes;
+
+	attributes = g_new0 (DirAttributes, 1);
+	attributes->src = g_object_ref (src);
+	attributes->dest = g_object_ref (dest);
+	attributes->flags = flags;
+
+	parallel->dir_attributes = g_list_prepend (parallel->dir_attributes, attributes);
+}
+
+/* Waits for the pool to finish, then sets the folders' attributes - the
+ * innermost first, as a folder made read-only couldn't take them. */
+static void
+parallel_copy_finish (CopyMoveJob *copy_job,
+		      SourceInfo *source_info,
+		      TransferInfo *transfer_info)
+{
+	ParallelCopy *parallel = copy_job->parallel;
+	CommonJob *job = (CommonJob *) copy_job;
+	GList *l;
+
+	parallel_copy_flush (copy_job, source_info, transfer_info, 0);
+
+	g_thread_pool_free (parallel->pool, FALSE, TRUE);
+
+	parallel->dir_attributes = g_list_reverse (parallel->dir_attributes);
+
+	for (l = parallel->dir_attributes; l != NULL; l = l->next) {
+		DirAttributes *attributes = l->data;
+
+		/* Ignore errors here. Failure to copy metadata is not a hard error */
+		g_file_copy_attributes (attributes->src, attributes->dest,
+					attributes->flags,
+					job->cancellable, NULL);
+
+		g_object_unref (attributes->src);
+		g_object_unref (attributes->dest);
+		g_free (attributes);
+	}
+
+	g_list_free (parallel->dir_attributes);
+
+	g_mutex_clear (&parallel->lock);
+	g_cond_clear (&parallel->cond);
+	g_free (parallel);
+
+	copy_job->parallel = NULL;
+}
+
 static gboolean
 test_dir_is_parent (GFile *child, GFile *root)
 {
@@ -4564,12 +5242,23 @@ copy_move_file (CopyMoveJob *copy_job,
 				   &pdata,
 				   &error);
 	} else {
-		res = g_file_copy (src, dest,
-				   flags,
-				   job->cancellable,
-				   copy_file_progress_callback,
-				   &pdata,
-				   &error);
+		LocalCopyResult local_res;
+
+		transfer_info->copy_mode = NULL;
+		local_res = copy_file_locally (job, src, dest, flags,
+					       copy_file_progress_callback, &pdata,
+					       &transfer_info->copy_mode, &error);
+
+		if (local_res == LOCAL_COPY_UNHANDLED) {
+			res = g_file_copy (src, dest,
+					   flags,
+					   job->cancellable,
+					   copy_file_progress_callback,
+					   &pdata,
+					   &error);
+		} else {
+			res = local_res == LOCAL_COPY_DONE;
+		}
 	}
 
 	if (res) {
@@ -4968,6 +5657,7 @@ copy_job (GIOSchedulerJob *io_job,
 	TransferInfo transfer_info;
 	char *dest_fs_id;
 	GFile *dest;
+	int n_threads;
 
 	job = user_data;
 	common = &job->common;
@@ -5005,11 +5695,21 @@ copy_job (GIOSchedulerJob *io_job,
 
 	nemo_progress_info_start (common->progress);
 
+	n_threads = g_settings_get_int (nemo_preferences, NEMO_PREFERENCES_COPY_THREADS);
+	n_threads = CLAMP (n_threads, 1, PARALLEL_COPY_MAX_THREADS);
+	if (n_threads > 1) {
+		job->parallel = parallel_copy_new (job, n_threads);
+	}
+
 	memset (&transfer_info, 0, sizeof (transfer_info));
 	copy_files (job,
 		    dest_fs_id,
 		    &source_info, &transfer_info);
 
+	if (job->parallel != NULL) {
+		parallel_copy_finish (job, &source_info, &transfer_info);
+	}
+
  aborted:
 
 	g_free (dest_fs_id);
@@ -6231,6 +6931,318 @@ nemo_file_set_permissions_recursive (const char *directory,
     add_job_to_job_queue (set_permissions_job, job, job->common.cancellable, job->common.progress, OP_KIND_PERMISSIONS);
 }
 
+/* Thumbnails are queued this many at a time, and the next batch waits until
+ * the thumbnailer is down to THUMBNAIL_LOW_WATER. */
+#define THUMBNAIL_BATCH 64
+#define THUMBNAIL_LOW_WATER 16
+#define THUMBNAIL_POLL_INTERVAL (250 * 1000)
+
+#ifdef __linux__
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#endif
+
+/* Puts the calling thread in the idle I/O class, returning the old priority
+ * to restore, or -1. */
+static int
+set_thread_io_priority_idle (void)
+{
+#if defined (__linux__) && defined (SYS_ioprio_set)
+	int old;
+
+	old = syscall (SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+
+	if (old < 0 ||
+	    syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0) {
+		return -1;
+	}
+
+	return old;
+#else
+	return -1;
+#endif
+}
+
+static void
+restore_thread_io_priority (int priority)
+{
+#if defined (__linux__) && defined (SYS_ioprio_set)
+	if (priority >= 0) {
+		syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, priority);
+	}
+#endif
+}
+
+static gboolean
+generate_thumbnails_job_done (gpointer user_data)
+{
+	GenerateThumbnailsJob *job;
+	guint i;
+
+	job = user_data;
+
+	if (job_aborted ((CommonJob *) job)) {
+		for (i = 0; i < job->in_flight->len; i++) {
+			nemo_thumbnail_remove_from_queue (g_ptr_array_index (job->in_flight, i));
+		}
+	}
+
+	g_ptr_array_unref (job->in_flight);
+	g_object_unref (job->file);
+
+	finalize_common ((CommonJob *)job);
+	return FALSE;
+}
+
+static void
+report_generate_thumbnails_progress (GenerateThumbnailsJob *job,
+				     gboolean               waiting)
+{
+	CommonJob *common;
+	char *s, *details;
+
+	common = (CommonJob *)job;
+
+	s = f (ngettext ("%'d thumbnail queued, %'d files scanned",
+			 "%'d thumbnails queued, %'d files scanned",
+			 job->n_queued),
+	       job->n_queued, job->n_scanned);
+
+	if (waiting) {
+		details = g_strconcat (s, "\xE2\x80\x94", _("Paused"), NULL);
+		g_free (s);
+	} else {
+		details = s;
+	}
+
+	nemo_progress_info_take_details (common->progress, details);
+	nemo_progress_info_pulse_progress (common->progress);
+}
+
+/* Waits for the thumbnailer to work through what we gave it, for as long as
+ * the user is paging through folders (their thumbnails come first) or has
+ * paused us. */
+static void
+wait_for_thumbnailer (GenerateThumbnailsJob *job,
+		      guint                  low_water)
+{
+	CommonJob *common;
+	gboolean waiting, reported_waiting;
+
+	common = (CommonJob *)job;
+	reported_waiting = FALSE;
+
+	while (!job_aborted (common)) {
+		waiting = nemo_progress_info_get_is_paused (common->progress) ||
+			  nemo_thumbnail_user_is_browsing ();
+
+		if (!waiting && nemo_thumbnail_get_n_queued () <= low_water) {
+			break;
+		}
+
+		if (waiting != reported_waiting) {
+			report_generate_thumbnails_progress (job, waiting);
+			reported_waiting = waiting;
+		}
+
+		g_usleep (THUMBNAIL_POLL_INTERVAL);
+	}
+
+	/* Everything older than the last two batches has been thumbnailed */
+	if (job->in_flight->len > 2 * THUMBNAIL_BATCH) {
+		g_ptr_array_remove_range (job->in_flight, 0, job->in_flight->len - 2 * THUMBNAIL_BATCH);
+	}
+
+	job->n_since_wait = 0;
+	report_generate_thumbnails_progress (job, FALSE);
+}
+
+static void
+generate_thumbnails_file (GenerateThumbnailsJob *job,
+			  GFile                 *file,
+			  GFileInfo             *info)
+{
+	CommonJob *common;
+	GFileEnumerator *enumerator;
+	GFileInfo *child_info;
+	GFile *child;
+	const char *mime_type;
+	char *uri;
+
+	common = (CommonJob *)job;
+
+	if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+		enumerator = g_file_enumerate_children (file,
+							G_FILE_ATTRIBUTE_STANDARD_NAME","
+							G_FILE_ATTRIBUTE_STANDARD_TYPE","
+							G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN","
+							G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE","
+							G_FILE_ATTRIBUTE_STANDARD_SIZE","
+							G_FILE_ATTRIBUTE_TIME_MODIFIED,
+							G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+							common->cancellable,
+							NULL);
+		/* Ignore errors */
+		if (enumerator == NULL) {
+			return;
+		}
+
+		while (!job_aborted (common) &&
+		       (child_info = g_file_enumerator_next_file (enumerator, common->cancellable, NULL)) != NULL) {
+			if (!g_file_info_get_is_hidden (child_info)) {
+				child = g_file_get_child (file, g_file_info_get_name (child_info));
+				generate_thumbnails_file (job, child, child_info);
+				g_object_unref (child);
+			}
+
+			g_object_unref (child_info);
+		}
+
+		g_file_enumerator_close (enumerator, common->cancellable, NULL);
+		g_object_unref (enumerator);
+		return;
+	}
+
+	if (g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR) {
+		return;
+	}
+
+	job->n_scanned++;
+
+	mime_type = g_file_info_get_content_type (info);
+
+	if (mime_type == NULL ||
+	    (guint64) g_file_info_get_size (info) > job->size_limit) {
+		return;
+	}
+
+	uri = g_file_get_uri (file);
+
+	if (nemo_thumbnail_queue_background (uri,
+					     mime_type,
+					     g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+					     g_file_info_get_size (info))) {
+		g_ptr_array_add (job->in_flight, uri);
+		job->n_queued++;
+
+		if (++job->n_since_wait >= THUMBNAIL_BATCH) {
+			wait_for_thumbnailer (job, THUMBNAIL_LOW_WATER);
+		}
+	} else {
+		g_free (uri);
+	}
+
+	if (job->n_scanned % 100 == 0) {
+		report_generate_thumbnails_progress (job, FALSE);
+	}
+}
+
+/* What nemo_file_should_show_thumbnail () goes by, for the folder as a whole */
+static gboolean
+thumbnails_wanted (GenerateThumbnailsJob *job)
+{
+	if (job->use_preview == G_FILESYSTEM_PREVIEW_TYPE_NEVER) {
+		return FALSE;
+	}
+
+	switch (job->show_image_thumbs) {
+	case NEMO_SPEED_TRADEOFF_ALWAYS:
+		return TRUE;
+	case NEMO_SPEED_TRADEOFF_NEVER:
+		return FALSE;
+	default:
+		return job->use_preview == G_FILESYSTEM_PREVIEW_TYPE_IF_LOCAL ||
+		       g_file_is_native (job->file) ||
+		       g_file_has_uri_scheme (job->file, "trash");
+	}
+}
+
+static gboolean
+generate_thumbnails_job (GIOSchedulerJob *io_job,
+			 GCancellable *cancellable,
+			 gpointer user_data)
+{
+	GenerateThumbnailsJob *job = user_data;
+	CommonJob *common;
+	GFileInfo *info;
+	int old_io_priority;
+
+	common = (CommonJob *)job;
+	common->io_job = io_job;
+
+	nemo_progress_info_set_status (common->progress,
+				       _("Generating thumbnails"));
+
+	nemo_progress_info_start (common->progress);
+
+	old_io_priority = set_thread_io_priority_idle ();
+
+	/* The views go by the folder's filesystem too, to tell whether to
+	 * thumbnail it at all */
+	info = g_file_query_filesystem_info (job->file,
+					     G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW,
+					     common->cancellable,
+					     NULL);
+
+	if (info != NULL) {
+		job->use_preview = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW);
+		g_object_unref (info);
+	}
+
+	if (thumbnails_wanted (job)) {
+		info = g_file_query_info (job->file,
+					  G_FILE_ATTRIBUTE_STANDARD_TYPE,
+					  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+					  common->cancellable,
+					  NULL);
+
+		if (info != NULL) {
+			generate_thumbnails_file (job, job->file, info);
+			g_object_unref (info);
+		}
+	}
+
+	/* Stay around until the last batch is done, so the progress is honest */
+	wait_for_thumbnailer (job, 0);
+
+	restore_thread_io_priority (old_io_priority);
+
+	g_io_scheduler_job_send_to_mainloop_async (io_job,
+						   generate_thumbnails_job_done,
+						   job,
+						   NULL);
+
+	return FALSE;
+}
+
+void
+nemo_file_operations_generate_thumbnails (const char *directory,
+					  GtkWindow  *parent_window)
+{
+	GenerateThumbnailsJob *job;
+
+	nemo_thumbnail_background_begin ();
+
+	job = op_job_new (GenerateThumbnailsJob, parent_window);
+	job->file = g_file_new_for_uri (directory);
+	job->in_flight = g_ptr_array_new_with_free_func (g_free);
+
+	g_settings_get (nemo_preferences,
+			NEMO_PREFERENCES_IMAGE_FILE_THUMBNAIL_LIMIT,
+			"t", &job->size_limit);
+	job->show_image_thumbs = g_settings_get_enum (nemo_preferences,
+						      NEMO_PREFERENCES_SHOW_IMAGE_FILE_THUMBNAILS);
+
+	generate_initial_job_details (job->common.progress, OP_KIND_THUMBNAIL, NULL, job->file);
+
+	nemo_job_queue_add_background_job (nemo_job_queue_get (),
+					   generate_thumbnails_job,
+					   job,
+					   job->common.cancellable,
+					   job->common.progress);
+}
+
 static GList *
 location_list_from_uri_list (const GList *uris)
 {
@@ -101,6 +101,9 @@ void nemo_file_set_permissions_recursive (const char                     *direct
 					      NemoOpCallback              callback,
 					      gpointer                        callback_data);
 
+void nemo_file_operations_generate_thumbnails (const char             *directory,
+					       GtkWindow              *parent_window);
+
 void nemo_file_operations_unmount_mount (GtkWindow                      *parent_window,
 					     GMount                         *mount,
 					     gboolean                        eject,
@@ -44,6 +44,7 @@
 #include "nemo-search-directory.h"
 #include "nemo-search-engine.h"
 #include "nemo-search-directory-file.h"
+#include "nemo-thumbnail-cache.h"
 #include "nemo-thumbnails.h"
 #include "nemo-trash-monitor.h"
 #include "nemo-vfs-file.h"
@@ -4580,9 +4581,59 @@ delete_failed_thumbnail_marker (NemoFile *file)
     g_free (path);
 }
 
+/* The uri the thumbnailer knows @file by - nemo_create_thumbnail () makes
+ * favorites' thumbnails for the file they point to, so their failures are
+ * remembered against it too. */
+static gchar *
+get_thumbnailed_uri (NemoFile *file)
+{
+    if (nemo_file_is_in_favorites (file)) {
+        return nemo_file_get_symbolic_link_target_uri (file);
+    }
+
+    return nemo_file_get_uri (file);
+}
+
+/* The failed marker is only looked at when the file info is loaded, so
+ * fall back on what the thumbnailer remembers. */
+static gboolean
+thumbnailing_recently_failed (NemoFile *file)
+{
+    gboolean failed;
+    gchar *uri, *mime_type;
+
+    mime_type = nemo_file_get_mime_type (file);
+
+    if (nemo_thumbnail_mime_type_is_disabled (mime_type)) {
+        g_free (mime_type);
+        return TRUE;
+    }
+
+    uri = get_thumbnailed_uri (file);
+    failed = uri != NULL && nemo_thumbnail_is_known_failure (uri, file->details->mtime);
+
+    g_free (uri);
+    g_free (mime_type);
+
+    return failed;
+}
+
 void
 nemo_file_delete_thumbnail (NemoFile *file)
 {
+    gchar *uri;
+
+    uri = get_thumbnailed_uri (file);
+    if (uri != NULL) {
+        nemo_thumbnail_forget_failure (uri);
+    }
+    g_free (uri);
+
+    /* Images shown as their own thumbnail are cached by their own uri */
+    uri = nemo_file_get_uri (file);
+    nemo_thumbnail_cache_remove_path (uri);
+    g_free (uri);
+
     if (file->details->thumbnail_path == NULL) {
         if (file->details->thumbnailing_failed) {
             delete_failed_thumbnail_marker (file);
@@ -4595,6 +4646,7 @@ nemo_file_delete_thumbnail (NemoFile *file)
 
     nemo_file_invalidate_attributes (file, NEMO_FILE_ATTRIBUTE_THUMBNAIL);
     g_clear_object (&file->details->thumbnail);
+    nemo_thumbnail_cache_remove_path (file->details->thumbnail_path);
 
     success = g_unlink (file->details->thumbnail_path);
 
@@ -5028,7 +5080,8 @@ nemo_file_get_icon (NemoFile *file,
 			   file->details->can_read &&
 			   !file->details->is_thumbnailing &&
 			   !file->details->thumbnailing_failed) {
-			if (nemo_can_thumbnail (file)) {
+			if (nemo_can_thumbnail (file) &&
+			    !thumbnailing_recently_failed (file)) {
 				nemo_create_thumbnail (file);
 			}
 		}
@@ -0,0 +1,1429 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-filename-index.c: A stored index of file names for fast searching.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#include <config.h>
+#include "nemo-filename-index.h"
+#include "nemo-file-utilities.h"
+#include "nemo-global-preferences.h"
+#include "nemo-search-engine.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#define DEBUG_FLAG NEMO_DEBUG_SEARCH
+#include "nemo-debug.h"
+
+#ifndef GLIB_VERSION_2_70
+#define g_pattern_spec_match g_pattern_match
+#endif
+
+#define INDEX_MAGIC "NEMOFNX"
+#define INDEX_VERSION 1
+
+/* Wait this long after hearing of a change before re-reading directories,
+ * so a burst of changes costs one pass */
+#define DIRTY_DELAY 2
+/* How often every indexed directory's mtime is checked */
+#define VERIFY_INTERVAL (30 * 60)
+/* Rebuild the tables once this fraction of the entries are deleted */
+#define COMPACT_RATIO 4
+
+#define NO_ENTRY G_MAXUINT32
+
+#define INDEX_ATTRIBUTES \
+    G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+    G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+    G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN
+
+#define MTIME_ATTRIBUTES \
+    G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+    G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
+
+#define PACK_TRIGRAM(s) (((guint32) (guchar) (s)[0] << 16) | ((guint32) (guchar) (s)[1] << 8) | (guint32) (guchar) (s)[2])
+
+enum {
+    ENTRY_DIRECTORY = 1 << 0,
+    ENTRY_HIDDEN    = 1 << 1,
+    ENTRY_SKIPPED   = 1 << 2, /* a directory in search-skip-folders - its contents aren't indexed */
+    ENTRY_DELETED   = 1 << 3
+};
+
+#define STORED_FLAGS (ENTRY_DIRECTORY | ENTRY_HIDDEN | ENTRY_SKIPPED)
+
+/* Entries are only ever appended, so a parent's id is always lower than
+ * its children's, and so are the ids in each trigram's posting list. */
+typedef struct {
+    guint32 parent;
+    guint32 first_child;
+    guint32 next_sibling;
+    guint32 name;    /* offset into names - the name on disk, or the full path of a root */
+    guint32 display; /* offset into names - the normalized display name, often the same as name */
+    guint32 folded;  /* offset into folded - the case folded display name */
+    guint32 flags;
+    gint64 mtime;   /* directories only - as of when they were last read */
+} IndexEntry;
+
+struct _NemoFilenameIndexQuery {
+    gchar *location_path;
+    gboolean recurse;
+    gboolean show_hidden;
+    gboolean case_sensitive;
+    GPtrArray *patterns; /* GPatternSpecs, all of which must match */
+    GArray *trigrams;    /* guint32 - all of which a matching name has */
+};
+
+typedef struct {
+    gboolean verify;
+    GPtrArray *dirty; /* paths */
+    gchar **roots;
+    gchar **skip;
+} RefreshJob;
+
+typedef struct {
+    gchar *name;
+    guint32 flags;
+} ScannedChild;
+
+/* Guards everything below, up to index_ready */
+static GRWLock index_lock;
+static GArray *entries = NULL;
+static GString *names = NULL;
+static GString *folded = NULL;
+static GHashTable *trigrams = NULL;    /* packed trigram -> GArray of guint32 ids */
+static GHashTable *directories = NULL; /* path -> id + 1 */
+static guint n_deleted = 0;
+
+static gint index_ready = FALSE;
+
+/* Main thread only */
+static gboolean initialized = FALSE;
+static gboolean refresh_running = FALSE;
+static gboolean verify_pending = FALSE;
+static GHashTable *dirty_paths = NULL;
+static guint dirty_timeout_id = 0;
+
+static inline IndexEntry *
+get_entry (guint32 id)
+{
+    return &g_array_index (entries, IndexEntry, id);
+}
+
+static inline const gchar *
+entry_name (guint32 id)
+{
+    return names->str + get_entry (id)->name;
+}
+
+static gchar *
+entry_path_locked (guint32 id)
+{
+    GPtrArray *parts;
+    gchar **reversed;
+    gchar *path;
+    guint32 p;
+    guint i;
+
+    parts = g_ptr_array_new ();
+
+    for (p = id; p != NO_ENTRY; p = get_entry (p)->parent) {
+        g_ptr_array_add (parts, (gpointer) entry_name (p));
+    }
+
+    reversed = g_new0 (gchar *, parts->len + 1);
+
+    for (i = 0; i < parts->len; i++) {
+        reversed[i] = g_ptr_array_index (parts, parts->len - i - 1);
+    }
+
+    path = g_build_filenamev (reversed);
+
+    g_free (reversed);
+    g_ptr_array_free (parts, TRUE);
+
+    return path;
+}
+
+/* The NFD display name, which case sensitive queries match against */
+static gchar *
+normalize_name (const gchar *name)
+{
+    gchar *display, *normalized;
+
+    display = g_filename_display_name (name);
+    normalized = g_utf8_normalize (display, -1, G_NORMALIZE_NFD);
+
+    if (normalized == NULL) {
+        return display;
+    }
+
+    g_free (display);
+
+    return normalized;
+}
+
+static void
+clear_index_locked (void)
+{
+    g_clear_pointer (&entries, g_array_unref);
+    g_clear_pointer (&trigrams, g_hash_table_destroy);
+    g_clear_pointer (&directories, g_hash_table_destroy);
+
+    if (names != NULL) {
+        g_string_free (names, TRUE);
+        g_string_free (folded, TRUE);
+    }
+
+    entries = g_array_new (FALSE, FALSE, sizeof (IndexEntry));
+    names = g_string_new (NULL);
+    folded = g_string_new (NULL);
+    trigrams = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) g_array_unref);
+    directories = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    n_deleted = 0;
+}
+
+static void
+add_trigrams_locked (guint32      id,
+                     const gchar *folded_name)
+{
+    gsize i, len;
+
+    len = strlen (folded_name);
+
+    for (i = 0; i + 3 <= len; i++) {
+        gpointer key = GUINT_TO_POINTER (PACK_TRIGRAM (folded_name + i));
+        GArray *postings;
+
+        postings = g_hash_table_lookup (trigrams, key);
+
+        if (postings == NULL) {
+            postings = g_array_new (FALSE, FALSE, sizeof (guint32));
+            g_hash_table_insert (trigrams, key, postings);
+        }
+
+        /* A name can have the same trigram more than once */
+        if (postings->len == 0 || g_array_index (postings, guint32, postings->len - 1) != id) {
+            g_array_append_val (postings, id);
+        }
+    }
+}
+
+static guint32
+add_entry_locked (guint32      parent,
+                  const gchar *name,
+                  guint32      flags,
+                  gint64       mtime)
+{
+    IndexEntry entry;
+    gchar *normalized_name, *folded_name;
+    guint32 id;
+
+    id = entries->len;
+    normalized_name = normalize_name (name);
+    folded_name = g_utf8_strdown (normalized_name, -1);
+
+    entry.parent = parent;
+    entry.first_child = NO_ENTRY;
+    entry.next_sibling = parent != NO_ENTRY ? get_entry (parent)->first_child : NO_ENTRY;
+    entry.name = names->len;
+    entry.display = names->len;
+    entry.folded = folded->len;
+    entry.flags = flags;
+    entry.mtime = mtime;
+
+    g_string_append_len (names, name, strlen (name) + 1);
+
+    /* Only kept separately when it differs, which is rare */
+    if (strcmp (normalized_name, name) != 0) {
+        entry.display = names->len;
+        g_string_append_len (names, normalized_name, strlen (normalized_name) + 1);
+    }
+
+    g_string_append_len (folded, folded_name, strlen (folded_name) + 1);
+    g_array_append_val (entries, entry);
+
+    if (parent != NO_ENTRY) {
+        get_entry (parent)->first_child = id;
+    }
+
+    add_trigrams_locked (id, folded_name);
+
+    if (flags & ENTRY_DIRECTORY) {
+        g_hash_table_insert (directories, entry_path_locked (id), GUINT_TO_POINTER (id + 1));
+    }
+
+    g_free (normalized_name);
+    g_free (folded_name);
+
+    return id;
+}
+
+static void
+delete_subtree_locked (guint32 id)
+{
+    guint32 child;
+
+    if (get_entry (id)->flags & ENTRY_DELETED) {
+        return;
+    }
+
+    if (get_entry (id)->flags & ENTRY_DIRECTORY) {
+        gchar *path = entry_path_locked (id);
+
+        g_hash_table_remove (directories, path);
+        g_free (path);
+
+        for (child = get_entry (id)->first_child; child != NO_ENTRY; child = get_entry (child)->next_sibling) {
+            delete_subtree_locked (child);
+        }
+    }
+
+    get_entry (id)->flags |= ENTRY_DELETED;
+    n_deleted++;
+}
+
+static guint32
+lookup_directory_locked (const gchar *path)
+{
+    guint32 found;
+
+    found = GPOINTER_TO_UINT (g_hash_table_lookup (directories, path));
+
+    return found != 0 ? found - 1 : NO_ENTRY;
+}
+
+/* Loading and saving */
+
+static gchar *
+get_index_path (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), "nemo", "filename-index", NULL);
+}
+
+static gboolean
+read_uint32 (const gchar **p, const gchar *end, guint32 *value)
+{
+    if (end - *p < (gssize) sizeof (guint32)) {
+        return FALSE;
+    }
+
+    memcpy (value, *p, sizeof (guint32));
+    *p += sizeof (guint32);
+
+    return TRUE;
+}
+
+static gboolean
+read_int64 (const gchar **p, const gchar *end, gint64 *value)
+{
+    if (end - *p < (gssize) sizeof (gint64)) {
+        return FALSE;
+    }
+
+    memcpy (value, *p, sizeof (gint64));
+    *p += sizeof (gint64);
+
+    return TRUE;
+}
+
+static gboolean
+load_index_from_data_locked (const gchar *data,
+                             gsize        length)
+{
+    const gchar *p = data, *end = data + length;
+    guint32 version, count, i;
+
+    clear_index_locked ();
+
+    if (length < sizeof (INDEX_MAGIC) || memcmp (p, INDEX_MAGIC, sizeof (INDEX_MAGIC)) != 0) {
+        return FALSE;
+    }
+
+    p += sizeof (INDEX_MAGIC);
+
+    if (!read_uint32 (&p, end, &version) || version != INDEX_VERSION ||
+        !read_uint32 (&p, end, &count)) {
+        return FALSE;
+    }
+
+    for (i = 0; i < count; i++) {
+        guint32 parent, flags, name_length;
+        gint64 mtime;
+        gchar *name;
+
+        if (!read_uint32 (&p, end, &parent) ||
+            !read_uint32 (&p, end, &flags) ||
+            !read_int64 (&p, end, &mtime) ||
+            !read_uint32 (&p, end, &name_length) ||
+            end - p < (gssize) name_length ||
+            (parent != NO_ENTRY && parent >= i)) {
+            clear_index_locked ();
+            return FALSE;
+        }
+
+        name = g_strndup (p, name_length);
+        p += name_length;
+
+        add_entry_locked (parent, name, flags & STORED_FLAGS, mtime);
+
+        g_free (name);
+    }
+
+    return TRUE;
+}
+
+static void
+load_index (void)
+{
+    gchar *path, *data;
+    gsize length;
+
+    path = get_index_path ();
+
+    g_rw_lock_writer_lock (&index_lock);
+
+    if (g_file_get_contents (path, &data, &length, NULL)) {
+        if (load_index_from_data_locked (data, length)) {
+            DEBUG ("Filename index: loaded %u entries", entries->len);
+        } else {
+            DEBUG ("Filename index: ignoring unreadable index at %s", path);
+        }
+
+        g_free (data);
+    } else {
+        clear_index_locked ();
+    }
+
+    g_rw_lock_writer_unlock (&index_lock);
+
+    g_free (path);
+}
+
+/* Deleted entries are left out, so this is also how the index is compacted */
+static GString *
+serialize_index_locked (void)
+{
+    GString *out;
+    guint32 *remap;
+    guint32 id, count = 0;
+
+    out = g_string_new (NULL);
+    g_string_append_len (out, INDEX_MAGIC, sizeof (INDEX_MAGIC));
+
+    id = INDEX_VERSION;
+    g_string_append_len (out, (gchar *) &id, sizeof (guint32));
+    g_string_append_len (out, (gchar *) &count, sizeof (guint32));
+
+    remap = g_new (guint32, MAX (1, entries->len));
+
+    for (id = 0; id < entries->len; id++) {
+        IndexEntry *entry = get_entry (id);
+        guint32 parent, flags, name_length;
+
+        if (entry->flags & ENTRY_DELETED) {
+            remap[id] = NO_ENTRY;
+            continue;
+        }
+
+        remap[id] = count++;
+
+        parent = entry->parent != NO_ENTRY ? remap[entry->parent] : NO_ENTRY;
+        flags = entry->flags & STORED_FLAGS;
+        name_length = strlen (entry_name (id));
+
+        g_string_append_len (out, (gchar *) &parent, sizeof (guint32));
+        g_string_append_len (out, (gchar *) &flags, sizeof (guint32));
+        g_string_append_len (out, (gchar *) &entry->mtime, sizeof (gint64));
+        g_string_append_len (out, (gchar *) &name_length, sizeof (guint32));
+        g_string_append_len (out, entry_name (id), name_length);
+    }
+
+    memcpy (out->str + sizeof (INDEX_MAGIC) + sizeof (guint32), &count, sizeof (guint32));
+
+    g_free (remap);
+
+    return out;
+}
+
+static void
+save_index (void)
+{
+    GString *data;
+    gchar *path, *dir;
+    GError *error = NULL;
+    gboolean compact;
+
+    g_rw_lock_reader_lock (&index_lock);
+    data = serialize_index_locked ();
+    compact = n_deleted * COMPACT_RATIO > entries->len;
+    g_rw_lock_reader_unlock (&index_lock);
+
+    if (compact) {
+        g_rw_lock_writer_lock (&index_lock);
+        DEBUG ("Filename index: compacting, %u of %u entries are deleted", n_deleted, entries->len);
+        load_index_from_data_locked (data->str, data->len);
+        g_rw_lock_writer_unlock (&index_lock);
+    }
+
+    path = get_index_path ();
+    dir = g_path_get_dirname (path);
+
+    g_mkdir_with_parents (dir, DEFAULT_NEMO_DIRECTORY_MODE);
+
+    if (!g_file_set_contents (path, data->str, data->len, &error)) {
+        g_warning ("Could not save the filename index: %s", error->message);
+        g_error_free (error);
+    }
+
+    g_free (dir);
+    g_free (path);
+    g_string_free (data, TRUE);
+}
+
+/* Refreshing */
+
+/* The deepest of roots that path is in, or NULL */
+static const gchar *
+find_root (gchar       **roots,
+           const gchar  *path)
+{
+    const gchar *best = NULL;
+    gint i;
+
+    for (i = 0; roots[i] != NULL; i++) {
+        gsize len = strlen (roots[i]);
+
+        if (strncmp (path, roots[i], len) == 0 &&
+            (path[len] == '\0' || path[len] == G_DIR_SEPARATOR || roots[i][len - 1] == G_DIR_SEPARATOR) &&
+            (best == NULL || len > strlen (best))) {
+            best = roots[i];
+        }
+    }
+
+    return best;
+}
+
+static gboolean
+should_skip_directory (gchar       **skip,
+                       gchar       **roots,
+                       const gchar  *path)
+{
+    const gchar *root;
+    gchar *basename;
+    gboolean ret = FALSE;
+    gint i;
+
+    basename = g_path_get_basename (path);
+    root = find_root (roots, path);
+
+    /* The same rules the advanced search engine uses, which ignores a skip
+     * folder that's an ancestor of where it starts - here, the root */
+    for (i = 0; skip[i] != NULL && !ret; i++) {
+        if (root != NULL && g_str_has_prefix (root, skip[i])) {
+            continue;
+        }
+
+        ret = g_str_has_prefix (path, skip[i]) || g_strcmp0 (basename, skip[i]) == 0;
+    }
+
+    g_free (basename);
+
+    return ret;
+}
+
+static gint64
+get_mtime (GFileInfo *info)
+{
+    return (gint64) g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+           g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
+
+static gint64
+get_directory_mtime (const gchar *path)
+{
+    GFile *file;
+    GFileInfo *info;
+    gint64 mtime = -1;
+
+    file = g_file_new_for_path (path);
+    info = g_file_query_info (file, MTIME_ATTRIBUTES, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, NULL);
+
+    if (info != NULL) {
+        mtime = get_mtime (info);
+        g_object_unref (info);
+    }
+
+    g_object_unref (file);
+
+    return mtime;
+}
+
+static void
+scanned_child_free (ScannedChild *child)
+{
+    g_free (child->name);
+    g_free (child);
+}
+
+/* Brings the children of directory id up to date, queueing any new
+ * subdirectories (as id + 1) to be read in turn.  Symlinks are indexed
+ * but not followed. */
+static gboolean
+scan_directory (guint32      id,
+                const gchar *path,
+                GQueue      *new_dirs)
+{
+    GFile *file;
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+    GPtrArray *children;
+    GHashTable *existing;
+    GHashTableIter iter;
+    gpointer value;
+    guint32 child;
+    gint64 mtime;
+    gboolean changed = FALSE;
+    guint i;
+
+    /* Before reading, so anything that changes meanwhile is caught next time */
+    mtime = get_directory_mtime (path);
+
+    if (mtime < 0) {
+        /* Gone - its parent will notice */
+        return FALSE;
+    }
+
+    file = g_file_new_for_path (path);
+    enumerator = g_file_enumerate_children (file, INDEX_ATTRIBUTES,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, NULL);
+    g_object_unref (file);
+
+    if (enumerator == NULL) {
+        return FALSE;
+    }
+
+    children = g_ptr_array_new_with_free_func ((GDestroyNotify) scanned_child_free);
+
+    while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL) {
+        ScannedChild *scanned = g_new0 (ScannedChild, 1);
+
+        scanned->name = g_strdup (g_file_info_get_name (info));
+
+        if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+            scanned->flags |= ENTRY_DIRECTORY;
+        }
+
+        if (g_file_info_get_is_hidden (info)) {
+            scanned->flags |= ENTRY_HIDDEN;
+        }
+
+        g_ptr_array_add (children, scanned);
+        g_object_unref (info);
+    }
+
+    g_object_unref (enumerator);
+
+    g_rw_lock_writer_lock (&index_lock);
+
+    /* It may have gone away while we were reading it */
+    if ((get_entry (id)->flags & (ENTRY_DELETED | ENTRY_DIRECTORY)) != ENTRY_DIRECTORY) {
+        g_rw_lock_writer_unlock (&index_lock);
+        g_ptr_array_free (children, TRUE);
+        return FALSE;
+    }
+
+    existing = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    for (child = get_entry (id)->first_child; child != NO_ENTRY; child = get_entry (child)->next_sibling) {
+        if (!(get_entry (child)->flags & ENTRY_DELETED)) {
+            g_hash_table_insert (existing, g_strdup (entry_name (child)), GUINT_TO_POINTER (child + 1));
+        }
+    }
+
+    for (i = 0; i < children->len; i++) {
+        ScannedChild *scanned = g_ptr_array_index (children, i);
+        guint32 found;
+
+        found = GPOINTER_TO_UINT (g_hash_table_lookup (existing, scanned->name));
+
+        if (found != 0 &&
+            (get_entry (found - 1)->flags & ENTRY_DIRECTORY) == (scanned->flags & ENTRY_DIRECTORY)) {
+            IndexEntry *entry = get_entry (found - 1);
+
+            entry->flags = (entry->flags & ~ENTRY_HIDDEN) | (scanned->flags & ENTRY_HIDDEN);
+            g_hash_table_remove (existing, scanned->name);
+            continue;
+        }
+
+        /* New, or replaced by something of another type (the old one is
+         * still in existing, so it's deleted below) */
+        child = add_entry_locked (id, scanned->name, scanned->flags, 0);
+        changed = TRUE;
+
+        if (scanned->flags & ENTRY_DIRECTORY) {
+            g_queue_push_tail (new_dirs, GUINT_TO_POINTER (child + 1));
+        }
+    }
+
+    g_hash_table_iter_init (&iter, existing);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+        delete_subtree_locked (GPOINTER_TO_UINT (value) - 1);
+        changed = TRUE;
+    }
+
+    get_entry (id)->mtime = mtime;
+
+    g_rw_lock_writer_unlock (&index_lock);
+
+    g_hash_table_destroy (existing);
+    g_ptr_array_free (children, TRUE);
+
+    return changed;
+}
+
+static gboolean
+scan_new_directories (GQueue  *new_dirs,
+                      gchar  **skip,
+                      gchar  **roots)
+{
+    gpointer data;
+    gboolean changed = FALSE;
+
+    while ((data = g_queue_pop_head (new_dirs)) != NULL) {
+        guint32 id = GPOINTER_TO_UINT (data) - 1;
+        gboolean is_root;
+        gchar *path;
+
+        g_rw_lock_reader_lock (&index_lock);
+        path = entry_path_locked (id);
+        is_root = get_entry (id)->parent == NO_ENTRY;
+        g_rw_lock_reader_unlock (&index_lock);
+
+        if (!is_root && should_skip_directory (skip, roots, path)) {
+            g_rw_lock_writer_lock (&index_lock);
+            get_entry (id)->flags |= ENTRY_SKIPPED;
+            g_rw_lock_writer_unlock (&index_lock);
+
+            changed = TRUE;
+        } else {
+            changed |= scan_directory (id, path, new_dirs);
+        }
+
+        g_free (path);
+    }
+
+    return changed;
+}
+
+static gboolean
+reconcile_roots (gchar  **roots,
+                 GQueue  *new_dirs)
+{
+    gboolean changed = FALSE;
+    guint32 id;
+    gint i;
+
+    g_rw_lock_writer_lock (&index_lock);
+
+    for (id = 0; id < entries->len; id++) {
+        IndexEntry *entry = get_entry (id);
+
+        if (entry->parent == NO_ENTRY && !(entry->flags & ENTRY_DELETED) &&
+            !g_strv_contains ((const gchar * const *) roots, entry_name (id))) {
+            DEBUG ("Filename index: dropping %s", entry_name (id));
+            delete_subtree_locked (id);
+            changed = TRUE;
+        }
+    }
+
+    for (i = 0; roots[i] != NULL; i++) {
+        /* Already a root, or inside one */
+        if (lookup_directory_locked (roots[i]) != NO_ENTRY) {
+            continue;
+        }
+
+        if (!g_file_test (roots[i], G_FILE_TEST_IS_DIR)) {
+            continue;
+        }
+
+        DEBUG ("Filename index: adding %s", roots[i]);
+
+        id = add_entry_locked (NO_ENTRY, roots[i], ENTRY_DIRECTORY, 0);
+        g_queue_push_tail (new_dirs, GUINT_TO_POINTER (id + 1));
+        changed = TRUE;
+    }
+
+    g_rw_lock_writer_unlock (&index_lock);
+
+    return changed;
+}
+
+typedef struct {
+    guint32 id;
+    gchar *path;
+} DirectorySnapshot;
+
+static gboolean
+verify_directories (gchar  **skip,
+                    gchar  **roots,
+                    GQueue  *new_dirs)
+{
+    GArray *snapshot;
+    GHashTableIter iter;
+    gpointer key, value;
+    gboolean changed = FALSE;
+    guint i;
+
+    snapshot = g_array_new (FALSE, FALSE, sizeof (DirectorySnapshot));
+
+    g_rw_lock_reader_lock (&index_lock);
+
+    g_hash_table_iter_init (&iter, directories);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        DirectorySnapshot dir;
+
+        dir.id = GPOINTER_TO_UINT (value) - 1;
+        dir.path = g_strdup (key);
+
+        g_array_append_val (snapshot, dir);
+    }
+
+    g_rw_lock_reader_unlock (&index_lock);
+
+    for (i = 0; i < snapshot->len; i++) {
+        DirectorySnapshot *dir = &g_array_index (snapshot, DirectorySnapshot, i);
+        gboolean deleted, skipped, skip_now;
+        guint32 child;
+        gint64 mtime;
+
+        g_rw_lock_reader_lock (&index_lock);
+        deleted = (get_entry (dir->id)->flags & ENTRY_DELETED) != 0;
+        skipped = (get_entry (dir->id)->flags & ENTRY_SKIPPED) != 0;
+        skip_now = get_entry (dir->id)->parent != NO_ENTRY && should_skip_directory (skip, roots, dir->path);
+        mtime = get_entry (dir->id)->mtime;
+        g_rw_lock_reader_unlock (&index_lock);
+
+        /* Along with a parent that was read again above */
+        if (deleted) {
+            g_free (dir->path);
+            continue;
+        }
+
+        if (skip_now && !skipped) {
+            g_rw_lock_writer_lock (&index_lock);
+
+            for (child = get_entry (dir->id)->first_child; child != NO_ENTRY; child = get_entry (child)->next_sibling) {
+                delete_subtree_locked (child);
+            }
+
+            get_entry (dir->id)->flags |= ENTRY_SKIPPED;
+
+            g_rw_lock_writer_unlock (&index_lock);
+            changed = TRUE;
+        } else if (!skip_now && skipped) {
+            g_rw_lock_writer_lock (&index_lock);
+            get_entry (dir->id)->flags &= ~ENTRY_SKIPPED;
+            g_rw_lock_writer_unlock (&index_lock);
+
+            scan_directory (dir->id, dir->path, new_dirs);
+            changed = TRUE;
+        } else if (!skip_now && get_directory_mtime (dir->path) != mtime) {
+            changed |= scan_directory (dir->id, dir->path, new_dirs);
+        }
+
+        g_free (dir->path);
+    }
+
+    g_array_free (snapshot, TRUE);
+
+    changed |= scan_new_directories (new_dirs, skip, roots);
+
+    return changed;
+}
+
+static void
+refresh_job_free (RefreshJob *job)
+{
+    g_ptr_array_free (job->dirty, TRUE);
+    g_strfreev (job->roots);
+    g_strfreev (job->skip);
+    g_free (job);
+}
+
+static void
+refresh_thread (GTask        *task,
+                gpointer      source_object,
+                gpointer      task_data,
+                GCancellable *cancellable)
+{
+    /* Jobs run one at a time, so this is only touched here */
+    static gboolean loaded = FALSE;
+    RefreshJob *job = task_data;
+    GQueue new_dirs = G_QUEUE_INIT;
+    gboolean changed = FALSE;
+    gint64 start_time;
+    guint i;
+
+    start_time = g_get_monotonic_time ();
+
+    if (!loaded) {
+        load_index ();
+        loaded = TRUE;
+
+        /* Stale until verified, but still better than walking the disk */
+        if (entries->len > 0) {
+            g_atomic_int_set (&index_ready, TRUE);
+        }
+    }
+
+    if (job->verify) {
+        changed |= reconcile_roots (job->roots, &new_dirs);
+        changed |= verify_directories (job->skip, job->roots, &new_dirs);
+    }
+
+    for (i = 0; i < job->dirty->len; i++) {
+        const gchar *path = g_ptr_array_index (job->dirty, i);
+        guint32 id;
+        gboolean skipped = FALSE;
+
+        g_rw_lock_reader_lock (&index_lock);
+        id = lookup_directory_locked (path);
+        if (id != NO_ENTRY) {
+            skipped = (get_entry (id)->flags & ENTRY_SKIPPED) != 0;
+        }
+        g_rw_lock_reader_unlock (&index_lock);
+
+        if (id != NO_ENTRY && !skipped) {
+            changed |= scan_directory (id, path, &new_dirs);
+        }
+    }
+
+    changed |= scan_new_directories (&new_dirs, job->skip, job->roots);
+
+    g_atomic_int_set (&index_ready, TRUE);
+
+    if (changed) {
+        save_index ();
+    }
+
+    DEBUG ("Filename index: refreshed in %" G_GINT64_FORMAT "ms, %u entries (%u deleted)%s",
+           (g_get_monotonic_time () - start_time) / 1000, entries->len, n_deleted,
+           changed ? ", saved" : "");
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static gchar **
+get_index_roots (void)
+{
+    gchar **setting, **roots;
+    gint i, n = 0;
+
+    setting = g_settings_get_strv (nemo_search_preferences, NEMO_PREFERENCES_SEARCH_INDEX_ROOTS);
+    roots = g_new0 (gchar *, g_strv_length (setting) + 1);
+
+    for (i = 0; setting[i] != NULL; i++) {
+        GFile *file;
+
+        if (!g_path_is_absolute (setting[i])) {
+            continue;
+        }
+
+        /* Tidies up trailing slashes and the like */
+        file = g_file_new_for_path (setting[i]);
+        roots[n++] = g_file_get_path (file);
+        g_object_unref (file);
+    }
+
+    g_strfreev (setting);
+
+    return roots;
+}
+
+static void schedule_refresh (void);
+
+static void
+refresh_done (GObject      *source_object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+    refresh_running = FALSE;
+
+    schedule_refresh ();
+}
+
+static void
+schedule_refresh (void)
+{
+    GHashTableIter iter;
+    gpointer key;
+    RefreshJob *job;
+    GTask *task;
+
+    if (refresh_running || (!verify_pending && g_hash_table_size (dirty_paths) == 0)) {
+        return;
+    }
+
+    job = g_new0 (RefreshJob, 1);
+    job->verify = verify_pending;
+    job->dirty = g_ptr_array_new_with_free_func (g_free);
+    job->roots = get_index_roots ();
+    job->skip = g_settings_get_strv (nemo_search_preferences, NEMO_PREFERENCES_SEARCH_SKIP_FOLDERS);
+
+    g_hash_table_iter_init (&iter, dirty_paths);
+    while (g_hash_table_iter_next (&iter, &key, NULL)) {
+        g_ptr_array_add (job->dirty, key);
+        g_hash_table_iter_steal (&iter);
+    }
+
+    verify_pending = FALSE;
+    refresh_running = TRUE;
+
+    task = g_task_new (NULL, NULL, refresh_done, NULL);
+    g_task_set_task_data (task, job, (GDestroyNotify) refresh_job_free);
+    g_task_run_in_thread (task, refresh_thread);
+    g_object_unref (task);
+}
+
+static gboolean
+dirty_timeout_cb (gpointer user_data)
+{
+    dirty_timeout_id = 0;
+    schedule_refresh ();
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+verify_timeout_cb (gpointer user_data)
+{
+    verify_pending = TRUE;
+    schedule_refresh ();
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+index_settings_changed (GSettings   *settings,
+                        const gchar *key,
+                        gpointer     user_data)
+{
+    verify_pending = TRUE;
+    schedule_refresh ();
+}
+
+gboolean
+nemo_filename_index_is_enabled (void)
+{
+    gchar **roots;
+    gboolean ret;
+
+    roots = g_settings_get_strv (nemo_search_preferences, NEMO_PREFERENCES_SEARCH_INDEX_ROOTS);
+    ret = roots[0] != NULL;
+    g_strfreev (roots);
+
+    return ret;
+}
+
+/**
+ * nemo_filename_index_ensure:
+ *
+ * Loads the index and brings it up to date in the background, then keeps
+ * it that way.  Does nothing after the first call.
+ */
+void
+nemo_filename_index_ensure (void)
+{
+    if (initialized) {
+        return;
+    }
+
+    initialized = TRUE;
+
+    dirty_paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    g_signal_connect (nemo_search_preferences, "changed::" NEMO_PREFERENCES_SEARCH_INDEX_ROOTS,
+                      G_CALLBACK (index_settings_changed), NULL);
+    g_signal_connect (nemo_search_preferences, "changed::" NEMO_PREFERENCES_SEARCH_SKIP_FOLDERS,
+                      G_CALLBACK (index_settings_changed), NULL);
+
+    g_timeout_add_seconds (VERIFY_INTERVAL, verify_timeout_cb, NULL);
+
+    verify_pending = TRUE;
+    schedule_refresh ();
+}
+
+/**
+ * nemo_filename_index_note_changed:
+ * @location: a file that was added, removed or renamed
+ *
+ * Has the directory containing @location read again shortly.
+ */
+void
+nemo_filename_index_note_changed (GFile *location)
+{
+    GFile *parent;
+    gchar *path;
+
+    if (!initialized) {
+        return;
+    }
+
+    parent = g_file_get_parent (location);
+
+    if (parent == NULL) {
+        return;
+    }
+
+    path = g_file_get_path (parent);
+    g_object_unref (parent);
+
+    if (path == NULL) {
+        return;
+    }
+
+    g_hash_table_add (dirty_paths, path);
+
+    if (dirty_timeout_id == 0) {
+        dirty_timeout_id = g_timeout_add_seconds (DIRTY_DELAY, dirty_timeout_cb, NULL);
+    }
+}
+
+/* Querying */
+
+static void
+add_query_trigrams (GArray      *keys,
+                    const gchar *folded_word)
+{
+    gchar **segments;
+    gint i;
+
+    segments = g_strsplit_set (folded_word, "*?", -1);
+
+    for (i = 0; segments[i] != NULL; i++) {
+        gsize j, len = strlen (segments[i]);
+
+        for (j = 0; j + 3 <= len; j++) {
+            guint32 key = PACK_TRIGRAM (segments[i] + j);
+            guint k;
+
+            for (k = 0; k < keys->len && g_array_index (keys, guint32, k) != key; k++);
+
+            if (k == keys->len) {
+                g_array_append_val (keys, key);
+            }
+        }
+    }
+
+    g_strfreev (segments);
+}
+
+NemoFilenameIndexQuery *
+nemo_filename_index_query_new (NemoQuery *query)
+{
+    NemoFilenameIndexQuery *index_query;
+    GFile *location;
+    gchar *uri, *path, *text, *normalized, *cased;
+    gchar **words;
+    gboolean usable;
+    guint32 id;
+    gint i;
+
+    if (!initialized || !g_atomic_int_get (&index_ready) ||
+        nemo_query_has_content_pattern (query) ||
+        nemo_query_get_use_file_regex (query)) {
+        return NULL;
+    }
+
+    uri = nemo_query_get_location (query);
+
+    if (uri == NULL) {
+        return NULL;
+    }
+
+    location = g_file_new_for_uri (uri);
+    path = g_file_get_path (location);
+    g_object_unref (location);
+    g_free (uri);
+
+    if (path == NULL) {
+        return NULL;
+    }
+
+    /* Searching inside a skipped folder goes into it, but it isn't indexed */
+    g_rw_lock_reader_lock (&index_lock);
+    id = lookup_directory_locked (path);
+    usable = id != NO_ENTRY && !(get_entry (id)->flags & ENTRY_SKIPPED);
+    g_rw_lock_reader_unlock (&index_lock);
+
+    if (!usable) {
+        g_free (path);
+        return NULL;
+    }
+
+    index_query = g_new0 (NemoFilenameIndexQuery, 1);
+    index_query->location_path = path;
+    index_query->recurse = nemo_query_get_recurse (query);
+    index_query->show_hidden = nemo_query_get_show_hidden (query);
+    index_query->case_sensitive = nemo_query_get_file_case_sensitive (query);
+    index_query->patterns = g_ptr_array_new_with_free_func ((GDestroyNotify) g_pattern_spec_free);
+    index_query->trigrams = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+    /* Words are matched the same way nemo-search-engine-advanced does */
+    text = nemo_query_get_file_pattern (query);
+    normalized = g_utf8_normalize (text, -1, G_NORMALIZE_NFD);
+
+    if (index_query->case_sensitive) {
+        cased = g_strdup (normalized);
+    } else {
+        cased = g_utf8_strdown (normalized, -1);
+    }
+
+    words = g_strsplit_set (cased, " \t\r\n", -1);
+
+    for (i = 0; words[i] != NULL; i++) {
+        gchar *word_pattern, *folded_word;
+
+        if (words[i][0] == '\0') {
+            continue;
+        }
+
+        if (strchr (words[i], '*') == NULL && strchr (words[i], '?') == NULL) {
+            word_pattern = g_strdup_printf ("*%s*", words[i]);
+        } else {
+            word_pattern = g_strdup (words[i]);
+        }
+
+        g_ptr_array_add (index_query->patterns, g_pattern_spec_new (word_pattern));
+
+        /* The trigram table is case folded either way */
+        folded_word = g_utf8_strdown (words[i], -1);
+        add_query_trigrams (index_query->trigrams, folded_word);
+
+        g_free (folded_word);
+        g_free (word_pattern);
+    }
+
+    if (index_query->patterns->len == 0) {
+        g_ptr_array_add (index_query->patterns, g_pattern_spec_new ("*"));
+    }
+
+    g_strfreev (words);
+    g_free (cased);
+    g_free (normalized);
+    g_free (text);
+
+    return index_query;
+}
+
+void
+nemo_filename_index_query_free (NemoFilenameIndexQuery *index_query)
+{
+    g_free (index_query->location_path);
+    g_ptr_array_free (index_query->patterns, TRUE);
+    g_array_free (index_query->trigrams, TRUE);
+    g_free (index_query);
+}
+
+static gint
+compare_postings_length (gconstpointer a,
+                         gconstpointer b)
+{
+    GArray *postings_a = *(GArray **) a;
+    GArray *postings_b = *(GArray **) b;
+
+    return (gint) postings_a->len - (gint) postings_b->len;
+}
+
+/* Ids that are in every posting list of keys */
+static GArray *
+intersect_postings_locked (GArray *keys)
+{
+    GPtrArray *lists;
+    GArray *result;
+    guint i, j;
+
+    lists = g_ptr_array_new ();
+
+    for (i = 0; i < keys->len; i++) {
+        GArray *postings = g_hash_table_lookup (trigrams, GUINT_TO_POINTER (g_array_index (keys, guint32, i)));
+
+        if (postings == NULL) {
+            g_ptr_array_free (lists, TRUE);
+            return g_array_new (FALSE, FALSE, sizeof (guint32));
+        }
+
+        g_ptr_array_add (lists, postings);
+    }
+
+    /* Start with the rarest */
+    g_ptr_array_sort (lists, compare_postings_length);
+
+    result = g_array_new (FALSE, FALSE, sizeof (guint32));
+    g_array_append_vals (result, ((GArray *) g_ptr_array_index (lists, 0))->data,
+                         ((GArray *) g_ptr_array_index (lists, 0))->len);
+
+    for (i = 1; i < lists->len && result->len > 0; i++) {
+        GArray *other = g_ptr_array_index (lists, i);
+        guint kept = 0, pos = 0;
+
+        for (j = 0; j < result->len; j++) {
+            guint32 id = g_array_index (result, guint32, j);
+            guint low = pos, high = other->len;
+
+            /* First position in other not below id */
+            while (low < high) {
+                guint mid = low + (high - low) / 2;
+
+                if (g_array_index (other, guint32, mid) < id) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+
+            pos = low;
+
+            if (pos == other->len) {
+                break;
+            }
+
+            if (g_array_index (other, guint32, pos) == id) {
+                g_array_index (result, guint32, kept++) = id;
+            }
+        }
+
+        g_array_set_size (result, kept);
+    }
+
+    g_ptr_array_free (lists, TRUE);
+
+    return result;
+}
+
+static gboolean
+is_under_location_locked (NemoFilenameIndexQuery *index_query,
+                          guint32                 id,
+                          guint32                 location_id)
+{
+    gboolean hidden;
+    guint32 parent;
+
+    hidden = (get_entry (id)->flags & ENTRY_HIDDEN) != 0;
+    parent = get_entry (id)->parent;
+
+    if (index_query->recurse) {
+        /* Hidden folders aren't searched unless hidden files are shown */
+        while (parent != NO_ENTRY && parent != location_id) {
+            hidden |= (get_entry (parent)->flags & ENTRY_HIDDEN) != 0;
+            parent = get_entry (parent)->parent;
+        }
+    }
+
+    return parent == location_id && (index_query->show_hidden || !hidden);
+}
+
+static gboolean
+matches_locked (NemoFilenameIndexQuery *index_query,
+                guint32                 id)
+{
+    const gchar *text;
+    gboolean hit = TRUE;
+    gsize len;
+    guint i;
+
+    /* Both were worked out when the entry was added, so nothing here
+     * allocates under the lock */
+    if (index_query->case_sensitive) {
+        text = names->str + get_entry (id)->display;
+    } else {
+        text = folded->str + get_entry (id)->folded;
+    }
+
+    len = strlen (text);
+
+    for (i = 0; i < index_query->patterns->len && hit; i++) {
+        hit = g_pattern_spec_match (g_ptr_array_index (index_query->patterns, i), len, text, NULL);
+    }
+
+    return hit;
+}
+
+/**
+ * nemo_filename_index_query_run:
+ *
+ * Returns: (transfer full): a list of #FileSearchResult
+ */
+GList *
+nemo_filename_index_query_run (NemoFilenameIndexQuery *index_query,
+                               GCancellable           *cancellable)
+{
+    GArray *candidates = NULL;
+    GList *hits = NULL;
+    guint32 location_id, id;
+    guint i, n;
+
+    g_rw_lock_reader_lock (&index_lock);
+
+    location_id = lookup_directory_locked (index_query->location_path);
+
+    if (location_id == NO_ENTRY) {
+        g_rw_lock_reader_unlock (&index_lock);
+        return NULL;
+    }
+
+    /* Words of fewer than three letters have to look at every name */
+    if (index_query->trigrams->len > 0) {
+        candidates = intersect_postings_locked (index_query->trigrams);
+    }
+
+    n = candidates != NULL ? candidates->len : entries->len;
+
+    for (i = 0; i < n; i++) {
+        gchar *path, *uri;
+
+        if ((i & 0xfff) == 0 && g_cancellable_is_cancelled (cancellable)) {
+            break;
+        }
+
+        id = candidates != NULL ? g_array_index (candidates, guint32, i) : i;
+
+        if (id == location_id || (get_entry (id)->flags & ENTRY_DELETED) ||
+            !is_under_location_locked (index_query, id, location_id) ||
+            !matches_locked (index_query, id)) {
+            continue;
+        }
+
+        path = entry_path_locked (id);
+        uri = g_filename_to_uri (path, NULL, NULL);
+        g_free (path);
+
+        if (uri != NULL) {
+            hits = g_list_prepend (hits, file_search_result_new (uri, NULL));
+        }
+    }
+
+    g_rw_lock_reader_unlock (&index_lock);
+
+    if (candidates != NULL) {
+        g_array_free (candidates, TRUE);
+    }
+
+    return hits;
+}
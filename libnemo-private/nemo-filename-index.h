@@ -0,0 +1,49 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-filename-index.h: A stored index of file names for fast searching.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#ifndef NEMO_FILENAME_INDEX_H
+#define NEMO_FILENAME_INDEX_H
+
+#include <gio/gio.h>
+#include <libnemo-private/nemo-query.h>
+
+/* The folders listed in org.nemo.search index-roots are indexed by name,
+ * with a trigram table over the case folded names, and the index is kept
+ * in the user cache dir between sessions.  Directories are re-read when
+ * their modification time changes - immediately for those nemo hears about
+ * through nemo_directory_notify_*, and otherwise on a periodic check.
+ *
+ * nemo_filename_index_query_new () returns NULL when the index can't answer
+ * a query the way the regular search would (content and regex searches,
+ * locations outside the roots, or an index still being built).
+ */
+
+typedef struct _NemoFilenameIndexQuery NemoFilenameIndexQuery;
+
+gboolean                nemo_filename_index_is_enabled (void);
+void                    nemo_filename_index_ensure     (void);
+void                    nemo_filename_index_note_changed (GFile *location);
+
+NemoFilenameIndexQuery *nemo_filename_index_query_new  (NemoQuery              *query);
+GList                  *nemo_filename_index_query_run  (NemoFilenameIndexQuery *index_query,
+                                                        GCancellable           *cancellable);
+void                    nemo_filename_index_query_free (NemoFilenameIndexQuery *index_query);
+
+#endif /* NEMO_FILENAME_INDEX_H */
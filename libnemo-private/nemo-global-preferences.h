@@ -193,6 +193,8 @@ enum
 #define NEMO_PREFERENCES_LIST_VIEW_ENABLE_EXPANSION         "enable-folder-expansion"
 
 #define NEMO_PREFERENCES_MAX_THUMBNAIL_THREADS "thumbnail-threads"
+#define NEMO_PREFERENCES_THUMBNAIL_CACHE_SIZE "thumbnail-cache-size"
+#define NEMO_PREFERENCES_COPY_THREADS "copy-threads"
 
 enum
 {
@@ -296,6 +298,9 @@ typedef enum
 #define NEMO_PREFERENCES_SEARCH_VISIBLE_COLUMNS        "search-visible-columns"
 #define NEMO_PREFERENCES_SEARCH_SORT_COLUMN            "search-sort-column"
 #define NEMO_PREFERENCES_SEARCH_REVERSE_SORT           "search-reverse-sort"
+#define NEMO_PREFERENCES_SEARCH_INDEX_ROOTS            "index-roots"
+#define NEMO_PREFERENCES_SEARCH_HELPER_CACHE_SIZE      "search-helper-cache-size"
+#define NEMO_PREFERENCES_SEARCH_CONTENT_MAX_SIZE       "search-content-max-size"
 
 void nemo_global_preferences_init                      (void);
 void nemo_global_preferences_finalize                  (void);
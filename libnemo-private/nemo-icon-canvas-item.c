@@ -136,6 +136,8 @@ struct NemoIconCanvasItemDetails {
 
 	/* Accessibility bits */
 	GailTextUtil *text_util;
+	/* Weak pointer, only set once something asked for our accessible */
+	AtkObject *accessible;
 };
 
 /* Object argument IDs. */
@@ -213,6 +215,11 @@ nemo_icon_canvas_item_finalize (GObject *object)
 		g_object_unref (details->text_util);
 	}
 
+	if (details->accessible != NULL) {
+		g_object_remove_weak_pointer (G_OBJECT (details->accessible),
+					      (gpointer *) &details->accessible);
+	}
+
 	g_free (details->editable_text);
 	g_free (details->additional_text);
 
@@ -283,9 +290,12 @@ nemo_icon_canvas_item_set_property (GObject        *object,
 	AtkObject *accessible;
 
 	item = NEMO_ICON_CANVAS_ITEM (object);
-	accessible = atk_gobject_accessible_for_object (G_OBJECT (item));
 	details = item->details;
 
+	/* Don't create an accessible just to notify it; if no assistive
+	 * technology has asked for one yet, there is nobody to tell. */
+	accessible = details->accessible;
+
 	switch (property_id) {
 
 	case PROP_EDITABLE_TEXT:
@@ -299,6 +309,8 @@ nemo_icon_canvas_item_set_property (GObject        *object,
 		if (details->text_util) {
 			gail_text_util_text_setup (details->text_util,
 						   details->editable_text);
+		}
+		if (accessible != NULL) {
 			g_object_notify (G_OBJECT(accessible), "accessible-name");
 		}
 
@@ -332,8 +344,10 @@ nemo_icon_canvas_item_set_property (GObject        *object,
 		details->is_highlighted_for_selection = g_value_get_boolean (value);
 		nemo_icon_canvas_item_invalidate_label_size (item);
 
-		atk_object_notify_state_change (accessible, ATK_STATE_SELECTED,
-						details->is_highlighted_for_selection);
+		if (accessible != NULL) {
+			atk_object_notify_state_change (accessible, ATK_STATE_SELECTED,
+							details->is_highlighted_for_selection);
+		}
 
 		break;
 
@@ -343,7 +357,7 @@ nemo_icon_canvas_item_set_property (GObject        *object,
 		}
 		details->is_highlighted_as_keyboard_focus = g_value_get_boolean (value);
 
-		if (details->is_highlighted_as_keyboard_focus) {
+		if (details->is_highlighted_as_keyboard_focus && accessible != NULL) {
 			atk_focus_tracker_notify (accessible);
 		}
 		break;
@@ -2187,6 +2201,16 @@ nemo_icon_canvas_item_text_interface_init (EelAccessibleTextIface *iface)
 
 /* ============================= a11y interfaces =========================== */
 
+/* Returns the item's accessible if one was already created, without
+ * creating it. */
+AtkObject *
+nemo_icon_canvas_item_peek_accessible (NemoIconCanvasItem *item)
+{
+	g_return_val_if_fail (NEMO_IS_ICON_CANVAS_ITEM (item), NULL);
+
+	return item->details->accessible;
+}
+
 static const char *nemo_icon_canvas_item_accessible_action_names[] = {
         "open",
         "menu",
@@ -2902,6 +2926,10 @@ nemo_icon_canvas_item_accessible_factory_create_accessible (GObject *for_object)
 	accessible = g_object_new (nemo_icon_canvas_item_accessible_get_type (), NULL);
 	atk_object_initialize (accessible, for_object);
 
+	item->details->accessible = accessible;
+	g_object_add_weak_pointer (G_OBJECT (accessible),
+				   (gpointer *) &item->details->accessible);
+
 	return accessible;
 }
 
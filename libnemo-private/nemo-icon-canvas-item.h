@@ -105,6 +105,9 @@ void        nemo_icon_canvas_item_set_is_visible           (NemoIconCanvasItem
 void        nemo_icon_canvas_item_set_entire_text          (NemoIconCanvasItem       *icon_item,
 								gboolean                      entire_text);
 gint        nemo_icon_canvas_item_get_fixed_text_height_for_layout (NemoIconCanvasItem *item);
+
+/* accessibility */
+AtkObject * nemo_icon_canvas_item_peek_accessible          (NemoIconCanvasItem       *item);
 G_END_DECLS
 
 #endif /* NEMO_ICON_CANVAS_ITEM_H */
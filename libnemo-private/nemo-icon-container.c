@@ -140,6 +140,7 @@ static int compare_icons_vertical (NemoIconContainer *container,
 				   NemoIcon *icon_b);
 
 static void remove_search_entry_timeout (NemoIconContainer *container);
+static void search_index_free (NemoIconContainer *container);
 
 static gboolean handle_icon_slow_two_click (NemoIconContainer *container,
                                             NemoIcon *icon,
@@ -657,11 +658,32 @@ clear_keyboard_focus (NemoIconContainer *container)
 	container->details->keyboard_focus = NULL;
 }
 
+/* Returns the accessible for @icon.  Unless an assistive technology has
+ * already asked the container for its children, this doesn't create one
+ * and may return NULL.
+ */
+static AtkObject *
+get_icon_accessible_if_needed (NemoIcon *icon)
+{
+	NemoIconContainer *container;
+
+	container = NEMO_ICON_CONTAINER (EEL_CANVAS_ITEM (icon->item)->canvas);
+
+	if (!container->details->a11y_children_requested) {
+		return nemo_icon_canvas_item_peek_accessible (icon->item);
+	}
+
+	return atk_gobject_accessible_for_object (G_OBJECT (icon->item));
+}
+
 inline static void
 emit_atk_focus_tracker_notify (NemoIcon *icon)
 {
-	AtkObject *atk_object = atk_gobject_accessible_for_object (G_OBJECT (icon->item));
-	atk_focus_tracker_notify (atk_object);
+	AtkObject *atk_object = get_icon_accessible_if_needed (icon);
+
+	if (atk_object != NULL) {
+		atk_focus_tracker_notify (atk_object);
+	}
 }
 
 /* Set @icon as the icon currently selected for keyboard operations. */
@@ -2746,6 +2768,8 @@ destroy (GtkWidget *object)
 
 	remove_search_entry_timeout (container);
 
+	nemo_thumbnail_viewport_withdraw (container);
+
 	GTK_WIDGET_CLASS (nemo_icon_container_parent_class)->destroy (object);
 }
 
@@ -2770,6 +2794,8 @@ finalize (GObject *object)
 	g_hash_table_destroy (details->icon_set);
 	details->icon_set = NULL;
 
+	search_index_free (NEMO_ICON_CONTAINER (object));
+
 	g_free (details->font);
 	g_free (details->filter_highlight_text);
 
@@ -3827,78 +3853,308 @@ nemo_icon_container_get_icon_text (NemoIconContainer *container,
     klass->get_icon_text (container, data, editable_text, additional_text, pinned, fav_unavailable, include_invisible);
 }
 
+/* Interactive search index.
+ *
+ * Entries are kept sorted by their normalized, case-folded name, so all
+ * names sharing a prefix form one contiguous run that can be located with
+ * a binary search instead of walking (and re-normalizing) every icon on
+ * each keypress.  Each entry also remembers where its icon sits in the
+ * icon list, so the matches can be visited in view order without walking
+ * the list either.
+ */
+typedef struct {
+	char *key;
+	NemoIcon *icon;
+	guint position;
+} NemoIconSearchEntry;
+
+static void
+search_entry_free (gpointer data)
+{
+	NemoIconSearchEntry *entry = data;
+
+	g_free (entry->key);
+	g_free (entry);
+}
+
+static char *
+search_index_make_key (const char *text)
+{
+	char *normalized, *case_normalized;
+
+	normalized = g_utf8_normalize (text, -1, G_NORMALIZE_ALL);
+	if (!normalized) {
+		return NULL;
+	}
+	case_normalized = g_utf8_casefold (normalized, -1);
+	g_free (normalized);
+
+	return case_normalized;
+}
+
+static int
+search_entry_compare (gconstpointer a,
+		      gconstpointer b)
+{
+	const NemoIconSearchEntry *entry_a = *(NemoIconSearchEntry **) a;
+	const NemoIconSearchEntry *entry_b = *(NemoIconSearchEntry **) b;
+
+	return strcmp (entry_a->key, entry_b->key);
+}
+
+/* Returns the index of the first entry whose key is >= @key, or,
+ * when @upper is TRUE, the first entry whose key is > @key.
+ */
+static guint
+search_index_bound (GPtrArray  *index,
+		    const char *key,
+		    gboolean    upper)
+{
+	NemoIconSearchEntry *entry;
+	guint lo, hi, mid;
+	int cmp;
+
+	lo = 0;
+	hi = index->len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		entry = g_ptr_array_index (index, mid);
+		cmp = strcmp (entry->key, key);
+		if (cmp < 0 || (upper && cmp == 0)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static NemoIconSearchEntry *
+search_entry_new (NemoIconContainer *container,
+		  NemoIcon          *icon)
+{
+	NemoIconSearchEntry *entry;
+	char *name, *key;
+
+	name = NULL;
+	nemo_icon_container_get_icon_text (container, icon->data, &name,
+					   NULL, NULL, NULL, TRUE);
+
+	/* This can happen if the index is built really early while
+	 * loading the icon container, before the items have all been
+	 * updated once.  Such icons are indexed when they get updated.
+	 */
+	if (!name) {
+		return NULL;
+	}
+
+	key = search_index_make_key (name);
+	g_free (name);
+
+	if (!key) {
+		return NULL;
+	}
+
+	entry = g_new (NemoIconSearchEntry, 1);
+	entry->key = key;
+	entry->icon = icon;
+	entry->position = 0;
+
+	return entry;
+}
+
+static void
+search_index_free (NemoIconContainer *container)
+{
+	NemoIconContainerDetails *details;
+
+	details = container->details;
+
+	g_clear_pointer (&details->search_index_entries, g_hash_table_destroy);
+	g_clear_pointer (&details->search_index, g_ptr_array_unref);
+}
+
+static void
+search_index_ensure (NemoIconContainer *container)
+{
+	NemoIconContainerDetails *details;
+	NemoIconSearchEntry *entry;
+	GList *p;
+	guint position;
+
+	details = container->details;
+
+	if (details->search_index != NULL) {
+		return;
+	}
+
+	details->search_index = g_ptr_array_new_full (g_list_length (details->icons),
+						      search_entry_free);
+	details->search_index_entries = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	position = 0;
+	for (p = details->icons; p != NULL; p = p->next, position++) {
+		entry = search_entry_new (container, p->data);
+		if (entry == NULL) {
+			continue;
+		}
+
+		entry->position = position;
+		g_ptr_array_add (details->search_index, entry);
+		g_hash_table_insert (details->search_index_entries, entry->icon, entry);
+	}
+
+	g_ptr_array_sort (details->search_index, search_entry_compare);
+	details->search_index_positions_valid = TRUE;
+}
+
+/* Renumbers the entries after the icon list got reordered or grew.
+ * Removing icons leaves the order of the others intact, so that doesn't
+ * need it.
+ */
+static void
+search_index_update_positions (NemoIconContainer *container)
+{
+	NemoIconContainerDetails *details;
+	NemoIconSearchEntry *entry;
+	GList *p;
+	guint position;
+
+	details = container->details;
+
+	if (details->search_index_positions_valid) {
+		return;
+	}
+
+	position = 0;
+	for (p = details->icons; p != NULL; p = p->next, position++) {
+		entry = g_hash_table_lookup (details->search_index_entries, p->data);
+		if (entry != NULL) {
+			entry->position = position;
+		}
+	}
+
+	details->search_index_positions_valid = TRUE;
+}
+
+static void
+search_index_remove_icon (NemoIconContainer *container,
+			  NemoIcon          *icon)
+{
+	NemoIconContainerDetails *details;
+	NemoIconSearchEntry *entry;
+	guint i;
+
+	details = container->details;
+
+	if (details->search_index == NULL) {
+		return;
+	}
+
+	entry = g_hash_table_lookup (details->search_index_entries, icon);
+	if (entry == NULL) {
+		return;
+	}
+
+	g_hash_table_remove (details->search_index_entries, icon);
+
+	for (i = search_index_bound (details->search_index, entry->key, FALSE);
+	     i < details->search_index->len; i++) {
+		if (g_ptr_array_index (details->search_index, i) == entry) {
+			g_ptr_array_remove_index (details->search_index, i);
+			break;
+		}
+	}
+}
+
+static void
+search_index_add_icon (NemoIconContainer *container,
+		       NemoIcon          *icon)
+{
+	NemoIconContainerDetails *details;
+	NemoIconSearchEntry *entry;
+
+	details = container->details;
+
+	if (details->search_index == NULL) {
+		return;
+	}
+
+	entry = search_entry_new (container, icon);
+	if (entry == NULL) {
+		return;
+	}
+
+	g_ptr_array_insert (details->search_index,
+			    search_index_bound (details->search_index, entry->key, TRUE),
+			    entry);
+	g_hash_table_insert (details->search_index_entries, icon, entry);
+	details->search_index_positions_valid = FALSE;
+}
+
 static gboolean
 nemo_icon_container_search_iter (NemoIconContainer *container,
 				     const char *key, gint n)
 {
-	GList *p;
-	NemoIcon *icon;
-	char *name;
+	NemoIconSearchEntry *entry, *candidate, *match;
+	GPtrArray *index;
+	char *case_normalized_key;
+	guint first, last, i;
 	int count;
-	char *normalized_key, *case_normalized_key;
-	char *normalized_name, *case_normalized_name;
 
 	g_assert (key != NULL);
 	g_assert (n >= 1);
 
-	normalized_key = g_utf8_normalize (key, -1, G_NORMALIZE_ALL);
-	if (!normalized_key) {
-		return FALSE;
-	}
-	case_normalized_key = g_utf8_casefold (normalized_key, -1);
-	g_free (normalized_key);
+	case_normalized_key = search_index_make_key (key);
 	if (!case_normalized_key) {
 		return FALSE;
 	}
 
-	icon = NULL;
-	name = NULL;
-	count = 0;
-	for (p = container->details->icons; p != NULL && count != n; p = p->next) {
-		icon = p->data;
-		nemo_icon_container_get_icon_text (container, icon->data, &name,
-						       NULL, NULL, NULL, TRUE);
-
-		/* This can happen if a key event is handled really early while
-		 * loading the icon container, before the items have all been
-		 * updated once.
-		 */
-		if (!name) {
-			continue;
-		}
+	search_index_ensure (container);
+	search_index_update_positions (container);
 
-		normalized_name = g_utf8_normalize (name, -1, G_NORMALIZE_ALL);
-		if (!normalized_name) {
-			continue;
-		}
-		case_normalized_name = g_utf8_casefold (normalized_name, -1);
-		g_free (normalized_name);
-		if (!case_normalized_name) {
-			continue;
-		}
+	/* Every name starting with the key sorts at or after the key itself,
+	 * and the matches are contiguous.
+	 */
+	index = container->details->search_index;
+	first = search_index_bound (index, case_normalized_key, FALSE);
 
-		if (strncmp (case_normalized_key, case_normalized_name,
-			     strlen (case_normalized_key)) == 0) {
-			count++;
+	for (last = first; last < index->len; last++) {
+		entry = g_ptr_array_index (index, last);
+		if (!g_str_has_prefix (entry->key, case_normalized_key)) {
+			break;
 		}
-
-		g_free (case_normalized_name);
-		g_free (name);
-		name = NULL;
 	}
 
 	g_free (case_normalized_key);
 
-	if (count == n) {
-		if (select_one_unselect_others (container, icon)) {
-			g_signal_emit (container, signals[SELECTION_CHANGED], 0);
+	/* The matches are visited in the order the view shows them: the n-th
+	 * one is the entry with the n-th smallest position in the run.
+	 */
+	if (last - first < (guint) n) {
+		return FALSE;
+	}
+
+	match = NULL;
+	for (count = 0; count < n; count++) {
+		entry = NULL;
+		for (i = first; i < last; i++) {
+			candidate = g_ptr_array_index (index, i);
+			if ((match == NULL || candidate->position > match->position) &&
+			    (entry == NULL || candidate->position < entry->position)) {
+				entry = candidate;
+			}
 		}
-		schedule_keyboard_icon_reveal (container, icon);
+		match = entry;
+	}
 
-		return TRUE;
+	if (select_one_unselect_others (container, match->icon)) {
+		g_signal_emit (container, signals[SELECTION_CHANGED], 0);
 	}
+	schedule_keyboard_icon_reveal (container, match->icon);
 
-	return FALSE;
+	return TRUE;
 }
 
 static void
@@ -4140,6 +4396,7 @@ nemo_icon_container_start_interactive_search (NemoIconContainer *container)
 	}
 
 	nemo_icon_container_ensure_interactive_directory (container);
+	search_index_ensure (container);
 
 	/* done, show it */
 	nemo_icon_container_search_position_func (container, container->details->search_window);
@@ -5276,6 +5533,8 @@ nemo_icon_container_clear (NemoIconContainer *container)
 
 	nemo_icon_container_end_renaming_mode (container, TRUE);
 
+	search_index_free (container);
+
 	clear_keyboard_focus (container);
 	clear_keyboard_rubberband_start (container);
 	unschedule_keyboard_icon_reveal (container);
@@ -5491,6 +5750,7 @@ icon_destroy (NemoIconContainer *container,
 	details->icons = g_list_remove (details->icons, icon);
 	details->new_icons = g_list_remove (details->new_icons, icon);
 	g_hash_table_remove (details->icon_set, icon->data);
+	search_index_remove_icon (container, icon);
 
 	was_selected = icon->is_selected;
 
@@ -5654,6 +5914,7 @@ update_visible_icons_cb (NemoIconContainer *container)
 	NemoIcon *icon;
 	gboolean visible;
 	GtkAllocation allocation;
+	NemoThumbnailViewport *viewport;
 
     container->details->update_visible_icons_id = 0;
 
@@ -5672,6 +5933,8 @@ update_visible_icons_cb (NemoIconContainer *container)
 	eel_canvas_c2w (EEL_CANVAS (container),
 			max_x, max_y, &max_x, &max_y);
 
+	viewport = nemo_thumbnail_viewport_new (container);
+
 	for (node = g_list_last (container->details->icons); node != NULL; node = node->prev) {
 		icon = node->data;
 
@@ -5689,15 +5952,18 @@ update_visible_icons_cb (NemoIconContainer *container)
 					     &y1);
 
             gint overshoot;
+            gint distance;
 
 			if (nemo_icon_container_is_layout_vertical (container)) {
                 overshoot = (max_x - min_x) / 2;
 
 				visible = x1 >= min_x - overshoot && x0 <= max_x + overshoot;
+                distance = MAX (0, MAX (min_x - x1, x0 - max_x));
 			} else {
                 overshoot = (max_y - min_y) / 2;
 
 				visible = y1 >= min_y - overshoot && y0 <= max_y + overshoot;
+                distance = MAX (0, MAX (min_y - y1, y0 - max_y));
 			}
 
 			if (visible) {
@@ -5713,9 +5979,11 @@ update_visible_icons_cb (NemoIconContainer *container)
                     }
 
                     nemo_file_invalidate_attributes (file, NEMO_FILE_DEFERRED_ATTRIBUTES);
-                } else {
+                }
+
+                if (nemo_file_is_thumbnailing (file) || nemo_file_should_show_thumbnail (file)) {
                     gchar *uri = nemo_file_get_uri (file);
-                    nemo_thumbnail_prioritize (uri);
+                    nemo_thumbnail_viewport_add (viewport, uri, distance);
                     g_free (uri);
                 }
 
@@ -5726,6 +5994,9 @@ update_visible_icons_cb (NemoIconContainer *container)
 		}
 	}
 
+	/* One batch per scroll; anything queued that isn't in it gets demoted */
+	nemo_thumbnail_viewport_publish (viewport);
+
     return G_SOURCE_REMOVE;
 }
 
@@ -5850,6 +6121,7 @@ nemo_icon_container_add (NemoIconContainer *container,
 	details->new_icons = g_list_prepend (details->new_icons, icon);
 
 	g_hash_table_insert (details->icon_set, data, icon);
+	search_index_add_icon (container, icon);
 
 	details->needs_resort = TRUE;
 
@@ -5926,6 +6198,11 @@ nemo_icon_container_request_update (NemoIconContainer *container,
 
 	if (icon != NULL) {
 		nemo_icon_container_update_icon (container, icon);
+
+		/* The name may have changed, re-file it in the search index. */
+		search_index_remove_icon (container, icon);
+		search_index_add_icon (container, icon);
+
 		container->details->needs_resort = TRUE;
 		schedule_redo_layout (container);
 	}
@@ -5985,6 +6262,9 @@ nemo_icon_container_request_update_all (NemoIconContainer *container)
 		nemo_icon_container_update_icon (container, icon);
 	}
 
+	/* Rebuilt on the next interactive search. */
+	search_index_free (container);
+
 	container->details->needs_resort = TRUE;
 	nemo_icon_container_redo_layout (container);
 
@@ -7601,8 +7881,8 @@ nemo_icon_container_accessible_icon_added_cb (NemoIconContainer *container,
 	icon = g_hash_table_lookup (container->details->icon_set, icon_data);
 	if (icon) {
 		atk_parent = ATK_OBJECT (data);
-		atk_child = atk_gobject_accessible_for_object
-			(G_OBJECT (icon->item));
+		/* May be NULL; listeners can ref the child by index */
+		atk_child = get_icon_accessible_if_needed (icon);
 		index = g_list_index (container->details->icons, icon);
 
 		g_signal_emit_by_name (atk_parent, "children_changed::add",
@@ -7623,8 +7903,8 @@ nemo_icon_container_accessible_icon_removed_cb (NemoIconContainer *container,
 	icon = g_hash_table_lookup (container->details->icon_set, icon_data);
 	if (icon) {
 		atk_parent = ATK_OBJECT (data);
-		atk_child = atk_gobject_accessible_for_object
-			(G_OBJECT (icon->item));
+		/* May be NULL; listeners can ref the child by index */
+		atk_child = get_icon_accessible_if_needed (icon);
 		index = g_list_index (container->details->icons, icon);
 
 		g_signal_emit_by_name (atk_parent, "children_changed::remove",
@@ -7701,6 +7981,7 @@ nemo_icon_container_accessible_ref_selection (AtkSelection *accessible,
 
 	icon = g_list_nth_data (priv->selection, i);
 	if (icon) {
+		NEMO_ICON_CONTAINER (EEL_CANVAS_ITEM (icon->item)->canvas)->details->a11y_children_requested = TRUE;
 		atk_object = atk_gobject_accessible_for_object (G_OBJECT (icon->item));
 		if (atk_object) {
 			g_object_ref (atk_object);
@@ -7865,6 +8146,7 @@ nemo_icon_container_accessible_ref_child (AtkObject *accessible, int i)
 	}
 
         container = NEMO_ICON_CONTAINER (widget);
+        container->details->a11y_children_requested = TRUE;
 
         icon = g_list_nth_data (container->details->icons, i);
         if (icon) {
@@ -8147,6 +8429,7 @@ void
 nemo_icon_container_resort (NemoIconContainer *container)
 {
     nemo_icon_container_sort_icons (container, &container->details->icons);
+    container->details->search_index_positions_valid = FALSE;
 }
 
 void
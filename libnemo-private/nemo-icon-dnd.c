@@ -1273,12 +1273,9 @@ prep_selection (NemoIconContainer *container,
                     item->icon_x = iter_rect.x;
                     item->icon_y = iter_rect.y;
                 } else {
-                    while (!iter_is_free) {
-                        nemo_centered_placement_grid_get_next_position_rect (grid,
-                                                                             &iter_rect,
-                                                                             &iter_rect,
-                                                                             &iter_is_free);
-                    }
+                    nemo_centered_placement_grid_get_next_free_position_rect (grid,
+                                                                              &iter_rect,
+                                                                              &iter_rect);
 
                     item->icon_x = iter_rect.x;
                     item->icon_y = iter_rect.y;
@@ -1358,12 +1355,9 @@ prep_selection (NemoIconContainer *container,
                     item->icon_x = iter_rect.x;
                     item->icon_y = iter_rect.y;
                 } else {
-                    while (!iter_is_free) {
-                        nemo_centered_placement_grid_get_next_position_rect (grid,
-                                                                             &iter_rect,
-                                                                             &iter_rect,
-                                                                             &iter_is_free);
-                    }
+                    nemo_centered_placement_grid_get_next_free_position_rect (grid,
+                                                                              &iter_rect,
+                                                                              &iter_rect);
 
                     item->icon_x = iter_rect.x;
                     item->icon_y = iter_rect.y;
@@ -103,8 +103,7 @@ typedef struct {
 typedef struct {
     NemoIconContainer *container;
     GtkBorder *borders;
-    int **icon_grid;
-    int *grid_memory;
+    gulong *bits;
     int num_rows;
     int num_columns;
     int icon_size;
@@ -115,8 +114,9 @@ typedef struct {
 
 typedef struct {
     NemoIconContainer *container;
-    int **icon_grid;
-    int *grid_memory;
+    gulong *bits;
+    gulong *scratch;
+    int words_per_column;
     int num_rows;
     int num_columns;
     gboolean tight;
@@ -281,6 +281,10 @@ struct NemoIconContainerDetails {
 	gboolean imcontext_changed;
 	/* a11y items used by canvas items */
 	guint a11y_item_action_idle_handler;
+	/* Set once an assistive technology has asked for our children; until
+	 * then, canvas items don't get accessibles created just to emit
+	 * notifications nobody listens to. */
+	gboolean a11y_children_requested;
 
         time_t layout_timestamp;
 
@@ -290,6 +294,15 @@ struct NemoIconContainerDetails {
 	GQueue* a11y_item_action_queue;
         int selected_iter;
 	guint search_entry_changed_id;
+
+	/* Sorted prefix index of the case-folded icon names used by the
+	 * interactive search.  Built lazily when the search entry first
+	 * opens, then maintained on icon add/remove/update until the
+	 * container is cleared.  The entries' icon list positions are
+	 * renumbered on the next search once the list is reordered. */
+	GPtrArray *search_index;
+	GHashTable *search_index_entries;
+	gboolean search_index_positions_valid;
 	guint typeselect_flush_timeout;
 
         gint current_dnd_x;
@@ -436,6 +449,9 @@ void               nemo_centered_placement_grid_get_next_position_rect (NemoCent
                                                                         GdkRectangle              *in_rect,
                                                                         GdkRectangle              *out_rect,
                                                                         gboolean                  *is_free);
+void               nemo_centered_placement_grid_get_next_free_position_rect (NemoCenteredPlacementGrid *grid,
+                                                                             GdkRectangle              *in_rect,
+                                                                             GdkRectangle              *out_rect);
 void               nemo_centered_placement_grid_get_current_position_rect (NemoCenteredPlacementGrid *grid,
                                                                            gint                       x,
                                                                            gint                       y,
@@ -459,5 +475,15 @@ gboolean           nemo_placement_grid_position_is_free  (NemoPlacementGrid *gri
 void               nemo_placement_grid_mark              (NemoPlacementGrid *grid, EelIRect pos);
 void               nemo_placement_grid_canvas_position_to_grid_position (NemoPlacementGrid *grid, EelIRect canvas_position, EelIRect *grid_position);
 void               nemo_placement_grid_mark_icon         (NemoPlacementGrid *grid, NemoIcon *icon);
+int                nemo_placement_grid_find_free_row     (NemoPlacementGrid *grid, EelIRect pos);
+
+/* Occupancy bitmap helpers, shared by both placement grids */
+
+#define NEMO_PLACEMENT_BITS_N_WORDS(n_bits) (((n_bits) + (GLIB_SIZEOF_LONG * 8) - 1) / (GLIB_SIZEOF_LONG * 8))
+
+gulong *           nemo_placement_bits_new               (gint n_bits);
+void               nemo_placement_bits_set_range         (gulong *bits, gint start, gint end, gboolean value);
+gboolean           nemo_placement_bits_get               (const gulong *bits, gint index);
+gint               nemo_placement_bits_find              (const gulong *bits, gint start, gint end, gboolean value);
 
 #endif /* NEMO_ICON_CONTAINER_PRIVATE_H */
@@ -27,6 +27,8 @@
 struct _NemoJobQueuePriv {
 	GList *queued_jobs;
     GList *running_jobs;
+    /* Long, low priority jobs that run alongside everything else */
+    GList *background_jobs;
     gulong pref_changed_id;
     gboolean skip_queue;
 };
@@ -157,11 +159,14 @@ job_finished_cb (NemoJobQueue *self,
     ptr = g_list_find_custom (self->priv->running_jobs, info, (GCompareFunc) compare_info_func);
     if (!ptr)
         ptr = g_list_find_custom (self->priv->queued_jobs, info, (GCompareFunc) compare_info_func);
+    if (!ptr)
+        ptr = g_list_find_custom (self->priv->background_jobs, info, (GCompareFunc) compare_info_func);
 
     Job *job = ptr->data;
 
     self->priv->running_jobs = g_list_remove (self->priv->running_jobs, job);
     self->priv->queued_jobs = g_list_remove (self->priv->queued_jobs, job);
+    self->priv->background_jobs = g_list_remove (self->priv->background_jobs, job);
 
     g_free (job);
 
@@ -211,6 +216,38 @@ nemo_job_queue_add_new_job (NemoJobQueue         *self,
     g_signal_emit (self, signals[NEW_JOB], 0, NULL);
 }
 
+/* Background jobs start right away and don't hold up the queue, so a
+ * long one can't keep file operations waiting. */
+void
+nemo_job_queue_add_background_job (NemoJobQueue         *self,
+                                   GIOSchedulerJobFunc   job_func,
+                                   gpointer              user_data,
+                                   GCancellable         *cancellable,
+                                   NemoProgressInfo     *info)
+{
+    Job *new_job = g_new0 (Job, 1);
+    new_job->job_func = job_func;
+    new_job->user_data = user_data;
+    new_job->cancellable = cancellable;
+    new_job->info = info;
+
+    self->priv->background_jobs =
+        g_list_append (self->priv->background_jobs, new_job);
+
+    nemo_progress_info_queue (info);
+
+    g_signal_connect_swapped (info, "finished",
+                              G_CALLBACK (job_finished_cb), self);
+
+    g_io_scheduler_push_job (job_func,
+                             user_data,
+                             NULL, // destroy notify
+                             G_PRIORITY_LOW,
+                             cancellable);
+
+    g_signal_emit (self, signals[NEW_JOB], 0, NULL);
+}
+
 static void
 start_job (NemoJobQueue *self, Job *job)
 {
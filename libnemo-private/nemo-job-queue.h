@@ -64,6 +64,12 @@ void nemo_job_queue_add_new_job (NemoJobQueue *self,
                                  NemoProgressInfo *info,
                                  gboolean start_immediately);
 
+void nemo_job_queue_add_background_job (NemoJobQueue *self,
+                                        GIOSchedulerJobFunc job_func,
+                                        gpointer user_data,
+                                        GCancellable *cancellable,
+                                        NemoProgressInfo *info);
+
 void nemo_job_queue_start_next_job (NemoJobQueue *self);
 
 void nemo_job_queue_start_job_by_info (NemoJobQueue     *self,
@@ -44,6 +44,9 @@ void nemo_run_lib_self_checks (void);
 	macro (nemo_self_check_directory) \
 	macro (nemo_self_check_file) \
 	macro (nemo_self_check_icon_container) \
+	macro (nemo_self_check_placement_grid) \
+	macro (nemo_self_check_query) \
+	macro (nemo_self_check_search_engine_advanced) \
 /* Add new self-check functions to the list above this line. */
 
 /* Generate prototypes for all the functions. */
@@ -22,9 +22,77 @@
 
 
 #include "math.h"
+#include <string.h>
 
 #include <eel/eel-art-extensions.h>
 #include "nemo-icon-private.h"
+#include "nemo-lib-self-check-functions.h"
+
+/* Occupancy bitmaps
+ *
+ * Cells are stored one bit each, packed into machine words, so free
+ * space can be found a word at a time (find-first-zero) instead of
+ * probing cell by cell.  These helpers are shared with the centered
+ * placement grid.
+ */
+
+#define BITS_PER_WORD (GLIB_SIZEOF_LONG * 8)
+
+gulong *
+nemo_placement_bits_new (gint n_bits)
+{
+    return g_new0 (gulong, NEMO_PLACEMENT_BITS_N_WORDS (n_bits));
+}
+
+void
+nemo_placement_bits_set_range (gulong *bits, gint start, gint end, gboolean value)
+{
+    gint i;
+
+    for (i = start; i < end; i++) {
+        if (value) {
+            bits[i / BITS_PER_WORD] |= 1UL << (i % BITS_PER_WORD);
+        } else {
+            bits[i / BITS_PER_WORD] &= ~(1UL << (i % BITS_PER_WORD));
+        }
+    }
+}
+
+gboolean
+nemo_placement_bits_get (const gulong *bits, gint index)
+{
+    return (bits[index / BITS_PER_WORD] >> (index % BITS_PER_WORD)) & 1;
+}
+
+/* Returns the first index in [start, end) whose bit equals @value,
+ * or @end if there is none. */
+gint
+nemo_placement_bits_find (const gulong *bits, gint start, gint end, gboolean value)
+{
+    gint word, last_word, bit;
+    gulong w;
+
+    if (start >= end) {
+        return end;
+    }
+
+    word = start / BITS_PER_WORD;
+    last_word = (end - 1) / BITS_PER_WORD;
+
+    w = value ? bits[word] : ~bits[word];
+    w &= ~0UL << (start % BITS_PER_WORD);
+
+    while (w == 0) {
+        if (++word > last_word) {
+            return end;
+        }
+        w = value ? bits[word] : ~bits[word];
+    }
+
+    bit = word * BITS_PER_WORD + g_bit_nth_lsf (w, -1);
+
+    return MIN (bit, end);
+}
 
 NemoPlacementGrid *
 nemo_placement_grid_new (NemoIconContainer *container, gboolean tight)
@@ -33,7 +101,6 @@ nemo_placement_grid_new (NemoIconContainer *container, gboolean tight)
     int width, height;
     int num_columns;
     int num_rows;
-    int i;
     GtkAllocation allocation;
 
     /* Get container dimensions */
@@ -53,28 +120,33 @@ nemo_placement_grid_new (NemoIconContainer *container, gboolean tight)
     grid->num_columns = num_columns;
     grid->num_rows = num_rows;
 
-    grid->grid_memory = g_new0 (int, (num_rows * num_columns));
-    grid->icon_grid = g_new0 (int *, num_columns);
-    
-    for (i = 0; i < num_columns; i++) {
-        grid->icon_grid[i] = grid->grid_memory + (i * num_rows);
-    }
-    
+    /* Column-major: each column is its own run of words, since icons are
+     * laid down top to bottom before moving to the next column. */
+    grid->words_per_column = NEMO_PLACEMENT_BITS_N_WORDS (num_rows);
+    grid->bits = g_new0 (gulong, grid->words_per_column * num_columns);
+    grid->scratch = g_new0 (gulong, grid->words_per_column);
+
     return grid;
 }
 
 void
 nemo_placement_grid_free (NemoPlacementGrid *grid)
 {
-    g_free (grid->icon_grid);
-    g_free (grid->grid_memory);
+    g_free (grid->bits);
+    g_free (grid->scratch);
     g_free (grid);
 }
 
+static inline gulong *
+grid_column (NemoPlacementGrid *grid, int x)
+{
+    return grid->bits + (x * grid->words_per_column);
+}
+
 gboolean
 nemo_placement_grid_position_is_free (NemoPlacementGrid *grid, EelIRect pos)
 {
-    int x, y;
+    int x;
     
     g_assert (pos.x0 >= 0 && pos.x0 < grid->num_columns);
     g_assert (pos.y0 >= 0 && pos.y0 < grid->num_rows);
@@ -82,10 +154,8 @@ nemo_placement_grid_position_is_free (NemoPlacementGrid *grid, EelIRect pos)
     g_assert (pos.y1 >= 0 && pos.y1 < grid->num_rows);
 
     for (x = pos.x0; x <= pos.x1; x++) {
-        for (y = pos.y0; y <= pos.y1; y++) {
-            if (grid->icon_grid[x][y] != 0) {
-                return FALSE;
-            }
+        if (nemo_placement_bits_find (grid_column (grid, x), pos.y0, pos.y1 + 1, TRUE) <= pos.y1) {
+            return FALSE;
         }
     }
 
@@ -95,7 +165,7 @@ nemo_placement_grid_position_is_free (NemoPlacementGrid *grid, EelIRect pos)
 void
 nemo_placement_grid_mark (NemoPlacementGrid *grid, EelIRect pos)
 {
-    int x, y;
+    int x;
     
     g_assert (pos.x0 >= 0 && pos.x0 < grid->num_columns);
     g_assert (pos.y0 >= 0 && pos.y0 < grid->num_rows);
@@ -103,10 +173,60 @@ nemo_placement_grid_mark (NemoPlacementGrid *grid, EelIRect pos)
     g_assert (pos.y1 >= 0 && pos.y1 < grid->num_rows);
 
     for (x = pos.x0; x <= pos.x1; x++) {
-        for (y = pos.y0; y <= pos.y1; y++) {
-            grid->icon_grid[x][y] = 1;
+        nemo_placement_bits_set_range (grid_column (grid, x), pos.y0, pos.y1 + 1, TRUE);
+    }
+}
+
+/**
+ * nemo_placement_grid_find_free_row:
+ * @grid: the grid
+ * @pos: a grid rectangle
+ *
+ * Finds the first row at or below @pos.y0 where a rectangle spanning the
+ * same columns and number of rows as @pos would be free.  Like
+ * nemo_placement_grid_canvas_position_to_grid_position(), a rectangle that
+ * runs past the last row is clipped to it.
+ *
+ * Returns: the row, or num_rows if the columns have no room left.
+ */
+int
+nemo_placement_grid_find_free_row (NemoPlacementGrid *grid, EelIRect pos)
+{
+    int x, w, y, height, next_used, last_needed;
+
+    g_assert (pos.x0 >= 0 && pos.x0 < grid->num_columns);
+    g_assert (pos.x1 >= 0 && pos.x1 < grid->num_columns);
+
+    /* Collapse the spanned columns into one */
+    memcpy (grid->scratch, grid_column (grid, pos.x0), grid->words_per_column * sizeof (gulong));
+    for (x = pos.x0 + 1; x <= pos.x1; x++) {
+        gulong *column = grid_column (grid, x);
+
+        for (w = 0; w < grid->words_per_column; w++) {
+            grid->scratch[w] |= column[w];
         }
     }
+
+    height = pos.y1 - pos.y0;
+    y = pos.y0;
+
+    while (y < grid->num_rows) {
+        y = nemo_placement_bits_find (grid->scratch, y, grid->num_rows, FALSE);
+        if (y >= grid->num_rows) {
+            break;
+        }
+
+        last_needed = MIN (y + height, grid->num_rows - 1);
+        next_used = nemo_placement_bits_find (grid->scratch, y, last_needed + 1, TRUE);
+
+        if (next_used > last_needed) {
+            return y;
+        }
+
+        y = next_used + 1;
+    }
+
+    return grid->num_rows;
 }
 
 void
@@ -154,3 +274,38 @@ nemo_placement_grid_mark_icon (NemoPlacementGrid *grid, NemoIcon *icon)
 
     nemo_placement_grid_mark (grid, grid_pos);
 }
+
+#if ! defined (NEMO_OMIT_SELF_CHECK)
+
+static gint
+check_find (const char *pattern, gint start, gboolean value)
+{
+    gulong *bits;
+    gint i, n, ret;
+
+    n = strlen (pattern);
+    bits = nemo_placement_bits_new (n);
+    for (i = 0; i < n; i++) {
+        nemo_placement_bits_set_range (bits, i, i + 1, pattern[i] == '1');
+    }
+
+    ret = nemo_placement_bits_find (bits, start, n, value);
+    g_free (bits);
+
+    return ret;
+}
+
+void
+nemo_self_check_placement_grid (void)
+{
+    EEL_CHECK_INTEGER_RESULT (check_find ("", 0, FALSE), 0);
+    EEL_CHECK_INTEGER_RESULT (check_find ("0000", 0, FALSE), 0);
+    EEL_CHECK_INTEGER_RESULT (check_find ("1110", 0, FALSE), 3);
+    EEL_CHECK_INTEGER_RESULT (check_find ("1111", 0, FALSE), 4);
+    EEL_CHECK_INTEGER_RESULT (check_find ("0001", 1, TRUE), 3);
+    EEL_CHECK_INTEGER_RESULT (check_find ("1000", 1, TRUE), 4);
+    EEL_CHECK_INTEGER_RESULT (check_find ("1111111111111111111111111111111111111111111111111111111111111111110", 0, FALSE), 66);
+    EEL_CHECK_INTEGER_RESULT (check_find ("0000000000000000000000000000000000000000000000000000000000000000001", 2, TRUE), 66);
+}
+
+#endif /* ! NEMO_OMIT_SELF_CHECK */
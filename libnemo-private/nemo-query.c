@@ -28,6 +28,7 @@
 #include <eel/eel-glib-extensions.h>
 #include <glib/gi18n.h>
 #include <libnemo-private/nemo-file-utilities.h>
+#include "nemo-lib-self-check-functions.h"
 
 struct NemoQueryDetails {
     gchar *file_pattern;
@@ -41,6 +42,8 @@ struct NemoQueryDetails {
     gboolean content_use_regex;
     gboolean count_hits;
     gboolean recurse;
+    gboolean has_candidates;
+    GList *candidates;
 };
 
 G_DEFINE_TYPE (NemoQuery, nemo_query, G_TYPE_OBJECT);
@@ -54,6 +57,7 @@ finalize (GObject *object)
     g_free (query->details->file_pattern);
 	g_free (query->details->content_pattern);
 	g_free (query->details->location_uri);
+	g_list_free_full (query->details->candidates, g_free);
 
 	G_OBJECT_CLASS (nemo_query_parent_class)->finalize (object);
 }
@@ -300,3 +304,230 @@ nemo_query_set_recurse (NemoQuery *query, gboolean recurse)
     query->details->recurse = recurse;
 }
 
+/**
+ * nemo_query_set_candidates:
+ * @query: a #NemoQuery
+ * @uris: (element-type utf8): the only files that can match
+ * @restricted: whether to use @uris at all
+ *
+ * Limits the search to @uris - used when @query only narrows an earlier
+ * one, so its results have to be among the earlier results.  An empty
+ * list with @restricted set means nothing can match.  Engines are free to
+ * ignore this and search as usual.
+ */
+void
+nemo_query_set_candidates (NemoQuery *query, GList *uris, gboolean restricted)
+{
+    g_return_if_fail (NEMO_IS_QUERY (query));
+
+    g_list_free_full (query->details->candidates, g_free);
+    query->details->candidates = restricted ? eel_g_str_list_copy (uris) : NULL;
+    query->details->has_candidates = restricted;
+}
+
+gboolean
+nemo_query_has_candidates (NemoQuery *query)
+{
+    g_return_val_if_fail (NEMO_IS_QUERY (query), FALSE);
+
+    return query->details->has_candidates;
+}
+
+GList *
+nemo_query_get_candidates (NemoQuery *query)
+{
+    g_return_val_if_fail (NEMO_IS_QUERY (query), NULL);
+
+    return eel_g_str_list_copy (query->details->candidates);
+}
+
+static gchar *
+fold_pattern (const gchar *text, gboolean case_sensitive)
+{
+    gchar *normalized, *folded;
+
+    normalized = g_utf8_normalize (text != NULL ? text : "", -1, G_NORMALIZE_NFD);
+
+    if (case_sensitive) {
+        return normalized;
+    }
+
+    folded = g_utf8_strdown (normalized, -1);
+    g_free (normalized);
+
+    return folded;
+}
+
+static gboolean
+has_wildcards (const gchar *word)
+{
+    return strchr (word, '*') != NULL || strchr (word, '?') != NULL;
+}
+
+/* Filename patterns are words that must all match, plain ones anywhere in
+ * the name.  Each earlier word has to be kept, or - if it's plain - be
+ * part of a longer plain word. */
+static gboolean
+file_pattern_narrows (const gchar *pattern,
+                      const gchar *previous,
+                      gboolean     case_sensitive)
+{
+    gchar *folded, *previous_folded;
+    gchar **words, **previous_words;
+    gboolean narrows = TRUE;
+    gint i, j;
+
+    folded = fold_pattern (pattern, case_sensitive);
+    previous_folded = fold_pattern (previous, case_sensitive);
+    words = g_strsplit_set (folded, " \t\r\n", -1);
+    previous_words = g_strsplit_set (previous_folded, " \t\r\n", -1);
+
+    for (i = 0; previous_words[i] != NULL && narrows; i++) {
+        gboolean kept = FALSE;
+
+        if (previous_words[i][0] == '\0') {
+            continue;
+        }
+
+        for (j = 0; words[j] != NULL && !kept; j++) {
+            if (has_wildcards (previous_words[i])) {
+                kept = strcmp (words[j], previous_words[i]) == 0;
+            } else {
+                kept = !has_wildcards (words[j]) && strstr (words[j], previous_words[i]) != NULL;
+            }
+        }
+
+        narrows = kept;
+    }
+
+    g_strfreev (words);
+    g_strfreev (previous_words);
+    g_free (folded);
+    g_free (previous_folded);
+
+    return narrows;
+}
+
+static gboolean
+mime_types_equal (GList *a, GList *b)
+{
+    for (; a != NULL && b != NULL; a = a->next, b = b->next) {
+        if (g_strcmp0 (a->data, b->data) != 0) {
+            return FALSE;
+        }
+    }
+
+    return a == NULL && b == NULL;
+}
+
+/**
+ * nemo_query_narrows:
+ * @query: a #NemoQuery
+ * @previous: an earlier #NemoQuery
+ *
+ * Returns: whether every file matching @query must also have matched
+ * @previous, judging by the queries alone.
+ */
+gboolean
+nemo_query_narrows (NemoQuery *query, NemoQuery *previous)
+{
+    NemoQueryDetails *details, *previous_details;
+
+    g_return_val_if_fail (NEMO_IS_QUERY (query), FALSE);
+    g_return_val_if_fail (NEMO_IS_QUERY (previous), FALSE);
+
+    details = query->details;
+    previous_details = previous->details;
+
+    if (g_strcmp0 (details->location_uri, previous_details->location_uri) != 0 ||
+        details->recurse != previous_details->recurse ||
+        (details->show_hidden && !previous_details->show_hidden) ||
+        (previous_details->mime_types != NULL &&
+         !mime_types_equal (details->mime_types, previous_details->mime_types))) {
+        return FALSE;
+    }
+
+    if (details->file_use_regex != previous_details->file_use_regex ||
+        details->file_case_sensitive != previous_details->file_case_sensitive) {
+        return FALSE;
+    }
+
+    if (details->file_use_regex) {
+        if (g_strcmp0 (details->file_pattern, previous_details->file_pattern) != 0) {
+            return FALSE;
+        }
+    } else if (!file_pattern_narrows (details->file_pattern, previous_details->file_pattern,
+                                      details->file_case_sensitive)) {
+        return FALSE;
+    }
+
+    /* No content pattern before matched any content */
+    if (previous_details->content_pattern == NULL) {
+        return TRUE;
+    }
+
+    if (details->content_pattern == NULL ||
+        details->content_use_regex != previous_details->content_use_regex ||
+        details->content_case_sensitive != previous_details->content_case_sensitive) {
+        return FALSE;
+    }
+
+    if (details->content_use_regex) {
+        return g_strcmp0 (details->content_pattern, previous_details->content_pattern) == 0;
+    } else {
+        gchar *folded, *previous_folded;
+        gboolean narrows;
+
+        folded = fold_pattern (details->content_pattern, details->content_case_sensitive);
+        previous_folded = fold_pattern (previous_details->content_pattern, details->content_case_sensitive);
+        narrows = strstr (folded, previous_folded) != NULL;
+
+        g_free (folded);
+        g_free (previous_folded);
+
+        return narrows;
+    }
+}
+
+#if ! defined (NEMO_OMIT_SELF_CHECK)
+
+static gboolean
+check_narrows (const char *file_pattern, const char *content_pattern,
+               const char *previous_file_pattern, const char *previous_content_pattern)
+{
+    NemoQuery *query, *previous;
+    gboolean ret;
+
+    query = nemo_query_new ();
+    nemo_query_set_file_pattern (query, file_pattern);
+    nemo_query_set_content_pattern (query, content_pattern);
+
+    previous = nemo_query_new ();
+    nemo_query_set_file_pattern (previous, previous_file_pattern);
+    nemo_query_set_content_pattern (previous, previous_content_pattern);
+
+    ret = nemo_query_narrows (query, previous);
+
+    g_object_unref (query);
+    g_object_unref (previous);
+
+    return ret;
+}
+
+void
+nemo_self_check_query (void)
+{
+    EEL_CHECK_BOOLEAN_RESULT (check_narrows ("report", NULL, "rep", NULL), TRUE);
+    EEL_CHECK_BOOLEAN_RESULT (check_narrows ("Report", NULL, "rep", NULL), TRUE);
+    EEL_CHECK_BOOLEAN_RESULT (check_narrows ("rep", NULL, "report", NULL), FALSE);
+    EEL_CHECK_BOOLEAN_RESULT (check_narrows ("rep *.pdf", NULL, "rep", NULL), TRUE);
+    EEL_CHECK_BOOLEAN_RESULT (check_narrows ("rep", NULL, "rep *.pdf", NULL), FALSE);
+    EEL_CHECK_BOOLEAN_RESULT (check_narrows ("rep*", NULL, "rep", NULL), FALSE);
+    EEL_CHECK_BOOLEAN_RESULT (check_narrows ("anything", NULL, "", NULL), TRUE);
+    EEL_CHECK_BOOLEAN_RESULT (check_narrows ("", "total", "", NULL), TRUE);
+    EEL_CHECK_BOOLEAN_RESULT (check_narrows ("", "totals", "", "total"), TRUE);
+    EEL_CHECK_BOOLEAN_RESULT (check_narrows ("", "tot", "", "total"), FALSE);
+    EEL_CHECK_BOOLEAN_RESULT (check_narrows ("", NULL, "", "total"), FALSE);
+}
+
+#endif /* ! NEMO_OMIT_SELF_CHECK */
@@ -81,6 +81,12 @@ void           nemo_query_set_use_content_regex      (NemoQuery *query, gboolean
 gboolean       nemo_query_get_recurse         (NemoQuery *query);
 void           nemo_query_set_recurse         (NemoQuery *query, gboolean recurse);
 
+void           nemo_query_set_candidates      (NemoQuery *query, GList *uris, gboolean restricted);
+gboolean       nemo_query_has_candidates      (NemoQuery *query);
+GList *        nemo_query_get_candidates      (NemoQuery *query);
+
+gboolean       nemo_query_narrows             (NemoQuery *query, NemoQuery *previous);
+
 char *         nemo_query_to_readable_string (NemoQuery *query);
 NemoQuery *nemo_query_load               (char *file);
 gboolean       nemo_query_save               (NemoQuery *query, char *file);
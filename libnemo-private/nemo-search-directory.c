@@ -45,6 +45,13 @@ struct NemoSearchDirectoryDetails {
 	gboolean search_running;
 	gboolean search_finished;
 
+	/* The query behind the current results, once its search is complete */
+	NemoQuery *finished_query;
+	/* Set when the new query narrows finished_query - the next search only
+	 * looks at these results again */
+	gboolean refine_pending;
+	GList *refine_uris;
+
 	GList *files;
 	GHashTable *file_hash;
 
@@ -134,6 +141,29 @@ reset_file_list (NemoSearchDirectory *search)
     nemo_search_engine_report_accounting ();
 }
 
+/* Hands the query to the engine, limited to the earlier results if it
+ * only narrows them */
+static void
+set_engine_query (NemoSearchDirectory *search)
+{
+	nemo_query_set_show_hidden (search->details->query,
+				    g_settings_get_boolean (nemo_preferences, NEMO_PREFERENCES_SHOW_HIDDEN_FILES));
+
+	if (search->details->refine_pending &&
+	    nemo_query_narrows (search->details->query, search->details->finished_query)) {
+		nemo_query_set_candidates (search->details->query, search->details->refine_uris, TRUE);
+	} else {
+		nemo_query_set_candidates (search->details->query, NULL, FALSE);
+	}
+
+	search->details->refine_pending = FALSE;
+	g_list_free_full (search->details->refine_uris, g_free);
+	search->details->refine_uris = NULL;
+	g_clear_object (&search->details->finished_query);
+
+	nemo_search_engine_set_query (search->details->engine, search->details->query);
+}
+
 static void
 start_or_stop_search_engine (NemoSearchDirectory *search, gboolean adding)
 {
@@ -145,11 +175,7 @@ start_or_stop_search_engine (NemoSearchDirectory *search, gboolean adding)
 		search->details->search_running = TRUE;
 		search->details->search_finished = FALSE;
 		ensure_search_engine (search);
-
-        nemo_query_set_show_hidden (search->details->query,
-                                    g_settings_get_boolean (nemo_preferences, NEMO_PREFERENCES_SHOW_HIDDEN_FILES));
-
-		nemo_search_engine_set_query (search->details->engine, search->details->query);
+		set_engine_query (search);
 
 		reset_file_list (search);
 
@@ -487,6 +513,17 @@ search_engine_hits_added (NemoSearchEngine *engine, GList *hits,
         fsr = (FileSearchResult *) hit->data;
 
         file = nemo_file_get_by_uri (fsr->uri);
+
+        /* Saves querying the file again before it can be shown - unless
+         * what's known is still current, which is at least as fresh. */
+        if (fsr->info != NULL) {
+            if (!file->details->got_file_info || !file->details->file_info_is_up_to_date) {
+                nemo_file_update_info (file, fsr->info);
+            }
+
+            g_clear_object (&fsr->info);
+        }
+
         if (nemo_file_add_search_result_data (file, (gpointer) search, fsr)) {
             for (monitor_list = search->details->monitor_list; monitor_list; monitor_list = monitor_list->next) {
                 monitor = monitor_list->data;
@@ -575,6 +612,7 @@ static void
 search_engine_finished (NemoSearchEngine *engine, NemoSearchDirectory *search)
 {
 	search->details->search_finished = TRUE;
+	g_set_object (&search->details->finished_query, search->details->query);
 
 	nemo_directory_emit_done_loading (NEMO_DIRECTORY (search));
 
@@ -612,10 +650,7 @@ search_force_reload (NemoDirectory *directory)
 	if (search->details->search_running) {
 		nemo_search_engine_stop (search->details->engine);
 
-        nemo_query_set_show_hidden (search->details->query,
-                                    g_settings_get_boolean (nemo_preferences, NEMO_PREFERENCES_SHOW_HIDDEN_FILES));
-
-		nemo_search_engine_set_query (search->details->engine, search->details->query);
+		set_engine_query (search);
 		nemo_search_engine_start (search->details->engine);
 	}
 }
@@ -705,6 +740,10 @@ search_dispose (GObject *object)
 		search->details->query = NULL;
 	}
 
+	g_clear_object (&search->details->finished_query);
+	g_list_free_full (search->details->refine_uris, g_free);
+	search->details->refine_uris = NULL;
+
 	if (search->details->engine) {
 		if (search->details->search_running) {
 			nemo_search_engine_stop (search->details->engine);
@@ -782,6 +821,23 @@ nemo_search_directory_set_query (NemoSearchDirectory *search,
 		search->details->modified = TRUE;
 	}
 
+	/* The results can be re-checked rather than searched for again - the
+	 * query itself is compared once it's final, as the search starts. */
+	g_list_free_full (search->details->refine_uris, g_free);
+	search->details->refine_uris = NULL;
+	search->details->refine_pending = FALSE;
+
+	if (query != NULL && search->details->finished_query != NULL) {
+		GList *l;
+
+		for (l = search->details->files; l != NULL; l = l->next) {
+			search->details->refine_uris = g_list_prepend (search->details->refine_uris,
+								       nemo_file_get_uri (l->data));
+		}
+
+		search->details->refine_pending = TRUE;
+	}
+
 	if (query) {
 		g_object_ref (query);
 	}
@@ -19,14 +19,19 @@
 
 #include <config.h>
 #include "nemo-file.h"
+#include "nemo-file-private.h"
 #include "nemo-directory.h"
 #include "nemo-file-utilities.h"
 #include "nemo-search-engine-advanced.h"
 #include "nemo-global-preferences.h"
+#include "nemo-search-helper-cache.h"
+#include "nemo-document-text.h"
+#include "nemo-lib-self-check-functions.h"
 
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <glib.h>
 #include <gio/gio.h>
 
@@ -43,21 +48,96 @@
 #define CONTENT_SEARCH_BATCH_SIZE 1
 #define SNIPPET_EXTEND_SIZE 100
 
+/* Files are read this much at a time, cut back to the last full line */
+#define CONTENT_WINDOW_SIZE (1024 * 1024)
+
+/* Plain text files are sniffed this far before reading on - a nul byte in
+ * it, or more than one in BINARY_INVALID_RATIO bytes not being UTF-8, and
+ * the file is taken to be mislabeled binary and skipped. */
+#define BINARY_SNIFF_SIZE 8192
+#define BINARY_INVALID_RATIO 10
+
+/* Recursive searches walk the tree with this many threads at most */
+#define MAX_SEARCH_WORKERS 8
+/* How long an idle worker sleeps before checking for cancellation again */
+#define WORKER_IDLE_TIMEOUT (100 * G_TIME_SPAN_MILLISECOND)
+
+/* Helpers run on a pool with a thread per processor.  Past this many
+ * waiting files per thread, traversal waits for the pool to catch up. */
+#define HELPER_BACKLOG_PER_THREAD 4
+/* A helper still running after this many seconds is killed, and a document
+ * converted in process is given up on */
+#define HELPER_TIMEOUT 60
+/* The address space a helper may use - a runaway conversion fails
+ * instead of taking the machine's memory */
+#define HELPER_MEMORY_LIMIT ((rlim_t) 2 * 1024 * 1024 * 1024)
+
 typedef struct {
     gchar *filename;
     gchar *def_path;
     gchar *exec_format;
-    /* future? */
+    /* Helpers built from nemo-document-text are run in-process instead */
+    gboolean in_process;
+    NemoDocumentFormat format;
 } SearchHelper;
 
+typedef enum {
+    MATCH_SUBSTRING,
+    MATCH_PREFIX,
+    MATCH_SUFFIX,
+    MATCH_EXACT,
+    MATCH_GLOB
+} FilenameMatchType;
+
+/* One word of a (non-regex) filename search. Most words are plain text or
+ * have wildcards only at the ends, which a string compare handles without
+ * going through GPatternSpec. */
+typedef struct {
+    FilenameMatchType type;
+    gchar *literal;
+    gsize literal_len;
+    GPatternSpec *pattern; /* MATCH_GLOB only */
+} FilenameMatcher;
+
+typedef struct _SearchThreadData SearchThreadData;
+
 typedef struct {
+    SearchThreadData *data;
+    gint index;
+    GThread *thread;
+
+    /* Reused for each name, to save allocating a converted copy */
+    GString *name_buffer;
+    /* CONTENT_WINDOW_SIZE, allocated on first use */
+    gchar *content_buffer;
+
+    /* GFiles - the owner works from the tail, idle workers steal from the head */
+    GMutex lock;
+    GQueue directories;
+} SearchWorker;
+
+struct _SearchThreadData {
 	NemoSearchEngineAdvanced *engine;
 	GCancellable *cancellable;
 
 	GList *mime_types;
 
-	GQueue *directories; /* GFiles */
+    SearchWorker *workers;
+    gint n_workers;
 
+    /* URIs of the only files that can match, when the query narrows an
+     * earlier one - these are checked instead of walking the tree */
+    GPtrArray *candidates;
+    gint next_candidate;
+
+    /* Guards pending_directories and work_generation, and goes with work_cond
+     * for idle workers waiting for something to steal. */
+    GMutex work_lock;
+    GCond work_cond;
+    gint pending_directories; /* queued or being visited */
+    guint work_generation;
+
+    GMutex visited_lock;
 	GHashTable *visited;
     GHashTable *skip_folders;
 
@@ -65,8 +145,38 @@ typedef struct {
     GRegex *content_re;
     GRegex *newline_re;
 
+    /* Text any content match must contain, if there is any - files are
+     * only handed to content_re around places this turns up */
+    gchar *content_literal;
+    gsize content_literal_len;
+    gboolean content_literal_caseless;
+
+    /* Size limit of the stored helper output, 0 if it isn't stored */
+    gint64 helper_cache_limit;
+
+    /* Runs HelperJobs for content searches.  helper_lock guards
+     * helper_queued, the jobs queued or running, and goes with helper_cond
+     * for workers waiting for it to drop below helper_backlog_limit. */
+    GThreadPool *helper_pool;
+    guint helper_backlog_limit;
+    GMutex helper_lock;
+    GCond helper_cond;
+    guint helper_queued;
+
+    /* Plain text files bigger than this aren't read, 0 for no limit */
+    goffset content_max_size;
+
+    /* What content search cost, for the debug output at the end */
+    GMutex stats_lock;
+    guint64 stats_bytes_read;
+    guint stats_files_read;
+    guint stats_helper_runs;
+    guint stats_helper_stored; /* helper output read back from the cache */
+    guint stats_skipped_binary;
+    guint stats_skipped_size;
+
     GRegex *filename_re;
-    GList *filename_glob_patterns;
+    GList *filename_matchers;
 
     GMutex hit_list_lock;
     GList *hit_list; // holds FileSearchResults
@@ -79,7 +189,7 @@ typedef struct {
     gboolean location_supports_content_search;
 
     GTimer *timer;
-} SearchThreadData;
+};
 
 struct NemoSearchEngineAdvancedDetails {
 	NemoQuery *query;
@@ -151,6 +261,9 @@ process_search_helper_file (const gchar *path)
     gchar **try_exec_list = NULL;
     gchar *abs_try_path = NULL;
     gchar **mime_types = NULL;
+    gchar **exec_argv = NULL;
+    gboolean in_process = FALSE;
+    NemoDocumentFormat format = NEMO_DOCUMENT_FORMAT_ODF;
     gsize n_types;
     gint i;
 
@@ -209,6 +322,13 @@ process_search_helper_file (const gchar *path)
         goto done;
     }
 
+    if (g_shell_parse_argv (exec_format, NULL, &exec_argv, NULL)) {
+        g_autofree gchar *program = g_path_get_basename (exec_argv[0]);
+
+        in_process = nemo_document_format_for_program (program, &format);
+        g_strfreev (exec_argv);
+    }
+
     /* The helper table is keyed to mimetype strings, which will point to the same value */
 
     for (i = 0; i < n_types; i++) {
@@ -222,6 +342,8 @@ process_search_helper_file (const gchar *path)
         helper->filename = g_path_get_basename (path);
         helper->def_path = g_strdup (path);
         helper->exec_format = g_strdup (exec_format);
+        helper->in_process = in_process;
+        helper->format = format;
 
         existing = g_hash_table_lookup (search_helpers, mime_type);
 
@@ -401,6 +523,332 @@ nemo_search_engine_advanced_create_content_regex (NemoQuery  *query,
                         error);
 }
 
+static FilenameMatcher *
+filename_matcher_new (const gchar *word_pattern)
+{
+    FilenameMatcher *matcher;
+    const gchar *start, *end;
+    gboolean leading_star, trailing_star;
+
+    matcher = g_new0 (FilenameMatcher, 1);
+
+    start = word_pattern;
+    end = word_pattern + strlen (word_pattern);
+
+    leading_star = start < end && *start == '*';
+    if (leading_star) {
+        start++;
+    }
+
+    trailing_star = start < end && *(end - 1) == '*';
+    if (trailing_star) {
+        end--;
+    }
+
+    if (memchr (start, '*', end - start) != NULL || memchr (start, '?', end - start) != NULL) {
+        matcher->type = MATCH_GLOB;
+        matcher->pattern = g_pattern_spec_new (word_pattern);
+        return matcher;
+    }
+
+    matcher->literal = g_strndup (start, end - start);
+    matcher->literal_len = end - start;
+
+    if (leading_star && trailing_star) {
+        matcher->type = MATCH_SUBSTRING;
+    } else if (leading_star) {
+        matcher->type = MATCH_SUFFIX;
+    } else if (trailing_star) {
+        matcher->type = MATCH_PREFIX;
+    } else {
+        /* A lone '*' stripped as leading */
+        matcher->type = matcher->literal_len == 0 && leading_star ? MATCH_SUBSTRING : MATCH_EXACT;
+    }
+
+    return matcher;
+}
+
+static void
+filename_matcher_free (FilenameMatcher *matcher)
+{
+    g_free (matcher->literal);
+    g_clear_pointer (&matcher->pattern, g_pattern_spec_free);
+    g_free (matcher);
+}
+
+static gboolean
+filename_matcher_match (FilenameMatcher *matcher,
+                        const gchar     *name,
+                        gsize            len)
+{
+    switch (matcher->type) {
+        case MATCH_SUBSTRING:
+            return matcher->literal_len == 0 || strstr (name, matcher->literal) != NULL;
+        case MATCH_PREFIX:
+            return len >= matcher->literal_len &&
+                   memcmp (name, matcher->literal, matcher->literal_len) == 0;
+        case MATCH_SUFFIX:
+            return len >= matcher->literal_len &&
+                   memcmp (name + len - matcher->literal_len, matcher->literal, matcher->literal_len) == 0;
+        case MATCH_EXACT:
+            return len == matcher->literal_len &&
+                   memcmp (name, matcher->literal, len) == 0;
+        case MATCH_GLOB:
+        default:
+            /* GPatternSpec reverses the string itself only if it needs to */
+            return g_pattern_spec_match (matcher->pattern, len, name, NULL);
+    }
+}
+
+/* Returns the name as the search patterns see it - NFD normalized, and lower
+ * case if fold_case - either name itself or a copy in buffer.  Plain ASCII
+ * names, which are most of them, are already NFD and only need their case
+ * folding. */
+static const gchar *
+prepare_name_for_match (GString     *buffer,
+                        const gchar *name,
+                        gboolean     fold_case,
+                        gsize       *len)
+{
+    gchar *normalized, *cased;
+    gsize i, n;
+
+    for (n = 0; name[n] != '\0'; n++) {
+        if ((guchar) name[n] >= 0x80) {
+            break;
+        }
+    }
+
+    if (name[n] == '\0') {
+        *len = n;
+
+        if (!fold_case) {
+            return name;
+        }
+
+        g_string_set_size (buffer, n);
+
+        for (i = 0; i < n; i++) {
+            buffer->str[i] = g_ascii_tolower (name[i]);
+        }
+
+        return buffer->str;
+    }
+
+    normalized = g_utf8_normalize (name, -1, G_NORMALIZE_NFD);
+
+    if (normalized == NULL) {
+        normalized = g_strdup (name);
+    }
+
+    if (fold_case) {
+        cased = g_utf8_strdown (normalized, -1);
+        g_free (normalized);
+    } else {
+        cased = normalized;
+    }
+
+    g_string_assign (buffer, cased);
+    g_free (cased);
+
+    *len = buffer->len;
+
+    return buffer->str;
+}
+
+/* Skips an alphanumeric escape, starting just after its backslash, along
+ * with whatever argument it takes - \x41, \cA, \k<name>, \g{-1}, \p{L},
+ * \012 and so on. */
+static const gchar *
+skip_escape (const gchar *p)
+{
+    gchar kind = *p;
+
+    p = g_utf8_next_char (p);
+
+    if (g_ascii_isdigit (kind)) {
+        while (g_ascii_isdigit (*p)) {
+            p++;
+        }
+
+        return p;
+    }
+
+    if ((*p == '{' && strchr ("gkNopPx", kind) != NULL) ||
+        ((*p == '<' || *p == '\'') && (kind == 'g' || kind == 'k'))) {
+        gchar close = *p == '{' ? '}' : *p == '<' ? '>' : '\'';
+        const gchar *end = strchr (p + 1, close);
+
+        return end != NULL ? end + 1 : p + strlen (p);
+    }
+
+    switch (kind) {
+        case 'x':
+            if (g_ascii_isxdigit (*p)) {
+                p++;
+                if (g_ascii_isxdigit (*p)) {
+                    p++;
+                }
+            }
+            break;
+        case 'c':
+            if (*p != '\0') {
+                p = g_utf8_next_char (p);
+            }
+            break;
+        case 'g':
+            if (*p == '-' || *p == '+') {
+                p++;
+            }
+            while (g_ascii_isdigit (*p)) {
+                p++;
+            }
+            break;
+        case 'p':
+        case 'P':
+            if (g_ascii_isalpha (*p)) {
+                p++;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return p;
+}
+
+/* The longest run of plain text that every match of pattern has to contain,
+ * or NULL.  This errs on the side of giving up - alternatives, inline
+ * options and \Q..\E quoting all mean there's no literal to go on. */
+static gchar *
+extract_required_literal (const gchar *pattern)
+{
+    GString *best, *run;
+    const gchar *p, *next, *literal_start;
+
+    if (strchr (pattern, '|') != NULL || strstr (pattern, "(?") != NULL || strstr (pattern, "\\Q") != NULL) {
+        return NULL;
+    }
+
+    best = g_string_new (NULL);
+    run = g_string_new (NULL);
+
+    for (p = pattern; *p != '\0'; p = next) {
+        literal_start = NULL;
+        next = g_utf8_next_char (p);
+
+        if (*p == '\\') {
+            if (*next == '\0') {
+                break;
+            }
+
+            /* Escaped punctuation is itself - anything else is a class,
+             * an anchor, a character code or a back reference */
+            if (g_ascii_ispunct (*next)) {
+                literal_start = next;
+                next = g_utf8_next_char (next);
+            } else {
+                next = skip_escape (next);
+            }
+        } else if (*p == '[' || *p == '(' || *p == '{') {
+            gchar close = *p == '[' ? ']' : *p == '(' ? ')' : '}';
+            gint depth = 1;
+
+            /* Skip the whole class, group or repeat count - a group may
+             * be optional */
+            if (*p == '[' && *next == ']') {
+                next++;
+            }
+
+            while (*next != '\0' && depth > 0) {
+                if (*next == '\\' && next[1] != '\0') {
+                    next++;
+                } else if (*p == '(' && *next == '(') {
+                    depth++;
+                } else if (*next == close) {
+                    depth--;
+                }
+
+                next++;
+            }
+        } else if (strchr ("^$.)]}*+?", *p) == NULL) {
+            literal_start = p;
+        }
+
+        if (literal_start != NULL && *next != '*' && *next != '?' && *next != '{') {
+            g_string_append_len (run, literal_start, g_utf8_next_char (literal_start) - literal_start);
+            continue;
+        }
+
+        /* Anything else, including a literal that's made optional by what
+         * follows it, ends the run */
+        if (run->len > best->len) {
+            g_string_assign (best, run->str);
+        }
+
+        g_string_truncate (run, 0);
+    }
+
+    if (run->len > best->len) {
+        g_string_assign (best, run->str);
+    }
+
+    g_string_free (run, TRUE);
+
+    if (best->len < 2) {
+        g_string_free (best, TRUE);
+        return NULL;
+    }
+
+    return g_string_free (best, FALSE);
+}
+
+static void
+setup_content_literal (SearchThreadData *data,
+                       NemoQuery        *query)
+{
+    g_autofree gchar *text = NULL;
+    g_autofree gchar *normalized = NULL;
+    gchar *literal;
+    const gchar *p;
+
+    text = nemo_query_get_content_pattern (query);
+    normalized = g_utf8_normalize (text, -1, G_NORMALIZE_NFD);
+
+    if (normalized == NULL) {
+        return;
+    }
+
+    if (nemo_query_get_use_content_regex (query)) {
+        literal = extract_required_literal (normalized);
+    } else {
+        literal = g_strdup (normalized);
+    }
+
+    if (literal == NULL || literal[0] == '\0') {
+        g_free (literal);
+        return;
+    }
+
+    data->content_literal_caseless = !nemo_query_get_content_case_sensitive (query);
+
+    if (data->content_literal_caseless) {
+        /* Only ASCII has simple enough case rules to check this way */
+        for (p = literal; *p != '\0'; p++) {
+            if ((guchar) *p >= 0x80) {
+                g_free (literal);
+                return;
+            }
+        }
+    }
+
+    data->content_literal = literal;
+    data->content_literal_len = strlen (literal);
+
+    DEBUG ("Content prefilter literal is '%s'%s", literal,
+           data->content_literal_caseless ? " (ignoring case)" : "");
+}
+
 static SearchThreadData *
 search_thread_data_new (NemoSearchEngineAdvanced *engine,
 			NemoQuery *query)
@@ -415,7 +863,6 @@ search_thread_data_new (NemoSearchEngineAdvanced *engine,
 
     data->show_hidden = nemo_query_get_show_hidden (query);
 	data->engine = engine;
-	data->directories = g_queue_new ();
 	data->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	uri = nemo_query_get_location (query);
 	location = NULL;
@@ -427,7 +874,6 @@ search_thread_data_new (NemoSearchEngineAdvanced *engine,
 	if (location == NULL) {
 		location = g_file_new_for_path ("/");
 	}
-	g_queue_push_tail (data->directories, location);
 
     data->file_case_sensitive = nemo_query_get_file_case_sensitive (query);
     data->file_use_regex = nemo_query_get_use_file_regex (query);
@@ -461,7 +907,7 @@ search_thread_data_new (NemoSearchEngineAdvanced *engine,
          * the search text and wrap segments individually (*segment*) if no wildcard characters
          * already included, and generate a GPatternSpec for each segment. */
         words = g_strsplit_set (cased, " \t\r\n", -1);
-        data->filename_glob_patterns = NULL;
+        data->filename_matchers = NULL;
 
         for (gint i = 0; words[i] != NULL; i++) {
             if (words[i][0] != '\0') {
@@ -475,17 +921,17 @@ search_thread_data_new (NemoSearchEngineAdvanced *engine,
 
                 DEBUG ("pattern is '%s'", word_pattern);
 
-                data->filename_glob_patterns = g_list_prepend (data->filename_glob_patterns,
-                                                               g_pattern_spec_new (word_pattern));
+                data->filename_matchers = g_list_prepend (data->filename_matchers,
+                                                          filename_matcher_new (word_pattern));
             }
         }
 
         g_strfreev (words);
 
-        data->filename_glob_patterns = g_list_reverse (data->filename_glob_patterns);
+        data->filename_matchers = g_list_reverse (data->filename_matchers);
 
-        if (data->filename_glob_patterns == NULL) {
-            data->filename_glob_patterns = g_list_prepend (NULL, g_pattern_spec_new ("*"));
+        if (data->filename_matchers == NULL) {
+            data->filename_matchers = g_list_prepend (NULL, filename_matcher_new ("*"));
         }
 
         g_free (text);
@@ -507,6 +953,10 @@ search_thread_data_new (NemoSearchEngineAdvanced *engine,
     }
     g_strfreev (folders_array);
 
+    data->helper_cache_limit = nemo_search_helper_cache_get_limit ();
+    data->content_max_size = (goffset) MAX (g_settings_get_int (nemo_search_preferences,
+                                                                NEMO_PREFERENCES_SEARCH_CONTENT_MAX_SIZE), 0) * 1024 * 1024;
+
     data->count_hits = FALSE;
 
     gchar **saved_search_columns = g_settings_get_strv (nemo_search_preferences, NEMO_PREFERENCES_SEARCH_VISIBLE_COLUMNS);
@@ -522,10 +972,48 @@ search_thread_data_new (NemoSearchEngineAdvanced *engine,
     data->recurse = nemo_query_get_recurse (query);
     data->file_case_sensitive = nemo_query_get_file_case_sensitive (query);
 
+    if (nemo_query_has_candidates (query)) {
+        GList *uris, *l;
+
+        uris = nemo_query_get_candidates (query);
+        data->candidates = g_ptr_array_new_with_free_func (g_free);
+
+        for (l = uris; l != NULL; l = l->next) {
+            g_ptr_array_add (data->candidates, l->data);
+        }
+
+        g_list_free (uris);
+
+        DEBUG ("Refining %u earlier results", data->candidates->len);
+    }
+
+    /* A single directory gains nothing from more threads */
+    data->n_workers = data->recurse || data->candidates != NULL ?
+                      CLAMP (g_get_num_processors (), 2, MAX_SEARCH_WORKERS) : 1;
+    data->workers = g_new0 (SearchWorker, data->n_workers);
+
+    for (i = 0; i < data->n_workers; i++) {
+        data->workers[i].data = data;
+        data->workers[i].index = i;
+        g_mutex_init (&data->workers[i].lock);
+        g_queue_init (&data->workers[i].directories);
+        data->workers[i].name_buffer = g_string_sized_new (256);
+    }
+
+    g_mutex_init (&data->work_lock);
+    g_cond_init (&data->work_cond);
+    g_mutex_init (&data->visited_lock);
+
+    g_queue_push_tail (&data->workers[0].directories, location);
+    data->pending_directories = 1;
+
 	data->cancellable = g_cancellable_new ();
     data->timer = g_timer_new ();
 
     g_mutex_init (&data->hit_list_lock);
+    g_mutex_init (&data->stats_lock);
+    g_mutex_init (&data->helper_lock);
+    g_cond_init (&data->helper_cond);
 
     if (nemo_query_has_content_pattern (query)) {
         data->content_re = nemo_search_engine_advanced_create_content_regex (query, &error);
@@ -540,6 +1028,10 @@ search_thread_data_new (NemoSearchEngineAdvanced *engine,
             DEBUG ("regex is '%s'", g_regex_get_pattern (data->content_re));
         }
 
+        if (data->content_re != NULL) {
+            setup_content_literal (data, query);
+        }
+
         data->newline_re = g_regex_new ("[\\n\\r]{2,}",
                                            G_REGEX_OPTIMIZE,
                                            0,
@@ -560,9 +1052,22 @@ search_thread_data_new (NemoSearchEngineAdvanced *engine,
 static void
 search_thread_data_free (SearchThreadData *data)
 {
-	g_queue_foreach (data->directories,
-			 (GFunc)g_object_unref, NULL);
-	g_queue_free (data->directories);
+    gint i;
+
+    for (i = 0; i < data->n_workers; i++) {
+        g_queue_foreach (&data->workers[i].directories, (GFunc) g_object_unref, NULL);
+        g_queue_clear (&data->workers[i].directories);
+        g_mutex_clear (&data->workers[i].lock);
+        g_string_free (data->workers[i].name_buffer, TRUE);
+        g_free (data->workers[i].content_buffer);
+    }
+
+    g_free (data->workers);
+    g_clear_pointer (&data->candidates, g_ptr_array_unref);
+    g_mutex_clear (&data->work_lock);
+    g_cond_clear (&data->work_cond);
+    g_mutex_clear (&data->visited_lock);
+
 	g_hash_table_destroy (data->visited);
     g_hash_table_destroy (data->skip_folders);
 	g_object_unref (data->cancellable);
@@ -570,10 +1075,14 @@ search_thread_data_free (SearchThreadData *data)
 	g_list_free_full (data->hit_list, (GDestroyNotify) file_search_result_free);
     g_clear_pointer (&data->content_re, g_regex_unref);
     g_clear_pointer (&data->newline_re, g_regex_unref);
+    g_free (data->content_literal);
     g_clear_pointer (&data->filename_re, g_regex_unref);
-    g_list_free_full (data->filename_glob_patterns, (GDestroyNotify) g_pattern_spec_free);
+    g_list_free_full (data->filename_matchers, (GDestroyNotify) filename_matcher_free);
     g_timer_destroy (data->timer);
     g_mutex_clear (&data->hit_list_lock);
+    g_mutex_clear (&data->stats_lock);
+    g_mutex_clear (&data->helper_lock);
+    g_cond_clear (&data->helper_cond);
 
     g_free (data);
 }
@@ -591,6 +1100,13 @@ search_thread_done_idle (gpointer user_data)
 	}
 
     DEBUG ("Search took: %f seconds", g_timer_elapsed (data->timer, NULL));
+
+    if (data->content_re != NULL) {
+        DEBUG ("Content search read %" G_GUINT64_FORMAT " bytes from %u files (%u helpers run, %u stored outputs), "
+               "skipped %u binary and %u over the size limit",
+               data->stats_bytes_read, data->stats_files_read, data->stats_helper_runs, data->stats_helper_stored,
+               data->stats_skipped_binary, data->stats_skipped_size);
+    }
 	search_thread_data_free (data);
 
 	return FALSE;
@@ -629,7 +1145,7 @@ send_batch (SearchThreadData *data)
 	SearchHits *hits;
 
     g_mutex_lock (&data->hit_list_lock);
-	data->n_processed_files = 0;
+	g_atomic_int_set (&data->n_processed_files, 0);
 
 	if (data->hit_list) {
 		hits = g_new0 (SearchHits, 1);
@@ -651,7 +1167,76 @@ send_batch (SearchThreadData *data)
 
 #define CONTENT_SEARCH_ATTRIBUTES \
     G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE "," \
-    G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE
+    G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE "," \
+    G_FILE_ATTRIBUTE_TIME_MODIFIED
+
+/* Runs in the helper's process between fork and exec */
+static void
+limit_helper_memory (gpointer user_data)
+{
+    struct rlimit limit = { HELPER_MEMORY_LIMIT, HELPER_MEMORY_LIMIT };
+
+    setrlimit (RLIMIT_AS, &limit);
+}
+
+static gboolean
+helper_timed_out (gpointer user_data)
+{
+    GSubprocess *helper_proc = G_SUBPROCESS (user_data);
+
+    g_warning ("Search helper '%s' took longer than %d seconds, stopping it",
+               g_subprocess_get_identifier (helper_proc), HELPER_TIMEOUT);
+    g_subprocess_force_exit (helper_proc);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+extraction_timed_out (gpointer user_data)
+{
+    GCancellable *cancellable = G_CANCELLABLE (user_data);
+
+    g_warning ("Reading a document's text took longer than %d seconds, stopping", HELPER_TIMEOUT);
+    g_cancellable_cancel (cancellable);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Gives up on a document converted in process if it runs past
+ * HELPER_TIMEOUT, by cancelling @cancellable.  The returned source is
+ * destroyed once it's done. */
+static GSource *
+watch_extraction (GCancellable *cancellable)
+{
+    GSource *source;
+
+    source = g_timeout_source_new_seconds (HELPER_TIMEOUT);
+    g_source_set_callback (source, extraction_timed_out, g_object_ref (cancellable), g_object_unref);
+    g_source_attach (source, NULL);
+
+    return source;
+}
+
+static void
+forward_cancel (GCancellable *cancellable,
+                gpointer      user_data)
+{
+    g_cancellable_cancel (G_CANCELLABLE (user_data));
+}
+
+/* Kills the helper if it runs past HELPER_TIMEOUT, which ends its output
+ * like any other exit.  The returned source is destroyed once it's done. */
+static GSource *
+watch_helper (GSubprocess *helper_proc)
+{
+    GSource *source;
+
+    source = g_timeout_source_new_seconds (HELPER_TIMEOUT);
+    g_source_set_callback (source, helper_timed_out, g_object_ref (helper_proc), g_object_unref);
+    g_source_attach (source, NULL);
+
+    return source;
+}
 
 static GInputStream *
 get_stream_from_helper (SearchHelper *helper,
@@ -660,6 +1245,7 @@ get_stream_from_helper (SearchHelper *helper,
                         GError      **error)
 {
     GSubprocess *helper_proc;
+    GSubprocessLauncher *launcher;
     GSubprocessFlags flags;
     GInputStream *stream;
     GString *command_line;
@@ -699,7 +1285,11 @@ get_stream_from_helper (SearchHelper *helper,
         flags |= G_SUBPROCESS_FLAGS_STDERR_SILENCE;
     }
 
-    helper_proc = g_subprocess_newv ((const gchar * const *) argv, flags, error);
+    launcher = g_subprocess_launcher_new (flags);
+    g_subprocess_launcher_set_child_setup (launcher, limit_helper_memory, NULL, NULL);
+
+    helper_proc = g_subprocess_launcher_spawnv (launcher, (const gchar * const *) argv, error);
+    g_object_unref (launcher);
 
     stream = NULL;
 
@@ -766,115 +1356,75 @@ create_snippet (GMatchInfo  *match_info,
     return snippet;
 }
 
-static gchar *
-load_contents (SearchThreadData *data,
-               GFile            *file,
-               SearchHelper     *helper,
-               GError          **error)
+static void
+add_hit (SearchThreadData *data,
+         FileSearchResult *fsr,
+         GFile            *file)
 {
-    // TODO: Use flock/mmap for local files?
-    GSubprocess *helper_proc;
-    GInputStream *stream = NULL;
-    GString *str;
-
-    helper_proc = NULL;
-
-    if (helper != NULL) {
-        stream = get_stream_from_helper (helper, file, &helper_proc, error);
-    } else {
-        // text/plain
-        stream = G_INPUT_STREAM (g_file_read (file, data->cancellable, error));
-    }
-
-    if (stream == NULL) {
-        return NULL;
-    }
-
-    str = g_string_new (NULL);
-    gssize len = 0;
-
-    do {
-        gchar chunk[4096];
-        len = g_input_stream_read (stream, chunk, 4096, data->cancellable, error);
-
-        if (len <= 0) {
-            break;
-        }
-
-        g_string_append_len (str, chunk, len);
-    } while (!g_cancellable_is_cancelled (data->cancellable));
-
-    g_input_stream_close (stream,
-                          data->cancellable,
-                          *error == NULL ? error : NULL);
-
-    // GSubprocess owns the input stream for its STDOUT, but we own it for the text/plain stream.
-    if (helper_proc != NULL) {
-        g_subprocess_wait (helper_proc,
-                           NULL,
-                           *error == NULL ? error : NULL);
-        g_object_unref (helper_proc);
-    } else {
-        g_object_unref (stream);
-    }
+    /* Everything NemoFile wants, queried here on the worker rather than
+     * one file at a time from the main loop once the hit is shown */
+    fsr->info = g_file_query_info (file, NEMO_FILE_DEFAULT_ATTRIBUTES, 0, data->cancellable, NULL);
 
-    return g_string_free (str, FALSE);
+    g_mutex_lock (&data->hit_list_lock);
+    data->hit_list = g_list_prepend (data->hit_list, fsr);
+    g_mutex_unlock (&data->hit_list_lock);
 }
 
+typedef struct {
+    SearchThreadData *data;
+    gchar **buffer; /* CONTENT_WINDOW_SIZE, allocated on first use */
+    GFile *file;
+    FileSearchResult *fsr;
+    gboolean done;
+    /* Set for plain text files, whose first window is checked for binary */
+    gboolean sniff;
+    gboolean binary;
+    guint64 bytes_read;
+    GCancellable *cancellable; /* data's, or one with a deadline */
+} ContentScan;
+
+/* Runs the content regex over len bytes of text, which needn't be valid
+ * UTF-8 or nul terminated. */
 static void
-search_for_content_hits (SearchThreadData *data,
-                         GFile            *file,
-                         SearchHelper     *helper)
+scan_region (ContentScan *scan,
+             const gchar *text,
+             gsize        len)
 {
+    SearchThreadData *data = scan->data;
     GMatchInfo *match_info;
-    GError *error;
-    gchar *contents = NULL;
-    gchar *stripped, *utf8;
-
-    error = NULL;
-
-    contents = load_contents (data, file, helper, &error);
-
-    if (g_cancellable_is_cancelled (data->cancellable)) {
-        g_clear_error (&error);
-        g_free (contents);
-        return;
-    }
+    GError *error = NULL;
+    gchar *valid = NULL;
 
-    if (error != NULL) {
-        gchar *uri = g_file_get_uri (file);
-        g_warning ("Could not load contents of '%s' during content search: %s", uri, error->message);
-        g_free (uri);
-        g_error_free (error);
-        g_free (contents);
-        return;
+    if (!g_utf8_validate (text, len, NULL)) {
+        valid = g_utf8_make_valid (text, len);
+        text = valid;
+        len = strlen (valid);
     }
 
-    utf8 = g_utf8_make_valid (contents, -1);
-    g_free (contents);
+    g_regex_match_full (data->content_re, text, len, 0, 0, &match_info, NULL);
 
-    if (data->newline_re != NULL) {
-        stripped = g_regex_replace_literal (data->newline_re, (const gchar *) utf8, -1, 0, "\n", 0, NULL);
-    } else {
-        stripped = g_strdup ((const gchar *) utf8);
-    }
-
-    g_free (utf8);
+    while (g_match_info_matches (match_info) && !g_cancellable_is_cancelled (data->cancellable)) {
+        if (scan->fsr == NULL) {
+            gchar *snippet = create_snippet (match_info, text, g_utf8_strlen (text, len));
 
-    FileSearchResult *fsr = NULL;
+            if (snippet != NULL && data->newline_re != NULL) {
+                gchar *stripped = g_regex_replace_literal (data->newline_re, snippet, -1, 0, "\n", 0, NULL);
 
-    g_regex_match (data->content_re, stripped, 0, &match_info);
+                if (stripped != NULL) {
+                    g_free (snippet);
+                    snippet = stripped;
+                }
+            }
 
-    while (g_match_info_matches (match_info) && !g_cancellable_is_cancelled (data->cancellable)) {
-        if (fsr == NULL) {
-            fsr = file_search_result_new (g_file_get_uri (file), create_snippet (match_info, stripped, g_utf8_strlen (stripped, -1)));
+            scan->fsr = file_search_result_new (g_file_get_uri (scan->file), snippet);
         }
 
         if (!data->count_hits) {
+            scan->done = TRUE;
             break;
         }
 
-        file_search_result_add_hit (fsr);
+        file_search_result_add_hit (scan->fsr);
 
         if (!g_match_info_next (match_info, &error) && error) {
             g_warning ("Error iterating thru pattern matches (/%s/): code %d - %s",
@@ -885,18 +1435,420 @@ search_for_content_hits (SearchThreadData *data,
     }
 
     g_match_info_unref (match_info);
-    g_free (stripped);
-
-    if (fsr != NULL) {
-        g_mutex_lock (&data->hit_list_lock);
-        data->hit_list = g_list_prepend (data->hit_list, fsr);
-        g_mutex_unlock (&data->hit_list_lock);
-    }
+    g_free (valid);
 }
 
-static gboolean
-hash_func_check_skip_file (gpointer key,
-                           gpointer value,
+static const gchar *
+find_content_literal (SearchThreadData *data,
+                      const gchar      *start,
+                      const gchar      *end)
+{
+    const gchar *literal = data->content_literal;
+    gsize literal_len = data->content_literal_len;
+    const gchar *p = start, *lower = NULL, *upper = NULL;
+    gchar first_lower, first_upper;
+
+    first_lower = data->content_literal_caseless ? g_ascii_tolower (literal[0]) : literal[0];
+    first_upper = data->content_literal_caseless ? g_ascii_toupper (literal[0]) : literal[0];
+
+    while ((gsize) (end - p) >= literal_len) {
+        const gchar *candidate;
+
+        /* memchr is vectorized, so hunt for the first byte with it, in
+         * either case if need be, remembering how far each search got */
+        if (lower == NULL || lower < p) {
+            lower = memchr (p, first_lower, end - p);
+            if (lower == NULL) {
+                lower = end;
+            }
+        }
+
+        if (first_upper == first_lower) {
+            upper = lower;
+        } else if (upper == NULL || upper < p) {
+            upper = memchr (p, first_upper, end - p);
+            if (upper == NULL) {
+                upper = end;
+            }
+        }
+
+        candidate = MIN (lower, upper);
+
+        if ((gsize) (end - candidate) < literal_len) {
+            return NULL;
+        }
+
+        if (data->content_literal_caseless ? g_ascii_strncasecmp (candidate, literal, literal_len) == 0 :
+                                             memcmp (candidate, literal, literal_len) == 0) {
+            return candidate;
+        }
+
+        p = candidate + 1;
+    }
+
+    return NULL;
+}
+
+/* The literal only says whether the window is worth matching at all - a
+ * match of the whole pattern can run across lines, so when it's there the
+ * regex still gets the whole window. */
+static void
+scan_window (ContentScan *scan,
+             const gchar *window,
+             gsize        len)
+{
+    SearchThreadData *data = scan->data;
+
+    if (data->content_literal != NULL && find_content_literal (data, window, window + len) == NULL) {
+        return;
+    }
+
+    scan_region (scan, window, len);
+}
+
+/* Whether the start of a supposedly plain text file is really binary.  A
+ * partial character at the end of the text counts as invalid, but isn't
+ * enough to tip the ratio. */
+static gboolean
+looks_binary (SearchThreadData *data,
+              const gchar      *text,
+              gsize             len)
+{
+    const gchar *p = text, *end;
+    gsize invalid = 0;
+
+    end = text + len;
+
+    if (memchr (text, '\0', len) != NULL) {
+        return TRUE;
+    }
+
+    /* Raw patterns are for text that isn't UTF-8 to begin with */
+    if (g_regex_get_compile_flags (data->content_re) & G_REGEX_RAW) {
+        return FALSE;
+    }
+
+    while (p < end && !g_utf8_validate (p, end - p, &p)) {
+        invalid++;
+        p++;
+    }
+
+    return invalid * BINARY_INVALID_RATIO > len;
+}
+
+/* Reads the stream a window at a time, never holding more than that.  If
+ * there's a @tee, everything read is copied to it, and the stream is read to
+ * the end even once the scan is done.  Returns whether @tee got all of it. */
+static gboolean
+scan_stream (ContentScan    *scan,
+             GInputStream   *stream,
+             GOutputStream  *tee,
+             GError        **error)
+{
+    SearchThreadData *data = scan->data;
+    gchar *buffer;
+    gsize filled = 0;
+    gboolean eof = FALSE;
+
+    if (*scan->buffer == NULL) {
+        *scan->buffer = g_malloc (CONTENT_WINDOW_SIZE);
+    }
+
+    buffer = *scan->buffer;
+
+    while (!eof && (!scan->done || tee != NULL) && !g_cancellable_is_cancelled (scan->cancellable)) {
+        gsize n_read = 0, wanted, cut;
+
+        /* The block that's sniffed is read by itself, so a binary file
+         * costs no more than that */
+        wanted = CONTENT_WINDOW_SIZE - filled;
+
+        if (scan->sniff && scan->bytes_read == 0) {
+            wanted = MIN (wanted, BINARY_SNIFF_SIZE);
+        }
+
+        if (!g_input_stream_read_all (stream, buffer + filled, wanted,
+                                      &n_read, scan->cancellable, error)) {
+            break;
+        }
+
+        if (tee != NULL && !g_output_stream_write_all (tee, buffer + filled, n_read, NULL, NULL, NULL)) {
+            tee = NULL;
+        }
+
+        if (scan->sniff && scan->bytes_read == 0 && looks_binary (data, buffer, n_read)) {
+            scan->binary = TRUE;
+            scan->done = TRUE;
+        }
+
+        scan->bytes_read += n_read;
+        filled += n_read;
+        eof = n_read < wanted;
+
+        if (scan->done) {
+            filled = 0;
+            continue;
+        }
+
+        if (!eof && filled < CONTENT_WINDOW_SIZE) {
+            continue;
+        }
+
+        if (eof) {
+            cut = filled;
+        } else {
+            /* Keep the unfinished line for the next window, unless it's
+             * the whole window, in which case it's split on a character. */
+            for (cut = filled; cut > 0 && buffer[cut - 1] != '\n'; cut--);
+
+            if (cut == 0) {
+                const gchar *last = g_utf8_find_prev_char (buffer, buffer + filled);
+
+                cut = last != NULL && last > buffer ? (gsize) (last - buffer) : filled;
+            }
+        }
+
+        scan_window (scan, buffer, cut);
+
+        memmove (buffer, buffer + cut, filled - cut);
+        filled -= cut;
+    }
+
+    return eof && tee != NULL;
+}
+
+/* buffer is the caller's CONTENT_WINDOW_SIZE scratch space, allocated
+ * here if it's still NULL */
+static void
+search_for_content_hits (SearchThreadData  *data,
+                         gchar            **buffer,
+                         GFile             *file,
+                         GFileInfo         *info,
+                         SearchHelper      *helper)
+{
+    GSubprocess *helper_proc = NULL;
+    GSource *watchdog = NULL;
+    NemoSearchHelperCacheWriter *cache_writer = NULL;
+    GInputStream *stream = NULL;
+    GError *error = NULL;
+    ContentScan scan = { data, buffer, file, NULL, FALSE, helper == NULL, FALSE, 0, data->cancellable };
+    GCancellable *deadline = NULL;
+    gulong deadline_handler = 0;
+    gchar *cache_key = NULL;
+    gboolean helper_ran = FALSE, helper_stored = FALSE;
+
+    if (helper != NULL && helper->in_process) {
+        /* Held to the same time limit as a helper, and still stopped along
+         * with the search */
+        deadline = g_cancellable_new ();
+        deadline_handler = g_cancellable_connect (data->cancellable, G_CALLBACK (forward_cancel),
+                                                  g_object_ref (deadline), g_object_unref);
+        watchdog = watch_extraction (deadline);
+        scan.cancellable = deadline;
+
+        stream = nemo_document_text_stream_new (file, helper->format, deadline, &error);
+    } else if (helper != NULL) {
+        if (data->helper_cache_limit > 0) {
+            cache_key = nemo_search_helper_cache_make_key (g_file_peek_path (file),
+                                                           g_file_info_get_size (info),
+                                                           g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+                                                           helper->exec_format);
+            stream = nemo_search_helper_cache_lookup (cache_key);
+            helper_stored = stream != NULL;
+        }
+
+        if (stream == NULL) {
+            stream = get_stream_from_helper (helper, file, &helper_proc, &error);
+
+            if (stream != NULL) {
+                helper_ran = TRUE;
+                watchdog = watch_helper (helper_proc);
+
+                if (cache_key != NULL) {
+                    cache_writer = nemo_search_helper_cache_store (cache_key);
+                }
+            }
+        }
+    } else {
+        // text/plain
+        if (data->content_max_size > 0 && g_file_info_get_size (info) > data->content_max_size) {
+            DEBUG ("Not reading '%s', it's over the content search size limit", g_file_peek_path (file));
+
+            g_mutex_lock (&data->stats_lock);
+            data->stats_skipped_size++;
+            g_mutex_unlock (&data->stats_lock);
+            return;
+        }
+
+        stream = G_INPUT_STREAM (g_file_read (file, data->cancellable, &error));
+    }
+
+    if (stream != NULL) {
+        gboolean complete;
+
+        complete = scan_stream (&scan, stream,
+                                cache_writer ? nemo_search_helper_cache_writer_get_stream (cache_writer) : NULL,
+                                &error);
+
+        g_input_stream_close (stream, NULL, NULL);
+
+        // GSubprocess owns the input stream for its STDOUT, but we own it for the others.
+        if (helper_proc != NULL) {
+            /* No need for the rest of its output, unless it's being stored */
+            if (!complete && (scan.done || error != NULL || g_cancellable_is_cancelled (data->cancellable))) {
+                g_subprocess_force_exit (helper_proc);
+            }
+
+            /* Only output from a helper that finished cleanly is kept */
+            if (!g_subprocess_wait (helper_proc, NULL, NULL) || !g_subprocess_get_successful (helper_proc)) {
+                complete = FALSE;
+            }
+
+            g_object_unref (helper_proc);
+        } else {
+            g_object_unref (stream);
+        }
+
+        if (cache_writer != NULL) {
+            nemo_search_helper_cache_writer_finish (cache_writer, complete && error == NULL,
+                                                    data->helper_cache_limit);
+        }
+    }
+
+    g_free (cache_key);
+
+    if (watchdog != NULL) {
+        g_source_destroy (watchdog);
+        g_source_unref (watchdog);
+    }
+
+    if (deadline != NULL) {
+        g_cancellable_disconnect (data->cancellable, deadline_handler);
+
+        /* Already warned about, and no different from not matching */
+        if (g_cancellable_is_cancelled (deadline) && !g_cancellable_is_cancelled (data->cancellable)) {
+            g_clear_error (&error);
+        }
+
+        g_object_unref (deadline);
+    }
+
+    g_mutex_lock (&data->stats_lock);
+    data->stats_bytes_read += scan.bytes_read;
+
+    if (scan.binary) {
+        data->stats_skipped_binary++;
+    } else if (stream != NULL) {
+        data->stats_files_read++;
+    }
+
+    if (helper_ran) {
+        data->stats_helper_runs++;
+    } else if (helper_stored) {
+        data->stats_helper_stored++;
+    }
+
+    g_mutex_unlock (&data->stats_lock);
+
+    if (scan.binary) {
+        DEBUG ("Skipped '%s', it looks like a binary file", g_file_peek_path (file));
+    }
+
+    if (g_cancellable_is_cancelled (data->cancellable)) {
+        g_clear_error (&error);
+        g_clear_pointer (&scan.fsr, file_search_result_free);
+        return;
+    }
+
+    if (error != NULL) {
+        gchar *uri = g_file_get_uri (file);
+        g_warning ("Could not load contents of '%s' during content search: %s", uri, error->message);
+        g_free (uri);
+        g_error_free (error);
+        g_clear_pointer (&scan.fsr, file_search_result_free);
+        return;
+    }
+
+    if (scan.fsr != NULL) {
+        add_hit (data, scan.fsr, file);
+    }
+}
+
+typedef struct {
+    GFile *file;
+    GFileInfo *info;
+    SearchHelper *helper;
+} HelperJob;
+
+/* Helper pool threads outlive any one search, so they keep their buffer
+ * here rather than in the SearchThreadData */
+static GPrivate helper_thread_buffer = G_PRIVATE_INIT (g_free);
+
+static void
+helper_job_func (gpointer job_data,
+                 gpointer user_data)
+{
+    HelperJob *job = job_data;
+    SearchThreadData *data = user_data;
+
+    if (!g_cancellable_is_cancelled (data->cancellable)) {
+        gchar *buffer = g_private_get (&helper_thread_buffer);
+
+        search_for_content_hits (data, &buffer, job->file, job->info, job->helper);
+
+        g_private_set (&helper_thread_buffer, buffer);
+    }
+
+    g_object_unref (job->file);
+    g_object_unref (job->info);
+    g_free (job);
+
+    g_mutex_lock (&data->helper_lock);
+    data->helper_queued--;
+    g_cond_signal (&data->helper_cond);
+    g_mutex_unlock (&data->helper_lock);
+}
+
+/* Hands a file to the helper pool, so traversal can carry on while it's
+ * converted.  If the pool is far enough behind, this waits for it to catch
+ * up, so no more conversions run at once than the pool has threads. */
+static void
+queue_helper_job (SearchWorker *worker,
+                  GFile        *file,
+                  GFileInfo    *info,
+                  SearchHelper *helper)
+{
+    SearchThreadData *data = worker->data;
+    HelperJob *job;
+
+    if (data->helper_pool == NULL) {
+        search_for_content_hits (data, &worker->content_buffer, file, info, helper);
+        return;
+    }
+
+    g_mutex_lock (&data->helper_lock);
+
+    while (data->helper_queued >= data->helper_backlog_limit &&
+           !g_cancellable_is_cancelled (data->cancellable)) {
+        g_cond_wait_until (&data->helper_cond, &data->helper_lock,
+                           g_get_monotonic_time () + WORKER_IDLE_TIMEOUT);
+    }
+
+    data->helper_queued++;
+
+    g_mutex_unlock (&data->helper_lock);
+
+    job = g_new0 (HelperJob, 1);
+    job->file = g_object_ref (file);
+    job->info = g_object_ref (info);
+    job->helper = helper;
+
+    g_thread_pool_push (data->helper_pool, job, NULL);
+}
+
+static gboolean
+hash_func_check_skip_file (gpointer key,
+                           gpointer value,
                            gpointer user_data)
 {
     const gchar *entry = key;
@@ -989,14 +1941,189 @@ lookup_helpers_for_content_type (const gchar *content_type)
     return find_data.helpers;
 }
 
+/* Takes ownership of dir */
+static void
+queue_directory (SearchWorker *worker,
+                 GFile        *dir)
+{
+    SearchThreadData *data = worker->data;
+
+    g_mutex_lock (&worker->lock);
+    g_queue_push_tail (&worker->directories, dir);
+    g_mutex_unlock (&worker->lock);
+
+    /* Counting it only now is fine - the directory being visited
+     * keeps pending_directories above zero until we return. */
+    g_mutex_lock (&data->work_lock);
+    data->pending_directories++;
+    data->work_generation++;
+    g_cond_signal (&data->work_cond);
+    g_mutex_unlock (&data->work_lock);
+}
+
 static void
-visit_directory (GFile *dir, SearchThreadData *data)
+directory_done (SearchThreadData *data)
+{
+    g_mutex_lock (&data->work_lock);
+
+    data->work_generation++;
+
+    if (--data->pending_directories == 0) {
+        g_cond_broadcast (&data->work_cond);
+    }
+
+    g_mutex_unlock (&data->work_lock);
+}
+
+static GFile *
+steal_directory (SearchWorker *worker)
+{
+    SearchThreadData *data = worker->data;
+    GFile *dir = NULL;
+    gint i;
+
+    /* Our own queue first, in case something arrived since we last looked */
+    for (i = 0; i < data->n_workers && dir == NULL; i++) {
+        SearchWorker *victim = &data->workers[(worker->index + i) % data->n_workers];
+
+        g_mutex_lock (&victim->lock);
+        dir = g_queue_pop_head (&victim->directories);
+        g_mutex_unlock (&victim->lock);
+    }
+
+    return dir;
+}
+
+static GFile *
+worker_next_directory (SearchWorker *worker)
 {
+    SearchThreadData *data = worker->data;
+    GFile *dir;
+
+    /* Depth first from our own queue keeps a worker in one part of the
+     * tree, while thieves take the oldest - usually biggest - subtrees. */
+    g_mutex_lock (&worker->lock);
+    dir = g_queue_pop_tail (&worker->directories);
+    g_mutex_unlock (&worker->lock);
+
+    while (dir == NULL && !g_cancellable_is_cancelled (data->cancellable)) {
+        guint generation;
+        gboolean finished;
+
+        g_mutex_lock (&data->work_lock);
+        generation = data->work_generation;
+        finished = data->pending_directories == 0;
+        g_mutex_unlock (&data->work_lock);
+
+        if (finished) {
+            break;
+        }
+
+        dir = steal_directory (worker);
+
+        if (dir == NULL) {
+            g_mutex_lock (&data->work_lock);
+
+            if (data->work_generation == generation) {
+                g_cond_wait_until (&data->work_cond, &data->work_lock,
+                                   g_get_monotonic_time () + WORKER_IDLE_TIMEOUT);
+            }
+
+            g_mutex_unlock (&data->work_lock);
+        }
+    }
+
+    return dir;
+}
+
+static void
+count_processed_file (SearchThreadData *data)
+{
+    if (g_atomic_int_add (&data->n_processed_files, 1) >= (data->content_re ? CONTENT_SEARCH_BATCH_SIZE :
+                                                                              FILE_SEARCH_ONLY_BATCH_SIZE)) {
+        send_batch (data);
+    }
+}
+
+/* Checks the name of a file against the filename part of the query */
+static gboolean
+name_matches (SearchWorker *worker,
+              const gchar  *display_name)
+{
+    SearchThreadData *data = worker->data;
+    const gchar *name;
+    gsize name_len;
+
+    if (data->file_use_regex) {
+        name = prepare_name_for_match (worker->name_buffer, display_name, FALSE, &name_len);
+        return g_regex_match (data->filename_re, name, 0, NULL);
+    }
+
+    name = prepare_name_for_match (worker->name_buffer, display_name,
+                                   !data->file_case_sensitive, &name_len);
+
+    for (GList *l = data->filename_matchers; l != NULL; l = l->next) {
+        if (!filename_matcher_match (l->data, name, name_len)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* A file whose name matched - a hit, unless there's content to check */
+static void
+evaluate_hit (SearchWorker *worker,
+              GFile        *child,
+              GFileInfo    *info,
+              gboolean      skip_child)
+{
+    SearchThreadData *data = worker->data;
+    const gchar *content_type;
+
+    content_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
+
+    if (content_type == NULL) {
+        content_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+    }
+
+    if (data->content_re && data->location_supports_content_search) {
+        if (!skip_child) {
+            if (DEBUGGING) {
+                g_message ("Evaluating '%s'", g_file_peek_path (child));
+            }
+
+            if (g_content_type_is_a (content_type, "text/plain")) {
+                search_for_content_hits (data, &worker->content_buffer, child, info, NULL);
+            } else {
+                GList *helpers = lookup_helpers_for_content_type (content_type);
+                if (helpers != NULL) {
+                    GList *i;
+
+                    for (i = helpers; i != NULL; i = i->next) {
+                        queue_helper_job (worker, child, info, i->data);
+                    }
+
+                    g_list_free (helpers);
+                }
+            }
+        }
+    } else {
+        FileSearchResult *fsr = NULL;
+
+        fsr = file_search_result_new (g_file_get_uri (child), NULL);
+        add_hit (data, fsr, child);
+    }
+}
+
+static void
+visit_directory (GFile *dir, SearchWorker *worker)
+{
+    SearchThreadData *data = worker->data;
 	GFileEnumerator *enumerator;
 	GFileInfo *info;
     GFile *child;
 	const char *display_name;
-	char *normalized;
 	gboolean hit, is_dir, skip_child;
 
     const gchar *attrs;
@@ -1024,38 +2151,7 @@ visit_directory (GFile *dir, SearchThreadData *data)
 			goto next;
 		}
 
-		normalized = g_utf8_normalize (display_name, -1, G_NORMALIZE_NFD);
-
-        if (data->file_use_regex) {
-            GMatchInfo *match_info;
-            hit = g_regex_match (data->filename_re, normalized, 0, &match_info);
-            g_match_info_unref (match_info);
-        } else {
-            gchar *cased;
-
-            if (!data->file_case_sensitive) {
-                cased = g_utf8_strdown (normalized, -1);
-            } else {
-                cased = g_strdup (normalized);
-            }
-
-            gchar *cased_reversed = g_utf8_strreverse (cased, -1);
-            gsize len = strlen (cased);
-
-            hit = TRUE;
-            for (GList *l = data->filename_glob_patterns; l != NULL; l = l->next) {
-                GPatternSpec *pattern = l->data;
-                if (!g_pattern_spec_match (pattern, len, cased, cased_reversed)) {
-                    hit = FALSE;
-                    break;
-                }
-            }
-
-            g_free (cased);
-            g_free (cased_reversed);
-        }
-
-        g_free (normalized);
+        hit = name_matches (worker, display_name);
 
         child = g_file_get_child (dir, g_file_info_get_name (info));
         is_dir = g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY;
@@ -1090,52 +2186,10 @@ visit_directory (GFile *dir, SearchThreadData *data)
         skip_child = should_skip_child (data, info, child, is_dir);
 
         if (hit) {
-            const gchar *content_type;
-
-            content_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
-
-            if (content_type == NULL) {
-                content_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
-            }
-
-            if (data->content_re && data->location_supports_content_search) {
-                if (!skip_child) {
-                    if (DEBUGGING) {
-                        g_message ("Evaluating '%s'", g_file_peek_path (child));
-                    }
-
-                    if (g_content_type_is_a (content_type, "text/plain")) {
-                        search_for_content_hits (data, child, NULL);
-                    } else {
-                        GList *helpers = lookup_helpers_for_content_type (content_type);
-                        if (helpers != NULL) {
-                            GList *i;
-
-                            for (i = helpers; i != NULL; i = i->next) {
-                                SearchHelper *helper = i->data;
-                                search_for_content_hits (data, child, helper);
-                            }
-
-                            g_list_free (helpers);
-                        }
-                    }
-                }
-            } else {
-                FileSearchResult *fsr = NULL;
-
-                fsr = file_search_result_new (g_file_get_uri (child), NULL);
-                g_mutex_lock (&data->hit_list_lock);
-                data->hit_list = g_list_prepend (data->hit_list, fsr);
-                g_mutex_unlock (&data->hit_list_lock);
-            }
+            evaluate_hit (worker, child, info, skip_child);
         }
 
-		data->n_processed_files++;
-
-        if (data->n_processed_files > (data->content_re ? CONTENT_SEARCH_BATCH_SIZE :
-                                                        FILE_SEARCH_ONLY_BATCH_SIZE)) {
-            send_batch (data);
-        }
+        count_processed_file (data);
 
 		if (is_dir && data->recurse && !skip_child) {
             gboolean visited;
@@ -1144,16 +2198,18 @@ visit_directory (GFile *dir, SearchThreadData *data)
 			id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
 			visited = FALSE;
 			if (id) {
+				g_mutex_lock (&data->visited_lock);
 				if (g_hash_table_lookup_extended (data->visited,
 								  id, NULL, NULL)) {
 					visited = TRUE;
 				} else {
 					g_hash_table_insert (data->visited, g_strdup (id), NULL);
 				}
+				g_mutex_unlock (&data->visited_lock);
 			}
 
 			if (!visited) {
-				g_queue_push_tail (data->directories, g_object_ref (child));
+				queue_directory (worker, g_object_ref (child));
 			}
 		}
 
@@ -1166,6 +2222,72 @@ visit_directory (GFile *dir, SearchThreadData *data)
 }
 
 
+/* Re-checks an earlier result, without touching the disk unless its
+ * name still matches */
+static void
+visit_candidate (SearchWorker *worker,
+                 const gchar  *uri)
+{
+    SearchThreadData *data = worker->data;
+    GFile *file;
+    GFileInfo *info;
+    gchar *basename, *display_name;
+
+    file = g_file_new_for_uri (uri);
+    basename = g_file_get_basename (file);
+    display_name = g_filename_display_name (basename);
+
+    if (name_matches (worker, display_name)) {
+        info = g_file_query_info (file,
+                                  data->content_re ? STD_ATTRIBUTES "," CONTENT_SEARCH_ATTRIBUTES : STD_ATTRIBUTES,
+                                  0, data->cancellable, NULL);
+
+        if (info != NULL) {
+            if (data->show_hidden || !g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN)) {
+                gboolean is_dir = g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY;
+
+                evaluate_hit (worker, file, info, should_skip_child (data, info, file, is_dir));
+            }
+
+            g_object_unref (info);
+        }
+    }
+
+    count_processed_file (data);
+
+    g_free (display_name);
+    g_free (basename);
+    g_object_unref (file);
+}
+
+static gpointer
+search_worker_func (gpointer user_data)
+{
+    SearchWorker *worker = user_data;
+    SearchThreadData *data = worker->data;
+    GFile *dir;
+
+    if (data->candidates != NULL) {
+        gint i;
+
+        while ((i = g_atomic_int_add (&data->next_candidate, 1)) < (gint) data->candidates->len &&
+               !g_cancellable_is_cancelled (data->cancellable)) {
+            visit_candidate (worker, g_ptr_array_index (data->candidates, i));
+        }
+
+        return NULL;
+    }
+
+    while ((dir = worker_next_directory (worker)) != NULL) {
+        visit_directory (dir, worker);
+        g_object_unref (dir);
+
+        directory_done (worker->data);
+    }
+
+    return NULL;
+}
+
 static gpointer
 search_thread_func (gpointer user_data)
 {
@@ -1173,10 +2295,11 @@ search_thread_func (gpointer user_data)
 	GFile *dir;
 	GFileInfo *info;
 	const char *id;
+	gint i;
 	data = user_data;
 
 	/* Insert id for toplevel directory into visited */
-	dir = g_queue_peek_head (data->directories);
+	dir = g_queue_peek_head (&data->workers[0].directories);
 	info = g_file_query_info (dir, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable, NULL);
 	if (info) {
 		id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
@@ -1186,12 +2309,33 @@ search_thread_func (gpointer user_data)
 		g_object_unref (info);
 	}
 
-    while (!g_cancellable_is_cancelled (data->cancellable) &&
-           (dir = g_queue_pop_head (data->directories)) != NULL) {
+    DEBUG ("Searching with %d workers", data->n_workers);
+
+    if (data->content_re != NULL && data->location_supports_content_search) {
+        gint n_threads = g_get_num_processors ();
+
+        data->helper_pool = g_thread_pool_new (helper_job_func, data, n_threads, FALSE, NULL);
+        /* The ones running, and the ones waiting */
+        data->helper_backlog_limit = n_threads * (HELPER_BACKLOG_PER_THREAD + 1);
+    }
+
+    for (i = 1; i < data->n_workers; i++) {
+        data->workers[i].thread = g_thread_new ("nemo-search-worker", search_worker_func, &data->workers[i]);
+    }
+
+    search_worker_func (&data->workers[0]);
+
+    for (i = 1; i < data->n_workers; i++) {
+        g_thread_join (data->workers[i].thread);
+    }
+
+    /* Waits for the queued helper jobs - they return right away if the
+     * search was cancelled */
+    if (data->helper_pool != NULL) {
+        g_thread_pool_free (data->helper_pool, FALSE, TRUE);
+        data->helper_pool = NULL;
+    }
 
-		visit_directory (dir, data);
-		g_object_unref (dir);
-	}
 	send_batch (data);
 
 	g_idle_add (search_thread_done_idle, data);
@@ -1325,3 +2469,27 @@ nemo_search_engine_advanced_check_content_pattern (NemoQuery *query,
     g_clear_pointer (&regex, g_regex_unref);
     return ret;
 }
+
+#if ! defined (NEMO_OMIT_SELF_CHECK)
+
+void
+nemo_self_check_search_engine_advanced (void)
+{
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("report"), "report");
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("hello\\.world"), "hello.world");
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("foo\\d+barbaz"), "barbaz");
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("colou?r"), "colo");
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("cat|dog"), NULL);
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("\\x41"), NULL);
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("\\x{263a}ok"), "ok");
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("\\cAbc"), "bc");
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("a\\k<name>"), NULL);
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("a\\k{name}"), NULL);
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("a\\g{-1}"), NULL);
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("\\p{Lu}x"), NULL);
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("\\1"), NULL);
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("\\012"), NULL);
+    EEL_CHECK_STRING_RESULT (extract_required_literal ("ab\\1234"), "ab");
+}
+
+#endif /* ! NEMO_OMIT_SELF_CHECK */
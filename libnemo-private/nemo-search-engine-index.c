@@ -0,0 +1,256 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Nemo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nemo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+ * Boston, MA 02110-1335, USA.
+ *
+ */
+
+#include <config.h>
+#include "nemo-search-engine-index.h"
+#include "nemo-filename-index.h"
+
+#include <gio/gio.h>
+
+#define DEBUG_FLAG NEMO_DEBUG_SEARCH
+#include "nemo-debug.h"
+
+struct NemoSearchEngineIndexDetails {
+	NemoQuery *query;
+	NemoSearchEngine *fallback;
+	gboolean using_fallback;
+
+	GCancellable *cancellable;
+	gboolean query_pending;
+};
+
+G_DEFINE_TYPE (NemoSearchEngineIndex,
+	       nemo_search_engine_index,
+	       NEMO_TYPE_SEARCH_ENGINE);
+
+static void
+finalize (GObject *object)
+{
+	NemoSearchEngineIndex *index;
+
+	index = NEMO_SEARCH_ENGINE_INDEX (object);
+
+	if (index->details->fallback) {
+		g_signal_handlers_disconnect_by_data (index->details->fallback, index);
+		g_clear_object (&index->details->fallback);
+	}
+
+	g_clear_object (&index->details->query);
+	g_clear_object (&index->details->cancellable);
+
+	G_OBJECT_CLASS (nemo_search_engine_index_parent_class)->finalize (object);
+}
+
+static void
+fallback_hits_added (NemoSearchEngine *fallback, GList *hits, NemoSearchEngine *engine)
+{
+	nemo_search_engine_hits_added (engine, hits);
+}
+
+static void
+fallback_hits_subtracted (NemoSearchEngine *fallback, GList *hits, NemoSearchEngine *engine)
+{
+	nemo_search_engine_hits_subtracted (engine, hits);
+}
+
+static void
+fallback_finished (NemoSearchEngine *fallback, NemoSearchEngine *engine)
+{
+	nemo_search_engine_finished (engine);
+}
+
+static void
+fallback_error (NemoSearchEngine *fallback, const char *error_message, NemoSearchEngine *engine)
+{
+	nemo_search_engine_error (engine, error_message);
+}
+
+static void
+free_hits (GList *hits)
+{
+	g_list_free_full (hits, (GDestroyNotify) file_search_result_free);
+}
+
+static void
+query_thread (GTask        *task,
+	      gpointer      source_object,
+	      gpointer      task_data,
+	      GCancellable *cancellable)
+{
+	GList *hits;
+
+	hits = nemo_filename_index_query_run (task_data, cancellable);
+
+	g_task_return_pointer (task, hits, (GDestroyNotify) free_hits);
+}
+
+static void
+query_done (GObject      *source_object,
+	    GAsyncResult *result,
+	    gpointer      user_data)
+{
+	NemoSearchEngineIndex *index;
+	GCancellable *cancellable;
+	GList *hits;
+
+	index = NEMO_SEARCH_ENGINE_INDEX (source_object);
+	cancellable = g_task_get_cancellable (G_TASK (result));
+	hits = g_task_propagate_pointer (G_TASK (result), NULL);
+
+	/* Stopped, and maybe started again since */
+	if (g_cancellable_is_cancelled (cancellable)) {
+		free_hits (hits);
+		return;
+	}
+
+	index->details->query_pending = FALSE;
+
+	DEBUG ("Index search found %u files", g_list_length (hits));
+
+	if (hits != NULL) {
+		/* FileSearchResults are normally freed in NemoSearchDirectory reset_file_list() */
+		nemo_search_engine_hits_added (NEMO_SEARCH_ENGINE (index), hits);
+		g_list_free (hits);
+	}
+
+	nemo_search_engine_finished (NEMO_SEARCH_ENGINE (index));
+}
+
+static void
+nemo_search_engine_index_start (NemoSearchEngine *engine)
+{
+	NemoSearchEngineIndex *index;
+	NemoFilenameIndexQuery *index_query;
+	GTask *task;
+
+	index = NEMO_SEARCH_ENGINE_INDEX (engine);
+
+	if (index->details->query_pending) {
+		return;
+	}
+
+	if (index->details->query == NULL) {
+		return;
+	}
+
+	index_query = nemo_filename_index_query_new (index->details->query);
+
+	if (index_query == NULL) {
+		DEBUG ("Not answerable from the filename index, searching the usual way");
+
+		index->details->using_fallback = TRUE;
+		nemo_search_engine_set_query (index->details->fallback, index->details->query);
+		nemo_search_engine_start (index->details->fallback);
+		return;
+	}
+
+	index->details->using_fallback = FALSE;
+
+	g_clear_object (&index->details->cancellable);
+	index->details->cancellable = g_cancellable_new ();
+
+	task = g_task_new (index, index->details->cancellable, query_done, NULL);
+	g_task_set_task_data (task, index_query, (GDestroyNotify) nemo_filename_index_query_free);
+	g_task_run_in_thread (task, query_thread);
+	g_object_unref (task);
+
+	index->details->query_pending = TRUE;
+}
+
+static void
+nemo_search_engine_index_stop (NemoSearchEngine *engine)
+{
+	NemoSearchEngineIndex *index;
+
+	index = NEMO_SEARCH_ENGINE_INDEX (engine);
+
+	if (index->details->using_fallback) {
+		nemo_search_engine_stop (index->details->fallback);
+		index->details->using_fallback = FALSE;
+	}
+
+	if (index->details->query_pending) {
+		g_cancellable_cancel (index->details->cancellable);
+		index->details->query_pending = FALSE;
+	}
+}
+
+static void
+nemo_search_engine_index_set_query (NemoSearchEngine *engine, NemoQuery *query)
+{
+	NemoSearchEngineIndex *index;
+
+	index = NEMO_SEARCH_ENGINE_INDEX (engine);
+
+	if (query) {
+		g_object_ref (query);
+	}
+
+	if (index->details->query) {
+		g_object_unref (index->details->query);
+	}
+
+	index->details->query = query;
+}
+
+static void
+nemo_search_engine_index_class_init (NemoSearchEngineIndexClass *class)
+{
+	GObjectClass *gobject_class;
+	NemoSearchEngineClass *engine_class;
+
+	gobject_class = G_OBJECT_CLASS (class);
+	gobject_class->finalize = finalize;
+
+	engine_class = NEMO_SEARCH_ENGINE_CLASS (class);
+	engine_class->set_query = nemo_search_engine_index_set_query;
+	engine_class->start = nemo_search_engine_index_start;
+	engine_class->stop = nemo_search_engine_index_stop;
+
+	g_type_class_add_private (class, sizeof (NemoSearchEngineIndexDetails));
+}
+
+static void
+nemo_search_engine_index_init (NemoSearchEngineIndex *engine)
+{
+	engine->details = G_TYPE_INSTANCE_GET_PRIVATE (engine, NEMO_TYPE_SEARCH_ENGINE_INDEX,
+						       NemoSearchEngineIndexDetails);
+}
+
+NemoSearchEngine *
+nemo_search_engine_index_new (NemoSearchEngine *fallback)
+{
+	NemoSearchEngineIndex *engine;
+
+	nemo_filename_index_ensure ();
+
+	engine = g_object_new (NEMO_TYPE_SEARCH_ENGINE_INDEX, NULL);
+	engine->details->fallback = fallback;
+
+	g_signal_connect (fallback, "hits-added",
+			  G_CALLBACK (fallback_hits_added), engine);
+	g_signal_connect (fallback, "hits-subtracted",
+			  G_CALLBACK (fallback_hits_subtracted), engine);
+	g_signal_connect (fallback, "finished",
+			  G_CALLBACK (fallback_finished), engine);
+	g_signal_connect (fallback, "error",
+			  G_CALLBACK (fallback_error), engine);
+
+	return NEMO_SEARCH_ENGINE (engine);
+}
@@ -0,0 +1,50 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Nemo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nemo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+ * Boston, MA 02110-1335, USA.
+ *
+ */
+
+#ifndef NEMO_SEARCH_ENGINE_INDEX_H
+#define NEMO_SEARCH_ENGINE_INDEX_H
+
+#include <libnemo-private/nemo-search-engine.h>
+
+#define NEMO_TYPE_SEARCH_ENGINE_INDEX		(nemo_search_engine_index_get_type ())
+#define NEMO_SEARCH_ENGINE_INDEX(obj)		(G_TYPE_CHECK_INSTANCE_CAST ((obj), NEMO_TYPE_SEARCH_ENGINE_INDEX, NemoSearchEngineIndex))
+#define NEMO_SEARCH_ENGINE_INDEX_CLASS(klass)	(G_TYPE_CHECK_CLASS_CAST ((klass), NEMO_TYPE_SEARCH_ENGINE_INDEX, NemoSearchEngineIndexClass))
+#define NEMO_IS_SEARCH_ENGINE_INDEX(obj)		(G_TYPE_CHECK_INSTANCE_TYPE ((obj), NEMO_TYPE_SEARCH_ENGINE_INDEX))
+#define NEMO_IS_SEARCH_ENGINE_INDEX_CLASS(klass)	(G_TYPE_CHECK_CLASS_TYPE ((klass), NEMO_TYPE_SEARCH_ENGINE_INDEX))
+#define NEMO_SEARCH_ENGINE_INDEX_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), NEMO_TYPE_SEARCH_ENGINE_INDEX, NemoSearchEngineIndexClass))
+
+typedef struct NemoSearchEngineIndexDetails NemoSearchEngineIndexDetails;
+
+typedef struct NemoSearchEngineIndex {
+	NemoSearchEngine parent;
+	NemoSearchEngineIndexDetails *details;
+} NemoSearchEngineIndex;
+
+typedef struct {
+	NemoSearchEngineClass parent_class;
+} NemoSearchEngineIndexClass;
+
+GType nemo_search_engine_index_get_type (void);
+
+/* Answers filename searches from the filename index, and hands anything
+ * else (or anything outside the indexed folders) to @fallback, which it
+ * takes ownership of. */
+NemoSearchEngine* nemo_search_engine_index_new (NemoSearchEngine *fallback);
+
+#endif /* NEMO_SEARCH_ENGINE_INDEX_H */
@@ -25,6 +25,8 @@
 #include <glib/gprintf.h>
 #include "nemo-search-engine.h"
 #include "nemo-search-engine-advanced.h"
+#include "nemo-search-engine-index.h"
+#include "nemo-filename-index.h"
 
 #ifdef ENABLE_TRACKER
 #include "nemo-search-engine-tracker.h"
@@ -95,16 +97,20 @@ nemo_search_engine_init (NemoSearchEngine *engine)
 NemoSearchEngine *
 nemo_search_engine_new (void)
 {
-	NemoSearchEngine *engine;
+	NemoSearchEngine *engine = NULL;
 	
 #ifdef ENABLE_TRACKER	
 	engine = nemo_search_engine_tracker_new ();
-	if (engine) {
-		return engine;
-	}
 #endif
 
-	engine = nemo_search_engine_advanced_new ();
+	if (engine == NULL) {
+		engine = nemo_search_engine_advanced_new ();
+	}
+
+	if (nemo_filename_index_is_enabled ()) {
+		engine = nemo_search_engine_index_new (engine);
+	}
+
 	return engine;
 }
 
@@ -215,6 +221,7 @@ file_search_result_free (FileSearchResult *res)
 
     g_free (res->uri);
     g_free (res->snippet);
+    g_clear_object (&res->info);
     g_free (res);
 }
 
@@ -25,6 +25,7 @@
 #define NEMO_SEARCH_ENGINE_H
 
 #include <glib-object.h>
+#include <gio/gio.h>
 #include <libnemo-private/nemo-query.h>
 
 #define NEMO_TYPE_SEARCH_ENGINE		(nemo_search_engine_get_type ())
@@ -74,6 +75,7 @@ typedef struct {
     gchar     *uri;           // The file uri;
     gchar     *snippet;          // List of hits.
     gint64     hits;
+    GFileInfo *info;         // Queried by the engine, if it could - seeds the NemoFile.
 } FileSearchResult;
 
 FileSearchResult *file_search_result_new     (gchar *uri, gchar *snippet);
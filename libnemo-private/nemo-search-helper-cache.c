@@ -0,0 +1,305 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-search-helper-cache.c: Stored text output of content search helpers.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#include <config.h>
+#include "nemo-search-helper-cache.h"
+#include "nemo-global-preferences.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+#include <gio/gunixinputstream.h>
+#include <gio/gunixoutputstream.h>
+
+#define DEBUG_FLAG NEMO_DEBUG_SEARCH
+#include "nemo-debug.h"
+
+/* Bumped whenever the key or file layout changes, so old entries are
+ * simply never found again and age out. */
+#define CACHE_VERSION "1"
+
+/* Trimming goes this far below the limit, so it isn't redone for every
+ * entry added once the cache is full */
+#define TRIM_PERCENT 90
+
+struct _NemoSearchHelperCacheWriter {
+    gchar *path;
+    gchar *tmp_path;
+    GOutputStream *stream;
+};
+
+typedef struct {
+    gchar *path;
+    gint64 size;
+    gint64 atime;
+} CacheEntry;
+
+static GMutex cache_lock;
+/* Total size of the entries, or -1 until the directory is first read */
+static gint64 cache_total = -1;
+
+static const gchar *
+get_cache_dir (void)
+{
+    static gchar *dir = NULL;
+
+    if (g_once_init_enter (&dir)) {
+        gchar *path = g_build_filename (g_get_user_cache_dir (), "nemo", "search-helper-text", NULL);
+
+        g_once_init_leave (&dir, path);
+    }
+
+    return dir;
+}
+
+gint64
+nemo_search_helper_cache_get_limit (void)
+{
+    gint megabytes = g_settings_get_int (nemo_search_preferences,
+                                         NEMO_PREFERENCES_SEARCH_HELPER_CACHE_SIZE);
+
+    return (gint64) MAX (megabytes, 0) * 1024 * 1024;
+}
+
+gchar *
+nemo_search_helper_cache_make_key (const gchar *path,
+                                   goffset      size,
+                                   guint64      mtime,
+                                   const gchar *helper_exec)
+{
+    GChecksum *checksum;
+    gchar *stamp, *key;
+
+    checksum = g_checksum_new (G_CHECKSUM_SHA1);
+    stamp = g_strdup_printf (CACHE_VERSION ":%" G_GINT64_FORMAT ":%" G_GUINT64_FORMAT ":",
+                             (gint64) size, mtime);
+
+    g_checksum_update (checksum, (const guchar *) stamp, -1);
+    g_checksum_update (checksum, (const guchar *) helper_exec, strlen (helper_exec) + 1);
+    g_checksum_update (checksum, (const guchar *) path, -1);
+
+    key = g_strdup (g_checksum_get_string (checksum));
+
+    g_checksum_free (checksum);
+    g_free (stamp);
+
+    return key;
+}
+
+/**
+ * nemo_search_helper_cache_lookup:
+ * @key: from nemo_search_helper_cache_make_key ()
+ *
+ * Opens the stored text for @key, and marks it as recently used.
+ *
+ * Returns: (transfer full) (nullable): a stream of the text, or %NULL.
+ */
+GInputStream *
+nemo_search_helper_cache_lookup (const gchar *key)
+{
+    gchar *path;
+    gint fd;
+
+    path = g_build_filename (get_cache_dir (), key, NULL);
+    fd = g_open (path, O_RDONLY | O_CLOEXEC, 0);
+
+    if (fd < 0) {
+        g_free (path);
+        return NULL;
+    }
+
+    /* The modification time is what eviction sorts on - access times
+     * aren't kept on many filesystems */
+    g_utime (path, NULL);
+
+    DEBUG ("Using stored search helper output %s", path);
+    g_free (path);
+
+    return g_unix_input_stream_new (fd, TRUE);
+}
+
+/**
+ * nemo_search_helper_cache_store:
+ * @key: from nemo_search_helper_cache_make_key ()
+ *
+ * Starts storing new text for @key.  The text only becomes visible to
+ * lookups once nemo_search_helper_cache_writer_finish () keeps it.
+ *
+ * Returns: (nullable): a writer, or %NULL if the cache dir isn't writable.
+ */
+NemoSearchHelperCacheWriter *
+nemo_search_helper_cache_store (const gchar *key)
+{
+    NemoSearchHelperCacheWriter *writer;
+    gchar *tmp_path;
+    gint fd;
+
+    if (g_mkdir_with_parents (get_cache_dir (), 0700) < 0) {
+        return NULL;
+    }
+
+    tmp_path = g_strdup_printf ("%s/.%s.XXXXXX", get_cache_dir (), key);
+    fd = g_mkstemp_full (tmp_path, O_WRONLY | O_CLOEXEC, 0600);
+
+    if (fd < 0) {
+        DEBUG ("Could not create %s: %s", tmp_path, g_strerror (errno));
+        g_free (tmp_path);
+        return NULL;
+    }
+
+    writer = g_new0 (NemoSearchHelperCacheWriter, 1);
+    writer->path = g_build_filename (get_cache_dir (), key, NULL);
+    writer->tmp_path = tmp_path;
+    writer->stream = g_unix_output_stream_new (fd, TRUE);
+
+    return writer;
+}
+
+GOutputStream *
+nemo_search_helper_cache_writer_get_stream (NemoSearchHelperCacheWriter *writer)
+{
+    return writer->stream;
+}
+
+static gint
+compare_entries_by_age (gconstpointer a,
+                        gconstpointer b)
+{
+    const CacheEntry *entry_a = a;
+    const CacheEntry *entry_b = b;
+
+    return (entry_a->atime > entry_b->atime) - (entry_a->atime < entry_b->atime);
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+    g_free (entry->path);
+    g_free (entry);
+}
+
+/* Reads the sizes of all the entries, and if @limit is over, removes the
+ * least recently used ones.  Stray temporary files are left alone - they
+ * belong to writers still running. */
+static void
+trim_cache_locked (gint64 limit)
+{
+    GDir *dir;
+    const gchar *name;
+    GList *entries = NULL, *l;
+    gint64 total = 0;
+
+    dir = g_dir_open (get_cache_dir (), 0, NULL);
+
+    if (dir == NULL) {
+        cache_total = 0;
+        return;
+    }
+
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        CacheEntry *entry;
+        GStatBuf st;
+        gchar *path;
+
+        if (name[0] == '.') {
+            continue;
+        }
+
+        path = g_build_filename (get_cache_dir (), name, NULL);
+
+        if (g_stat (path, &st) < 0 || !S_ISREG (st.st_mode)) {
+            g_free (path);
+            continue;
+        }
+
+        entry = g_new0 (CacheEntry, 1);
+        entry->path = path;
+        entry->size = st.st_size;
+        entry->atime = st.st_mtime;
+
+        total += entry->size;
+        entries = g_list_prepend (entries, entry);
+    }
+
+    g_dir_close (dir);
+
+    if (total > limit) {
+        gint64 target = limit / 100 * TRIM_PERCENT;
+
+        entries = g_list_sort (entries, compare_entries_by_age);
+
+        for (l = entries; l != NULL && total > target; l = l->next) {
+            CacheEntry *entry = l->data;
+
+            if (g_unlink (entry->path) == 0) {
+                total -= entry->size;
+            }
+        }
+
+        DEBUG ("Trimmed stored search helper output to %" G_GINT64_FORMAT " bytes", total);
+    }
+
+    g_list_free_full (entries, (GDestroyNotify) cache_entry_free);
+
+    cache_total = total;
+}
+
+/**
+ * nemo_search_helper_cache_writer_finish:
+ * @writer: (transfer full): from nemo_search_helper_cache_store ()
+ * @keep: whether the text written is complete and should be stored
+ * @limit: the cache size limit, from nemo_search_helper_cache_get_limit ()
+ *
+ * Closes and frees @writer, either publishing its text or discarding it.
+ */
+void
+nemo_search_helper_cache_writer_finish (NemoSearchHelperCacheWriter *writer,
+                                        gboolean                     keep,
+                                        gint64                       limit)
+{
+    GStatBuf st;
+
+    if (!g_output_stream_close (writer->stream, NULL, NULL)) {
+        keep = FALSE;
+    }
+
+    if (keep && g_rename (writer->tmp_path, writer->path) == 0 && g_stat (writer->path, &st) == 0) {
+        g_mutex_lock (&cache_lock);
+
+        if (cache_total >= 0) {
+            cache_total += st.st_size;
+        }
+
+        if (cache_total < 0 || cache_total > limit) {
+            trim_cache_locked (limit);
+        }
+
+        g_mutex_unlock (&cache_lock);
+    } else {
+        g_unlink (writer->tmp_path);
+    }
+
+    g_object_unref (writer->stream);
+    g_free (writer->tmp_path);
+    g_free (writer->path);
+    g_free (writer);
+}
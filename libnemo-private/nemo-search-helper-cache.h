@@ -0,0 +1,52 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-search-helper-cache.h: Stored text output of content search helpers.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#ifndef NEMO_SEARCH_HELPER_CACHE_H
+#define NEMO_SEARCH_HELPER_CACHE_H
+
+#include <gio/gio.h>
+
+/* The text a search helper extracts from a document is kept in the user
+ * cache dir, named for the document's path, size and mtime and the helper's
+ * command line, so an unchanged document is never converted twice.  Entries
+ * are dropped least recently used first once the total passes the size
+ * limit from org.nemo.search search-helper-cache-size.
+ *
+ * Everything here may be called from the search worker threads.
+ */
+
+typedef struct _NemoSearchHelperCacheWriter NemoSearchHelperCacheWriter;
+
+gint64                       nemo_search_helper_cache_get_limit (void);
+
+gchar                       *nemo_search_helper_cache_make_key  (const gchar *path,
+                                                                 goffset      size,
+                                                                 guint64      mtime,
+                                                                 const gchar *helper_exec);
+
+GInputStream                *nemo_search_helper_cache_lookup    (const gchar *key);
+
+NemoSearchHelperCacheWriter *nemo_search_helper_cache_store     (const gchar *key);
+GOutputStream               *nemo_search_helper_cache_writer_get_stream (NemoSearchHelperCacheWriter *writer);
+void                         nemo_search_helper_cache_writer_finish     (NemoSearchHelperCacheWriter *writer,
+                                                                         gboolean                     keep,
+                                                                         gint64                       limit);
+
+#endif /* NEMO_SEARCH_HELPER_CACHE_H */
@@ -0,0 +1,228 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-thumbnail-cache.c: Process-wide cache of decoded thumbnails.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#include <config.h>
+#include "nemo-thumbnail-cache.h"
+#include "nemo-thumbnail-stats.h"
+
+#include "nemo-global-preferences.h"
+#include <eel/eel-debug.h>
+
+#define DEBUG_FLAG NEMO_DEBUG_THUMBNAILS
+#include <libnemo-private/nemo-debug.h>
+
+typedef struct {
+    char *key;
+    char *path;
+    GdkPixbuf *pixbuf;
+    gsize bytes;
+    GList *lru_link;
+} ThumbnailCacheEntry;
+
+/* key -> ThumbnailCacheEntry */
+static GHashTable *entries = NULL;
+/* Most recently used at the head */
+static GQueue lru = G_QUEUE_INIT;
+static gsize total_bytes = 0;
+static gsize max_bytes = 0;
+
+static char *
+make_key (const char *path,
+          time_t      mtime,
+          int         size)
+{
+    return g_strdup_printf ("%d:%" G_GINT64_FORMAT ":%s", size, (gint64) mtime, path);
+}
+
+static void
+entry_free (ThumbnailCacheEntry *entry)
+{
+    g_free (entry->key);
+    g_free (entry->path);
+    g_object_unref (entry->pixbuf);
+    g_free (entry);
+}
+
+static void
+remove_entry (ThumbnailCacheEntry *entry)
+{
+    g_queue_delete_link (&lru, entry->lru_link);
+    total_bytes -= entry->bytes;
+
+    /* Frees the entry */
+    g_hash_table_remove (entries, entry->key);
+}
+
+static void
+trim_to_budget (void)
+{
+    while (total_bytes > max_bytes && !g_queue_is_empty (&lru)) {
+        ThumbnailCacheEntry *entry = g_queue_peek_tail (&lru);
+
+        DEBUG ("Evicting cached thumbnail: %s (%" G_GSIZE_FORMAT " bytes)", entry->key, entry->bytes);
+        remove_entry (entry);
+    }
+}
+
+static void
+cache_size_changed_callback (gpointer user_data)
+{
+    gint megabytes;
+
+    megabytes = g_settings_get_int (nemo_preferences, NEMO_PREFERENCES_THUMBNAIL_CACHE_SIZE);
+    max_bytes = (gsize) MAX (0, megabytes) * 1024 * 1024;
+
+    DEBUG ("Thumbnail cache budget: %d MB", megabytes);
+
+    trim_to_budget ();
+}
+
+static void
+free_thumbnail_cache (void)
+{
+    g_signal_handlers_disconnect_by_func (nemo_preferences,
+                                          cache_size_changed_callback,
+                                          NULL);
+
+    g_queue_clear (&lru);
+    g_clear_pointer (&entries, g_hash_table_destroy);
+    total_bytes = 0;
+}
+
+static void
+ensure_cache (void)
+{
+    if (entries != NULL) {
+        return;
+    }
+
+    entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                     NULL, (GDestroyNotify) entry_free);
+
+    cache_size_changed_callback (NULL);
+    g_signal_connect_swapped (nemo_preferences,
+                              "changed::" NEMO_PREFERENCES_THUMBNAIL_CACHE_SIZE,
+                              G_CALLBACK (cache_size_changed_callback),
+                              NULL);
+
+    eel_debug_call_at_shutdown ((EelFunction) free_thumbnail_cache);
+}
+
+/**
+ * nemo_thumbnail_cache_lookup:
+ * @path: the file the thumbnail was decoded from
+ * @mtime: modification time of the file the thumbnail represents
+ * @size: the size the thumbnail was scaled to
+ *
+ * Returns: (transfer full) (nullable): the cached pixbuf, or %NULL.
+ */
+GdkPixbuf *
+nemo_thumbnail_cache_lookup (const char *path,
+                             time_t      mtime,
+                             int         size)
+{
+    ThumbnailCacheEntry *entry;
+    char *key;
+
+    g_return_val_if_fail (path != NULL, NULL);
+
+    ensure_cache ();
+
+    key = make_key (path, mtime, size);
+    entry = g_hash_table_lookup (entries, key);
+    g_free (key);
+
+    nemo_thumbnail_stats_cache_lookup (entry != NULL);
+
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    /* Bump to the front */
+    g_queue_unlink (&lru, entry->lru_link);
+    g_queue_push_head_link (&lru, entry->lru_link);
+
+    return g_object_ref (entry->pixbuf);
+}
+
+void
+nemo_thumbnail_cache_insert (const char *path,
+                             time_t      mtime,
+                             int         size,
+                             GdkPixbuf  *pixbuf)
+{
+    ThumbnailCacheEntry *entry;
+    char *key;
+    gsize bytes;
+
+    g_return_if_fail (path != NULL);
+    g_return_if_fail (GDK_IS_PIXBUF (pixbuf));
+
+    ensure_cache ();
+
+    bytes = gdk_pixbuf_get_byte_length (pixbuf);
+
+    /* Not worth evicting everything else for */
+    if (bytes > max_bytes) {
+        return;
+    }
+
+    key = make_key (path, mtime, size);
+
+    entry = g_hash_table_lookup (entries, key);
+    if (entry != NULL) {
+        remove_entry (entry);
+    }
+
+    entry = g_new0 (ThumbnailCacheEntry, 1);
+    entry->key = key;
+    entry->path = g_strdup (path);
+    entry->pixbuf = g_object_ref (pixbuf);
+    entry->bytes = bytes;
+
+    g_queue_push_head (&lru, entry);
+    entry->lru_link = g_queue_peek_head_link (&lru);
+    g_hash_table_insert (entries, entry->key, entry);
+    total_bytes += bytes;
+
+    trim_to_budget ();
+}
+
+/* Drops every cached size and mtime of the thumbnail at @path, for when the
+ * file itself goes away. */
+void
+nemo_thumbnail_cache_remove_path (const char *path)
+{
+    GList *l, *next;
+
+    if (entries == NULL || path == NULL) {
+        return;
+    }
+
+    for (l = lru.head; l != NULL; l = next) {
+        ThumbnailCacheEntry *entry = l->data;
+
+        next = l->next;
+
+        if (g_strcmp0 (entry->path, path) == 0) {
+            remove_entry (entry);
+        }
+    }
+}
@@ -0,0 +1,46 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-thumbnail-cache.h: Process-wide cache of decoded thumbnails.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#ifndef NEMO_THUMBNAIL_CACHE_H
+#define NEMO_THUMBNAIL_CACHE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <time.h>
+
+/* Decoded thumbnails are shared between every NemoFile (and so every view
+ * and tab) showing the same thumbnail.  Entries are keyed by the path the
+ * pixbuf was decoded from (the file's uri, for images that are their own
+ * thumbnail), the mtime of the file it represents and the size
+ * it was scaled to, and are evicted least-recently-used first once the
+ * "thumbnail-cache-size" budget is exceeded.
+ *
+ * Main thread only.
+ */
+
+GdkPixbuf *nemo_thumbnail_cache_lookup       (const char *path,
+                                              time_t      mtime,
+                                              int         size);
+void       nemo_thumbnail_cache_insert       (const char *path,
+                                              time_t      mtime,
+                                              int         size,
+                                              GdkPixbuf  *pixbuf);
+void       nemo_thumbnail_cache_remove_path  (const char *path);
+
+#endif /* NEMO_THUMBNAIL_CACHE_H */
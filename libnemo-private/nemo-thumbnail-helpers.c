@@ -0,0 +1,489 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-thumbnail-helpers.c: Long-running external thumbnailers.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#include <config.h>
+#include "nemo-thumbnail-helpers.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <glib/gstdio.h>
+
+#define DEBUG_FLAG NEMO_DEBUG_THUMBNAILS
+#include <libnemo-private/nemo-debug.h>
+
+#define THUMBNAILER_GROUP "Thumbnailer Entry"
+#define PERSISTENT_EXEC_KEY "X-Nemo-PersistentExec"
+
+/* Helpers that take longer than this for one file are killed */
+#define HELPER_TIMEOUT (30 * 1000)
+
+/* More than this many files at once for one thumbnailer go to the factory */
+#define MAX_HELPERS_PER_THUMBNAILER 4
+
+/* A thumbnailer whose helper dies this many times in a row is given up on */
+#define MAX_HELPER_DEATHS 3
+
+#define MAX_RESPONSE_LENGTH 1024
+
+typedef struct {
+    char *name;
+    char **argv;
+    /* HelperProcess, waiting for work */
+    GQueue idle;
+    int n_helpers;
+    int n_deaths;
+} Thumbnailer;
+
+typedef struct {
+    Thumbnailer *thumbnailer;
+    GPid pid;
+    /* Our end of the socket the helper has as stdin and stdout */
+    int fd;
+    GString *buffer;
+} HelperProcess;
+
+typedef enum {
+    HELPER_OK,
+    HELPER_FAILED,
+    HELPER_DEAD
+} HelperResult;
+
+static GMutex helpers_mutex;
+static GPtrArray *thumbnailers = NULL;
+/* mime type -> Thumbnailer, or NULL if an ordinary thumbnailer handles it */
+static GHashTable *thumbnailers_by_mime_type = NULL;
+
+static void
+helper_process_kill (HelperProcess *helper)
+{
+    close (helper->fd);
+    kill (helper->pid, SIGKILL);
+    waitpid (helper->pid, NULL, 0);
+    g_spawn_close_pid (helper->pid);
+
+    g_string_free (helper->buffer, TRUE);
+    g_free (helper);
+}
+
+static void
+thumbnailer_free (Thumbnailer *thumbnailer)
+{
+    g_queue_foreach (&thumbnailer->idle, (GFunc) helper_process_kill, NULL);
+    g_queue_clear (&thumbnailer->idle);
+
+    g_strfreev (thumbnailer->argv);
+    g_free (thumbnailer->name);
+    g_free (thumbnailer);
+}
+
+/* Same precedence as the thumbnail factory: user directory first, and the
+ * first thumbnailer to claim a mime type gets it. */
+static void
+load_thumbnailers_from_dir (const char *data_dir,
+                            GHashTable *seen_names)
+{
+    GDir *dir;
+    const char *name;
+    gchar *path;
+
+    path = g_build_filename (data_dir, "thumbnailers", NULL);
+    dir = g_dir_open (path, 0, NULL);
+    g_free (path);
+
+    if (dir == NULL) {
+        return;
+    }
+
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        GKeyFile *key_file;
+        Thumbnailer *thumbnailer = NULL;
+        gchar *exec, *try_exec, *program = NULL;
+        gchar **mime_types, **argv;
+        gint i;
+
+        if (!g_str_has_suffix (name, ".thumbnailer") ||
+            g_hash_table_contains (seen_names, name)) {
+            continue;
+        }
+
+        g_hash_table_add (seen_names, g_strdup (name));
+
+        key_file = g_key_file_new ();
+        path = g_build_filename (data_dir, "thumbnailers", name, NULL);
+
+        if (!g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, NULL)) {
+            g_free (path);
+            g_key_file_free (key_file);
+            continue;
+        }
+
+        g_free (path);
+
+        exec = g_key_file_get_string (key_file, THUMBNAILER_GROUP, PERSISTENT_EXEC_KEY, NULL);
+        try_exec = g_key_file_get_string (key_file, THUMBNAILER_GROUP, "TryExec", NULL);
+
+        if (try_exec != NULL) {
+            program = g_find_program_in_path (try_exec);
+        }
+
+        if (exec != NULL &&
+            (try_exec == NULL || program != NULL) &&
+            g_shell_parse_argv (exec, NULL, &argv, NULL)) {
+            thumbnailer = g_new0 (Thumbnailer, 1);
+            thumbnailer->name = g_strdup (name);
+            thumbnailer->argv = argv;
+            g_queue_init (&thumbnailer->idle);
+
+            g_ptr_array_add (thumbnailers, thumbnailer);
+        }
+
+        mime_types = g_key_file_get_string_list (key_file, THUMBNAILER_GROUP, "MimeType", NULL, NULL);
+
+        for (i = 0; mime_types != NULL && mime_types[i] != NULL; i++) {
+            if (!g_hash_table_contains (thumbnailers_by_mime_type, mime_types[i])) {
+                g_hash_table_insert (thumbnailers_by_mime_type, g_strdup (mime_types[i]), thumbnailer);
+            }
+        }
+
+        g_strfreev (mime_types);
+        g_free (program);
+        g_free (try_exec);
+        g_free (exec);
+        g_key_file_free (key_file);
+    }
+
+    g_dir_close (dir);
+}
+
+/* With helpers_mutex held */
+static void
+ensure_thumbnailers (void)
+{
+    const gchar * const *data_dirs;
+    GHashTable *seen_names;
+    gint i;
+
+    if (thumbnailers != NULL) {
+        return;
+    }
+
+    thumbnailers = g_ptr_array_new_with_free_func ((GDestroyNotify) thumbnailer_free);
+    thumbnailers_by_mime_type = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    seen_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    load_thumbnailers_from_dir (g_get_user_data_dir (), seen_names);
+
+    data_dirs = g_get_system_data_dirs ();
+    for (i = 0; data_dirs[i] != NULL; i++) {
+        load_thumbnailers_from_dir (data_dirs[i], seen_names);
+    }
+
+    g_hash_table_destroy (seen_names);
+
+    DEBUG ("Found %u persistent thumbnailers", thumbnailers->len);
+}
+
+static HelperProcess *
+helper_process_spawn (Thumbnailer *thumbnailer)
+{
+    HelperProcess *helper;
+    GError *error = NULL;
+    GPid pid;
+    int fds[2];
+
+    /* Close-on-exec from the start, so no other child started meanwhile
+     * inherits them - the spawn dups fds[1] onto the helper's stdio */
+    if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        return NULL;
+    }
+
+    if (!g_spawn_async_with_fds (NULL, thumbnailer->argv, NULL,
+                                 G_SPAWN_SEARCH_PATH |
+                                 G_SPAWN_DO_NOT_REAP_CHILD |
+                                 G_SPAWN_STDERR_TO_DEV_NULL,
+                                 NULL, NULL,
+                                 &pid,
+                                 fds[1], fds[1], -1,
+                                 &error)) {
+        DEBUG ("Could not start %s: %s", thumbnailer->name, error->message);
+        g_error_free (error);
+        close (fds[0]);
+        close (fds[1]);
+        return NULL;
+    }
+
+    close (fds[1]);
+
+    helper = g_new0 (HelperProcess, 1);
+    helper->thumbnailer = thumbnailer;
+    helper->pid = pid;
+    helper->fd = fds[0];
+    helper->buffer = g_string_new (NULL);
+
+    DEBUG ("Started %s helper (pid %d)", thumbnailer->name, (int) pid);
+
+    return helper;
+}
+
+static gboolean
+helper_process_send (HelperProcess *helper,
+                     const char    *request)
+{
+    gsize length, written = 0;
+    gssize n;
+
+    length = strlen (request);
+
+    while (written < length) {
+        /* No SIGPIPE if the helper has gone away */
+        n = send (helper->fd, request + written, length - written, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return FALSE;
+        }
+
+        written += n;
+    }
+
+    return TRUE;
+}
+
+/* Returns the response line, without the newline, or NULL if the helper
+ * died, talked nonsense or timed out. */
+static gchar *
+helper_process_receive (HelperProcess *helper)
+{
+    struct pollfd pfd;
+    gint64 deadline;
+    char chunk[256];
+    gchar *newline, *line;
+    gssize n;
+    int timeout;
+
+    deadline = g_get_monotonic_time () + HELPER_TIMEOUT * 1000;
+
+    while ((newline = memchr (helper->buffer->str, '\n', helper->buffer->len)) == NULL) {
+        if (helper->buffer->len > MAX_RESPONSE_LENGTH) {
+            return NULL;
+        }
+
+        timeout = (int) ((deadline - g_get_monotonic_time ()) / 1000);
+
+        if (timeout <= 0) {
+            return NULL;
+        }
+
+        pfd.fd = helper->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        n = poll (&pfd, 1, timeout);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return NULL;
+        }
+
+        n = recv (helper->fd, chunk, sizeof (chunk), 0);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return NULL;
+        }
+
+        g_string_append_len (helper->buffer, chunk, n);
+    }
+
+    line = g_strndup (helper->buffer->str, newline - helper->buffer->str);
+    g_string_erase (helper->buffer, 0, newline - helper->buffer->str + 1);
+
+    return line;
+}
+
+static HelperResult
+helper_process_run (HelperProcess *helper,
+                    const char    *path,
+                    const char    *output_path,
+                    int            size)
+{
+    HelperResult result;
+    gchar *request, *response;
+
+    /* Tabs and newlines would break the protocol */
+    if (strpbrk (path, "\t\n") != NULL) {
+        return HELPER_FAILED;
+    }
+
+    request = g_strdup_printf ("%s\t%s\t%d\n", path, output_path, size);
+
+    if (!helper_process_send (helper, request)) {
+        g_free (request);
+        return HELPER_DEAD;
+    }
+
+    g_free (request);
+
+    response = helper_process_receive (helper);
+
+    if (response == NULL) {
+        result = HELPER_DEAD;
+    } else if (strcmp (response, "ok") == 0) {
+        result = HELPER_OK;
+    } else {
+        DEBUG ("%s couldn't thumbnail %s: %s", helper->thumbnailer->name, path, response);
+        result = HELPER_FAILED;
+    }
+
+    g_free (response);
+
+    return result;
+}
+
+/* Thumbnail thread */
+GdkPixbuf *
+nemo_thumbnail_helpers_generate (const char *uri,
+                                 const char *mime_type,
+                                 int         size,
+                                 gboolean   *handled)
+{
+    Thumbnailer *thumbnailer;
+    HelperProcess *helper;
+    HelperResult result;
+    GdkPixbuf *pixbuf = NULL;
+    gchar *path, *output_path = NULL;
+    int output_fd;
+
+    *handled = FALSE;
+
+    if (mime_type == NULL) {
+        return NULL;
+    }
+
+    /* Helpers only take local files - anything else is left to the
+     * ordinary thumbnailer before a helper is tied up */
+    path = g_filename_from_uri (uri, NULL, NULL);
+
+    if (path == NULL) {
+        return NULL;
+    }
+
+    g_mutex_lock (&helpers_mutex);
+
+    ensure_thumbnailers ();
+
+    thumbnailer = g_hash_table_lookup (thumbnailers_by_mime_type, mime_type);
+
+    if (thumbnailer == NULL || thumbnailer->n_deaths >= MAX_HELPER_DEATHS) {
+        g_mutex_unlock (&helpers_mutex);
+        goto out;
+    }
+
+    helper = g_queue_pop_head (&thumbnailer->idle);
+
+    if (helper == NULL && thumbnailer->n_helpers < MAX_HELPERS_PER_THUMBNAILER) {
+        helper = helper_process_spawn (thumbnailer);
+
+        if (helper != NULL) {
+            thumbnailer->n_helpers++;
+        } else {
+            thumbnailer->n_deaths = MAX_HELPER_DEATHS;
+        }
+    }
+
+    g_mutex_unlock (&helpers_mutex);
+
+    /* All busy, or it won't start */
+    if (helper == NULL) {
+        goto out;
+    }
+
+    output_fd = g_file_open_tmp ("nemo-thumbnail-XXXXXX.png", &output_path, NULL);
+
+    if (output_fd < 0) {
+        result = HELPER_FAILED;
+    } else {
+        close (output_fd);
+
+        result = helper_process_run (helper, path, output_path, size);
+
+        /* Only an answer from the helper counts - if it died or hung, the
+         * ordinary thumbnailer still gets its turn */
+        *handled = result != HELPER_DEAD;
+
+        if (result == HELPER_OK) {
+            pixbuf = gdk_pixbuf_new_from_file_at_size (output_path, size, size, NULL);
+        }
+    }
+
+    g_mutex_lock (&helpers_mutex);
+
+    if (result == HELPER_DEAD) {
+        DEBUG ("%s helper stopped answering, killing it", thumbnailer->name);
+
+        thumbnailer->n_helpers--;
+        thumbnailer->n_deaths++;
+        helper_process_kill (helper);
+    } else {
+        if (result == HELPER_OK) {
+            thumbnailer->n_deaths = 0;
+        }
+
+        g_queue_push_head (&thumbnailer->idle, helper);
+    }
+
+    g_mutex_unlock (&helpers_mutex);
+
+ out:
+    if (output_path != NULL) {
+        g_unlink (output_path);
+        g_free (output_path);
+    }
+    g_free (path);
+
+    return pixbuf;
+}
+
+/* Mainloop, once the thumbnail threads are done */
+void
+nemo_thumbnail_helpers_shutdown (void)
+{
+    g_mutex_lock (&helpers_mutex);
+
+    g_clear_pointer (&thumbnailers_by_mime_type, g_hash_table_destroy);
+    g_clear_pointer (&thumbnailers, g_ptr_array_unref);
+
+    g_mutex_unlock (&helpers_mutex);
+}
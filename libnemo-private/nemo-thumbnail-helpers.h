@@ -0,0 +1,49 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-thumbnail-helpers.h: Long-running external thumbnailers.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#ifndef NEMO_THUMBNAIL_HELPERS_H
+#define NEMO_THUMBNAIL_HELPERS_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+/* The thumbnail factory runs an external thumbnailer once per file.  A
+ * .thumbnailer file can instead offer a helper that stays running, with
+ *
+ *   X-Nemo-PersistentExec=video-thumbnailer --persistent
+ *
+ * The helper reads one request per line on stdin:
+ *
+ *   <input path>\t<output png path>\t<size>\n
+ *
+ * and, once it has written the thumbnail (or given up), answers on stdout
+ * with "ok\n" or "error <message>\n".  Helpers are started on demand, up to
+ * one per thumbnail thread, and killed and restarted if they stop answering.
+ *
+ * nemo_thumbnail_helpers_generate () sets @handled to FALSE when there's no
+ * helper for @mime_type (or @uri has no local path), in which case the
+ * thumbnail should be made the usual way.  Thread safe.
+ */
+GdkPixbuf *nemo_thumbnail_helpers_generate (const char *uri,
+                                            const char *mime_type,
+                                            int         size,
+                                            gboolean   *handled);
+void       nemo_thumbnail_helpers_shutdown (void);
+
+#endif /* NEMO_THUMBNAIL_HELPERS_H */
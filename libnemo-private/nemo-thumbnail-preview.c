@@ -0,0 +1,439 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-thumbnail-preview.c: Thumbnails from previews embedded in photos.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#include <config.h>
+#include "nemo-thumbnail-preview.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_EXIF
+  #include <libexif/exif-data.h>
+  #include <libexif/exif-utils.h>
+#endif
+
+#define DEBUG_FLAG NEMO_DEBUG_THUMBNAILS
+#include <libnemo-private/nemo-debug.h>
+
+/* Previews whose aspect ratio differs more than this from the photo are
+ * letterboxed, and would make a thumbnail with black bars. */
+#define ASPECT_TOLERANCE 0.02
+
+#define MAX_CANDIDATES 8
+
+/* EXIF thumbnails are 160x120 by the standard, so they're only worth trying
+ * for requests no bigger than that - never for the large thumbnails nemo
+ * makes, where only MPF previews can help. */
+#define EXIF_THUMBNAIL_SIZE 160
+
+gboolean
+nemo_thumbnail_preview_can_extract (const char *mime_type)
+{
+#ifdef HAVE_EXIF
+    return g_strcmp0 (mime_type, "image/jpeg") == 0;
+#else
+    return FALSE;
+#endif
+}
+
+#ifdef HAVE_EXIF
+
+typedef struct {
+    const guchar *data;
+    gsize length;
+} PreviewCandidate;
+
+typedef struct {
+    int size;
+    int width;
+    int height;
+    gboolean too_small;
+} PreviewDecode;
+
+static guint16
+get_uint16 (const guchar *p, gboolean big_endian)
+{
+    return big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static guint32
+get_uint32 (const guchar *p, gboolean big_endian)
+{
+    return big_endian ?
+        ((guint32) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3] :
+        ((guint32) p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+static void
+add_candidate (PreviewCandidate *candidates,
+               int              *n_candidates,
+               const guchar     *data,
+               gsize             length)
+{
+    if (*n_candidates >= MAX_CANDIDATES || length < 4 ||
+        data[0] != 0xff || data[1] != 0xd8) {
+        return;
+    }
+
+    candidates[*n_candidates].data = data;
+    candidates[*n_candidates].length = length;
+    (*n_candidates)++;
+}
+
+/* The APP2 "MPF" segment is a small TIFF structure whose MP Entry tag lists
+ * every image in the file.  Offsets are relative to the TIFF header. */
+static void
+add_mpf_candidates (const guchar     *file_data,
+                    gsize             file_length,
+                    const guchar     *tiff,
+                    gsize             tiff_length,
+                    PreviewCandidate *candidates,
+                    int              *n_candidates)
+{
+    gboolean big_endian;
+    guint32 ifd_offset;
+    guint16 n_tags, i;
+    gsize tiff_position;
+
+    if (tiff_length < 8) {
+        return;
+    }
+
+    if (memcmp (tiff, "MM", 2) == 0) {
+        big_endian = TRUE;
+    } else if (memcmp (tiff, "II", 2) == 0) {
+        big_endian = FALSE;
+    } else {
+        return;
+    }
+
+    tiff_position = tiff - file_data;
+    ifd_offset = get_uint32 (tiff + 4, big_endian);
+
+    if ((gsize) ifd_offset + 2 > tiff_length) {
+        return;
+    }
+
+    n_tags = get_uint16 (tiff + ifd_offset, big_endian);
+
+    for (i = 0; i < n_tags; i++) {
+        const guchar *tag = tiff + ifd_offset + 2 + 12 * i;
+        guint32 count, value_offset, j;
+
+        if ((gsize) ifd_offset + 2 + 12 * (i + 1) > tiff_length) {
+            return;
+        }
+
+        /* MPEntry */
+        if (get_uint16 (tag, big_endian) != 0xb002) {
+            continue;
+        }
+
+        count = get_uint32 (tag + 4, big_endian);
+        value_offset = get_uint32 (tag + 8, big_endian);
+
+        if (count % 16 != 0 || (gsize) value_offset + count > tiff_length) {
+            return;
+        }
+
+        /* The first entry is the photo itself */
+        for (j = 16; j < count; j += 16) {
+            const guchar *entry = tiff + value_offset + j;
+            guint32 type, length, offset;
+
+            type = get_uint32 (entry, big_endian) & 0xffffff;
+            length = get_uint32 (entry + 4, big_endian);
+            offset = get_uint32 (entry + 8, big_endian);
+
+            /* Large thumbnail, class 1 (VGA) or class 2 (full HD) */
+            if (type != 0x010001 && type != 0x010002) {
+                continue;
+            }
+
+            if (offset == 0 || tiff_position + offset + length > file_length) {
+                continue;
+            }
+
+            add_candidate (candidates, n_candidates, file_data + tiff_position + offset, length);
+        }
+
+        return;
+    }
+}
+
+/* Walks the JPEG markers up to the start of the image data, collecting the
+ * EXIF block and any MPF previews, and the EXIF thumbnail if it could be
+ * @size. */
+static ExifData *
+scan_jpeg (const guchar     *data,
+           gsize             length,
+           int               size,
+           PreviewCandidate *candidates,
+           int              *n_candidates)
+{
+    ExifData *exif = NULL;
+    gsize position;
+
+    if (length < 4 || data[0] != 0xff || data[1] != 0xd8) {
+        return NULL;
+    }
+
+    position = 2;
+
+    while (position + 4 <= length) {
+        guchar marker;
+        gsize segment_length;
+        const guchar *payload;
+
+        if (data[position] != 0xff) {
+            break;
+        }
+
+        marker = data[position + 1];
+
+        if (marker == 0xff) {
+            position++;
+            continue;
+        }
+
+        /* Start of scan, end of image */
+        if (marker == 0xda || marker == 0xd9) {
+            break;
+        }
+
+        segment_length = (data[position + 2] << 8) | data[position + 3];
+
+        if (segment_length < 2 || position + 2 + segment_length > length) {
+            break;
+        }
+
+        payload = data + position + 4;
+        segment_length -= 2;
+
+        if (marker == 0xe1 && exif == NULL &&
+            segment_length > 6 && memcmp (payload, "Exif\0\0", 6) == 0) {
+            exif = exif_data_new_from_data (payload, segment_length);
+        } else if (marker == 0xe2 &&
+                   segment_length > 4 && memcmp (payload, "MPF\0", 4) == 0) {
+            add_mpf_candidates (data, length,
+                                payload + 4, segment_length - 4,
+                                candidates, n_candidates);
+        }
+
+        position += 2 + segment_length + 2;
+    }
+
+    if (exif != NULL && exif->data != NULL && size <= EXIF_THUMBNAIL_SIZE) {
+        add_candidate (candidates, n_candidates, exif->data, exif->size);
+    }
+
+    return exif;
+}
+
+static int
+get_exif_int (ExifData *exif,
+              ExifIfd   ifd,
+              ExifTag   tag)
+{
+    ExifEntry *entry;
+    ExifByteOrder order;
+
+    entry = exif_content_get_entry (exif->ifd[ifd], tag);
+
+    if (entry == NULL || entry->components != 1) {
+        return 0;
+    }
+
+    order = exif_data_get_byte_order (exif);
+
+    switch (entry->format) {
+        case EXIF_FORMAT_SHORT:
+            return exif_get_short (entry->data, order);
+        case EXIF_FORMAT_LONG:
+            return exif_get_long (entry->data, order);
+        default:
+            return 0;
+    }
+}
+
+static void
+preview_size_prepared (GdkPixbufLoader *loader,
+                       int              width,
+                       int              height,
+                       PreviewDecode   *decode)
+{
+    decode->width = width;
+    decode->height = height;
+
+    if (MAX (width, height) < decode->size) {
+        decode->too_small = TRUE;
+        /* Stops the loader without decoding anything */
+        gdk_pixbuf_loader_set_size (loader, 0, 0);
+        return;
+    }
+
+    if (width >= height) {
+        gdk_pixbuf_loader_set_size (loader, decode->size,
+                                    MAX (1, (int) ((gint64) height * decode->size / width)));
+    } else {
+        gdk_pixbuf_loader_set_size (loader,
+                                    MAX (1, (int) ((gint64) width * decode->size / height)),
+                                    decode->size);
+    }
+}
+
+static GdkPixbuf *
+decode_candidate (const PreviewCandidate *candidate,
+                  int                     size,
+                  int                     photo_width,
+                  int                     photo_height)
+{
+    GdkPixbufLoader *loader;
+    GdkPixbuf *pixbuf = NULL;
+    PreviewDecode decode = { size, 0, 0, FALSE };
+    gboolean ok;
+
+    loader = gdk_pixbuf_loader_new_with_type ("jpeg", NULL);
+
+    if (loader == NULL) {
+        return NULL;
+    }
+
+    g_signal_connect (loader, "size-prepared",
+                      G_CALLBACK (preview_size_prepared), &decode);
+
+    ok = gdk_pixbuf_loader_write (loader, candidate->data, candidate->length, NULL);
+    ok = gdk_pixbuf_loader_close (loader, NULL) && ok;
+
+    if (ok && !decode.too_small) {
+        pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+    }
+
+    if (pixbuf != NULL && photo_width > 0 && photo_height > 0) {
+        double preview_aspect = (double) decode.width / decode.height;
+        double photo_aspect = (double) photo_width / photo_height;
+
+        if (fabs (preview_aspect - photo_aspect) > photo_aspect * ASPECT_TOLERANCE) {
+            DEBUG ("Embedded preview %dx%d doesn't match %dx%d photo, skipping",
+                   decode.width, decode.height, photo_width, photo_height);
+            pixbuf = NULL;
+        }
+    }
+
+    if (pixbuf != NULL) {
+        g_object_ref (pixbuf);
+    }
+
+    g_object_unref (loader);
+
+    return pixbuf;
+}
+
+static int
+compare_candidates (gconstpointer a,
+                    gconstpointer b)
+{
+    const PreviewCandidate *candidate_a = a;
+    const PreviewCandidate *candidate_b = b;
+
+    return candidate_a->length < candidate_b->length ? -1 :
+           candidate_a->length > candidate_b->length ? 1 : 0;
+}
+
+static GdkPixbuf *
+apply_orientation (GdkPixbuf *pixbuf,
+                   int        orientation)
+{
+    GdkPixbuf *oriented;
+
+    /* The preview's own EXIF, if it has any, takes precedence */
+    if (gdk_pixbuf_get_option (pixbuf, "orientation") == NULL &&
+        orientation > 1 && orientation <= 8) {
+        char value[2] = { '0' + orientation, '\0' };
+
+        gdk_pixbuf_set_option (pixbuf, "orientation", value);
+    }
+
+    oriented = gdk_pixbuf_apply_embedded_orientation (pixbuf);
+    g_object_unref (pixbuf);
+
+    return oriented;
+}
+
+GdkPixbuf *
+nemo_thumbnail_preview_extract (const char *path,
+                                int         size)
+{
+    GMappedFile *mapped;
+    ExifData *exif;
+    PreviewCandidate candidates[MAX_CANDIDATES];
+    int n_candidates = 0;
+    int photo_width = 0, photo_height = 0, orientation = 0;
+    GdkPixbuf *pixbuf = NULL;
+    int i;
+
+    mapped = g_mapped_file_new (path, FALSE, NULL);
+
+    if (mapped == NULL) {
+        return NULL;
+    }
+
+    exif = scan_jpeg ((const guchar *) g_mapped_file_get_contents (mapped),
+                      g_mapped_file_get_length (mapped),
+                      size, candidates, &n_candidates);
+
+    if (exif != NULL) {
+        photo_width = get_exif_int (exif, EXIF_IFD_EXIF, EXIF_TAG_PIXEL_X_DIMENSION);
+        photo_height = get_exif_int (exif, EXIF_IFD_EXIF, EXIF_TAG_PIXEL_Y_DIMENSION);
+        orientation = get_exif_int (exif, EXIF_IFD_0, EXIF_TAG_ORIENTATION);
+    }
+
+    /* Smallest first: the cheapest preview that is big enough wins */
+    qsort (candidates, n_candidates, sizeof (PreviewCandidate), compare_candidates);
+
+    for (i = 0; i < n_candidates && pixbuf == NULL; i++) {
+        pixbuf = decode_candidate (&candidates[i], size, photo_width, photo_height);
+    }
+
+    if (pixbuf != NULL) {
+        pixbuf = apply_orientation (pixbuf, orientation);
+        DEBUG ("Using embedded preview for %s", path);
+    }
+
+    if (exif != NULL) {
+        exif_data_unref (exif);
+    }
+
+    g_mapped_file_unref (mapped);
+
+    return pixbuf;
+}
+
+#else /* HAVE_EXIF */
+
+GdkPixbuf *
+nemo_thumbnail_preview_extract (const char *path,
+                                int         size)
+{
+    return NULL;
+}
+
+#endif /* HAVE_EXIF */
@@ -0,0 +1,45 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-thumbnail-preview.h: Thumbnails from previews embedded in photos.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#ifndef NEMO_THUMBNAIL_PREVIEW_H
+#define NEMO_THUMBNAIL_PREVIEW_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+/* Camera JPEGs usually carry a small EXIF thumbnail and often a larger
+ * Multi-Picture Format preview.  If one of them is at least @size pixels on
+ * its long side and has the same aspect ratio as the photo, it is decoded,
+ * scaled to fit @size and oriented, which is far cheaper than decoding the
+ * full image.  The EXIF thumbnail is only 160 pixels, so large thumbnails
+ * can only come from an MPF preview.
+ *
+ * nemo_thumbnail_preview_can_extract () returns whether files of
+ * @mime_type might have a preview, which is never without EXIF support.
+ *
+ * nemo_thumbnail_preview_extract () returns NULL if there is no usable
+ * preview, in which case the thumbnail should be generated the usual way.
+ *
+ * Thread safe.
+ */
+gboolean   nemo_thumbnail_preview_can_extract (const char *mime_type);
+GdkPixbuf *nemo_thumbnail_preview_extract     (const char *path,
+                                               int         size);
+
+#endif /* NEMO_THUMBNAIL_PREVIEW_H */
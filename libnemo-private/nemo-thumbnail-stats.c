@@ -0,0 +1,290 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-thumbnail-stats.c: Counters for the thumbnail pipeline.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#include <config.h>
+#include "nemo-thumbnail-stats.h"
+
+#define DEBUG_FLAG NEMO_DEBUG_THUMBNAILS
+#include <libnemo-private/nemo-debug.h>
+
+/* Bucket n counts values below 2^n, so the last one is everything from
+ * 2^(N_BUCKETS - 2) up. */
+#define N_BUCKETS 20
+
+/* Log a summary after this many thumbnails */
+#define SUMMARY_INTERVAL 100
+
+typedef struct {
+    guint64 buckets[N_BUCKETS];
+    guint64 count;
+    guint64 sum;
+    guint64 max;
+} Histogram;
+
+typedef struct {
+    Histogram generation_ms;
+    guint64 failed;
+} MimeTypeStats;
+
+static GMutex stats_mutex;
+
+static Histogram queue_depth;
+static Histogram time_in_queue_ms;
+static guint64 made[NEMO_THUMBNAIL_N_SOURCES];
+static guint64 failed;
+static guint64 cancelled;
+static guint64 skipped;
+static guint64 cache_hits;
+static guint64 cache_misses;
+/* mime type -> MimeTypeStats */
+static GHashTable *mime_types = NULL;
+
+static const char *source_names[NEMO_THUMBNAIL_N_SOURCES] = {
+    "embedded preview",
+    "persistent helper",
+    "thumbnail factory"
+};
+
+static void
+histogram_add (Histogram *histogram,
+               guint64    value)
+{
+    guint bucket = 0;
+
+    while (bucket < N_BUCKETS - 1 && value >= ((guint64) 1 << bucket)) {
+        bucket++;
+    }
+
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum += value;
+    histogram->max = MAX (histogram->max, value);
+}
+
+/* Upper bound of the bucket the given fraction of values falls in */
+static guint64
+histogram_percentile (Histogram *histogram,
+                      double     fraction)
+{
+    guint64 seen = 0, wanted;
+    guint bucket;
+
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    wanted = MAX (1, (guint64) (histogram->count * fraction + 0.5));
+
+    for (bucket = 0; bucket < N_BUCKETS - 1; bucket++) {
+        seen += histogram->buckets[bucket];
+
+        if (seen >= wanted) {
+            return MIN ((guint64) 1 << bucket, histogram->max);
+        }
+    }
+
+    return histogram->max;
+}
+
+static void
+histogram_append (GString    *string,
+                  const char *label,
+                  Histogram  *histogram,
+                  const char *unit)
+{
+    g_string_append_printf (string,
+                            "%s: n=%" G_GUINT64_FORMAT " mean=%.1f%s p50<=%" G_GUINT64_FORMAT "%s"
+                            " p90<=%" G_GUINT64_FORMAT "%s p99<=%" G_GUINT64_FORMAT "%s max=%" G_GUINT64_FORMAT "%s\n",
+                            label,
+                            histogram->count,
+                            histogram->count ? (double) histogram->sum / histogram->count : 0.0, unit,
+                            histogram_percentile (histogram, 0.5), unit,
+                            histogram_percentile (histogram, 0.9), unit,
+                            histogram_percentile (histogram, 0.99), unit,
+                            histogram->max, unit);
+}
+
+void
+nemo_thumbnail_stats_queued (guint depth)
+{
+    g_mutex_lock (&stats_mutex);
+    histogram_add (&queue_depth, depth);
+    g_mutex_unlock (&stats_mutex);
+}
+
+void
+nemo_thumbnail_stats_cancelled (void)
+{
+    g_mutex_lock (&stats_mutex);
+    cancelled++;
+    g_mutex_unlock (&stats_mutex);
+}
+
+void
+nemo_thumbnail_stats_skipped (void)
+{
+    g_mutex_lock (&stats_mutex);
+    skipped++;
+    g_mutex_unlock (&stats_mutex);
+}
+
+void
+nemo_thumbnail_stats_started (gint64 time_in_queue)
+{
+    g_mutex_lock (&stats_mutex);
+    histogram_add (&time_in_queue_ms, MAX (0, time_in_queue) / 1000);
+    g_mutex_unlock (&stats_mutex);
+}
+
+void
+nemo_thumbnail_stats_finished (const char          *mime_type,
+                               NemoThumbnailSource  source,
+                               gboolean             success,
+                               gint64               elapsed)
+{
+    MimeTypeStats *stats;
+    guint64 total;
+    gint i;
+
+    g_mutex_lock (&stats_mutex);
+
+    if (mime_types == NULL) {
+        mime_types = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    }
+
+    if (mime_type == NULL) {
+        mime_type = "unknown";
+    }
+
+    stats = g_hash_table_lookup (mime_types, mime_type);
+
+    if (stats == NULL) {
+        stats = g_new0 (MimeTypeStats, 1);
+        g_hash_table_insert (mime_types, g_strdup (mime_type), stats);
+    }
+
+    histogram_add (&stats->generation_ms, MAX (0, elapsed) / 1000);
+
+    if (success) {
+        made[source]++;
+    } else {
+        stats->failed++;
+        failed++;
+    }
+
+    total = failed;
+    for (i = 0; i < NEMO_THUMBNAIL_N_SOURCES; i++) {
+        total += made[i];
+    }
+
+    g_mutex_unlock (&stats_mutex);
+
+    if (DEBUGGING && total % SUMMARY_INTERVAL == 0) {
+        char *dump = nemo_thumbnail_stats_dump ();
+        DEBUG ("\n%s", dump);
+        g_free (dump);
+    }
+}
+
+void
+nemo_thumbnail_stats_cache_lookup (gboolean hit)
+{
+    g_mutex_lock (&stats_mutex);
+
+    if (hit) {
+        cache_hits++;
+    } else {
+        cache_misses++;
+    }
+
+    g_mutex_unlock (&stats_mutex);
+}
+
+static gint
+compare_mime_type_names (gconstpointer a,
+                         gconstpointer b)
+{
+    return g_strcmp0 (*(const char **) a, *(const char **) b);
+}
+
+char *
+nemo_thumbnail_stats_dump (void)
+{
+    GString *string;
+    GPtrArray *names;
+    GHashTableIter iter;
+    gpointer key;
+    guint64 made_total = 0;
+    guint i;
+
+    string = g_string_new (NULL);
+
+    g_mutex_lock (&stats_mutex);
+
+    for (i = 0; i < NEMO_THUMBNAIL_N_SOURCES; i++) {
+        made_total += made[i];
+    }
+
+    g_string_append_printf (string,
+                            "Thumbnails made: %" G_GUINT64_FORMAT ", failed: %" G_GUINT64_FORMAT
+                            ", cancelled: %" G_GUINT64_FORMAT ", skipped: %" G_GUINT64_FORMAT "\n",
+                            made_total, failed, cancelled, skipped);
+
+    for (i = 0; i < NEMO_THUMBNAIL_N_SOURCES; i++) {
+        g_string_append_printf (string, "  from %s: %" G_GUINT64_FORMAT "\n", source_names[i], made[i]);
+    }
+
+    g_string_append_printf (string,
+                            "Decoded cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses (%.1f%% hit rate)\n",
+                            cache_hits, cache_misses,
+                            cache_hits + cache_misses ? 100.0 * cache_hits / (cache_hits + cache_misses) : 0.0);
+
+    histogram_append (string, "Queue depth when added", &queue_depth, "");
+    histogram_append (string, "Time in queue", &time_in_queue_ms, "ms");
+
+    if (mime_types != NULL) {
+        g_string_append (string, "Generation time by mime type:\n");
+
+        names = g_ptr_array_new ();
+
+        g_hash_table_iter_init (&iter, mime_types);
+        while (g_hash_table_iter_next (&iter, &key, NULL)) {
+            g_ptr_array_add (names, key);
+        }
+
+        g_ptr_array_sort (names, compare_mime_type_names);
+
+        for (i = 0; i < names->len; i++) {
+            MimeTypeStats *stats = g_hash_table_lookup (mime_types, g_ptr_array_index (names, i));
+            gchar *label;
+
+            label = g_strdup_printf ("  %s (%" G_GUINT64_FORMAT " failed)",
+                                     (char *) g_ptr_array_index (names, i), stats->failed);
+            histogram_append (string, label, &stats->generation_ms, "ms");
+            g_free (label);
+        }
+
+        g_ptr_array_free (names, TRUE);
+    }
+
+    g_mutex_unlock (&stats_mutex);
+
+    return g_string_free (string, FALSE);
+}
@@ -0,0 +1,53 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   nemo-thumbnail-stats.h: Counters for the thumbnail pipeline.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+#ifndef NEMO_THUMBNAIL_STATS_H
+#define NEMO_THUMBNAIL_STATS_H
+
+#include <glib.h>
+
+/* Counters and power-of-two histograms for queue depth, time spent queued,
+ * generation time per mime type, the decoded thumbnail cache, failures and
+ * cancellations.  A summary is logged every so often with
+ * NEMO_DEBUG=Thumbnails, and the whole lot is available from
+ * nemo_thumbnail_stats_dump () (org.Nemo.Debug.GetThumbnailStats on the
+ * bus).  Thread safe.
+ */
+
+typedef enum {
+    NEMO_THUMBNAIL_SOURCE_PREVIEW,
+    NEMO_THUMBNAIL_SOURCE_HELPER,
+    NEMO_THUMBNAIL_SOURCE_FACTORY,
+    NEMO_THUMBNAIL_N_SOURCES
+} NemoThumbnailSource;
+
+void   nemo_thumbnail_stats_queued       (guint                depth);
+void   nemo_thumbnail_stats_cancelled    (void);
+void   nemo_thumbnail_stats_skipped      (void);
+void   nemo_thumbnail_stats_started      (gint64               time_in_queue);
+void   nemo_thumbnail_stats_finished     (const char          *mime_type,
+                                          NemoThumbnailSource  source,
+                                          gboolean             success,
+                                          gint64               elapsed);
+void   nemo_thumbnail_stats_cache_lookup (gboolean             hit);
+
+char * nemo_thumbnail_stats_dump         (void);
+
+#endif /* NEMO_THUMBNAIL_STATS_H */
@@ -25,6 +25,9 @@
 
 #include <config.h>
 #include "nemo-thumbnails.h"
+#include "nemo-thumbnail-helpers.h"
+#include "nemo-thumbnail-preview.h"
+#include "nemo-thumbnail-stats.h"
 
 #define GNOME_DESKTOP_USE_UNSTABLE_API
 
@@ -63,27 +66,79 @@
 #define NEMO_THUMBNAIL_FRAME_RIGHT 3
 #define NEMO_THUMBNAIL_FRAME_BOTTOM 3
 
+/* Pixel size of GNOME_DESKTOP_THUMBNAIL_SIZE_LARGE, which the factory is made with */
+#define LARGE_THUMBNAIL_SIZE 256
+
+/* How many seconds after the last viewport change the user counts as browsing */
+#define BROWSING_TIMEOUT 3
+
+/* Failed uris remembered before the table is dropped and started over */
+#define MAX_KNOWN_FAILURES 4096
+
+/* A mime type is given a rest for MIME_TYPE_DISABLE_TIME seconds after
+ * MIME_TYPE_FAILURE_LIMIT failures in a row.  A failure that takes longer
+ * than SLOW_FAILURE_TIME seconds is probably the thumbnailer timing out,
+ * and counts double. */
+#define MIME_TYPE_FAILURE_LIMIT 6
+#define MIME_TYPE_DISABLE_TIME (5 * 60)
+#define SLOW_FAILURE_TIME 8
+
+/* Remote files get their own, smaller pool, so a slow share can't hold up
+ * local folders.  Each pool only holds this many waiting files; the rest wait
+ * in the feeder's backlog, so newly visible files don't queue behind a whole
+ * folder's worth of work. */
+#define REMOTE_MAX_THREADS 2
+#define LOCAL_MAX_QUEUED 64
+#define REMOTE_MAX_QUEUED 8
+
+/* Thumbnailers read the whole file, which isn't worth it over the network
+ * past this size. */
+#define REMOTE_MAX_FILE_SIZE (32 * 1024 * 1024)
+
+
+/* Queue priorities, lower runs first.  Files in a view's last published
+ * viewport use their distance from it (>= 0). */
+#define PRIORITY_UNKNOWN (G_MAXINT / 2)
+#define PRIORITY_OFFSCREEN G_MAXINT
 
 typedef enum {
     THUMBNAIL_ADD,
     THUMBNAIL_REMOVE,
-    THUMBNAIL_BUMP,
+    THUMBNAIL_VIEWPORT,
+    THUMBNAIL_REFILL,
     THUMBNAIL_THREAD_EXIT
 } ThumbnailCommandType;
 
+typedef enum {
+    PARTITION_LOCAL,
+    PARTITION_REMOTE,
+    N_PARTITIONS
+} ThumbnailPartitionType;
+
+struct NemoThumbnailViewport {
+    /* The view it belongs to */
+    gconstpointer owner;
+    /* uri -> GINT_TO_POINTER (distance) */
+    GHashTable *distances;
+};
+
 /* multipurpose structure used for making thumbnails, associating a uri with where the thumbnail is to be stored */
 typedef struct {
     char *image_uri;
     char *mime_type;
     time_t original_file_mtime;
     gint64 add_time;
+    gint priority;
     ThumbnailCommandType cmd_type;
+    NemoThumbnailViewport *viewport;
     guint cancelled : 1;
+    guint background : 1;
+    guint remote : 1;
 } NemoThumbnailInfo;
 
 /* How it works:
  * 
- * When nemo_create_thumbnail(), nemo_thumbnail_remove_from_queue or nemo_thumbnail_prioritize are called,
+ * When nemo_create_thumbnail(), nemo_thumbnail_remove_from_queue or nemo_thumbnail_viewport_publish are called,
  * a new NemoThumbnailInfo is made, with info->cmd_type set based on the method called.
  *
  * These are added to the feeder queue, which feeds the feeder_task thread. When a new info arrives, it gets
@@ -98,18 +153,35 @@ typedef struct {
  *   If the info is found, it gets removed from thumbnails_to_make_hash, and info->cancelled is set to TRUE, so when
  *   it comes up in the threadpool queue, it is ignored and freed.
  *
- * - nemo_thumbnail_prioritize (THUMBNAIL_BUMP): The info is looked up by uri in thumbnails_to_make_hash. If found,
- *   it gets moved to the front of the threadpool queue.
+ * - Local and remote files are made in separate threadpools (ThumbnailPartition). Each pool is only fed
+ *   max_queued infos at a time, the rest wait in the partition's backlog. When a worker finishes and
+ *   there's a backlog, it sends THUMBNAIL_REFILL and the feeder tops the pool up, best priority first.
+ *
+ * - nemo_thumbnail_viewport_publish (THUMBNAIL_VIEWPORT): Views send one of these per scroll, listing the
+ *   files being thumbnailed that are on or near screen along with their distance from it. It replaces that
+ *   view's last one, and every queued info gets its priority from the closest any view has it (queued files
+ *   no view has are demoted to PRIORITY_OFFSCREEN), then the threadpool queue is resorted once. The viewports
+ *   are kept to prioritize files added later, until their view withdraws them.
  *
  *
  * - No mutex locking occurs in the public methods, only in the feeder and threadpool threads.
  * - NemoThumbnailInfos are garbage-collected in the threadpool worker only.
  */
 
-/* Workers that actually make the thumbnail. */
-static volatile GThreadPool *tpool = NULL;
-
-/* Table of uris queued to the thread pool (tpool) */
+typedef struct {
+    /* Workers that actually make the thumbnail. */
+    GThreadPool *pool;
+    guint max_queued;
+    /* Infos waiting for room in the pool. Feeder thread only. */
+    GPtrArray *backlog;
+    gboolean backlog_sorted;
+    /* backlog->len, for the workers */
+    gint backlog_length;
+} ThumbnailPartition;
+
+static ThumbnailPartition partitions[N_PARTITIONS];
+
+/* Table of uris queued to the thread pools, and in their backlogs */
 static GMutex thumbnails_mutex;
 static GHashTable *thumbnails_to_make_hash = NULL;
 
@@ -122,6 +194,25 @@ GCancellable *cancellable = NULL;
 
 static GnomeDesktopThumbnailFactory *thumbnail_factory = NULL;
 
+/* The last viewport published by each view, by owner. Only touched in the
+ * feeder thread. */
+static GHashTable *viewports = NULL;
+
+/* Monotonic time, in seconds, of the last nemo_thumbnail_viewport_publish () */
+static gint last_viewport_time = 0;
+
+typedef struct {
+    gint consecutive_failures;
+    gint64 disabled_until;
+} MimeTypeFailures;
+
+/* Outlive the NemoFiles, so broken files aren't retried on every visit */
+static GMutex failures_mutex;
+/* uri -> GSIZE_TO_POINTER (mtime) */
+static GHashTable *known_failures = NULL;
+/* mime type -> MimeTypeFailures */
+static GHashTable *mime_type_failures = NULL;
+
 static gint
 get_max_threads (void) {
     gint max_threads = 1;
@@ -154,17 +245,57 @@ get_max_threads (void) {
     return max_threads;
 }
 
+/* Closest to the viewport first, then most recently added first */
 static gint
-lifo_sorter (gconstpointer a,
-             gconstpointer b,
-             gpointer      data)
+priority_sorter (gconstpointer a,
+                 gconstpointer b,
+                 gpointer      data)
 {
-    gint64 ta = ((const NemoThumbnailInfo *) a)->add_time;
-    gint64 tb = ((const NemoThumbnailInfo *) b)->add_time;
+    const NemoThumbnailInfo *info_a = a;
+    const NemoThumbnailInfo *info_b = b;
+    gint64 ta, tb;
+
+    if (info_a->priority != info_b->priority) {
+        return info_a->priority < info_b->priority ? -1 : +1;
+    }
+
+    ta = info_a->add_time;
+    tb = info_b->add_time;
 
     return tb > ta ? +1 : ta == tb ? 0 : -1;
 }
 
+static void
+viewport_free (NemoThumbnailViewport *viewport)
+{
+    g_hash_table_destroy (viewport->distances);
+    g_free (viewport);
+}
+
+/* Feeder thread
+ *
+ * The closest any view has @uri, since the queue doesn't know which view
+ * asked for it.
+ */
+static gint
+get_viewport_priority (const char *uri,
+                       gint        fallback)
+{
+    NemoThumbnailViewport *viewport;
+    GHashTableIter iter;
+    gpointer distance;
+    gint priority = G_MAXINT;
+
+    g_hash_table_iter_init (&iter, viewports);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &viewport)) {
+        if (g_hash_table_lookup_extended (viewport->distances, uri, NULL, &distance)) {
+            priority = MIN (priority, GPOINTER_TO_INT (distance));
+        }
+    }
+
+    return priority != G_MAXINT ? priority : fallback;
+}
+
 static gboolean
 get_file_mtime (const char *file_uri, time_t* mtime)
 {
@@ -190,11 +321,41 @@ get_file_mtime (const char *file_uri, time_t* mtime)
     return ret;
 }
 
+/* The one test of whether thumbnailing a file means reading it over the
+ * network, for views and background thumbnailing alike.  Native files, and
+ * the trash and recent files that are backed by them, are local. */
+static gboolean
+uri_is_remote (const char *uri)
+{
+    return eel_uri_is_network (uri) ||
+           !(g_str_has_prefix (uri, "file:") ||
+             g_str_has_prefix (uri, "trash:") ||
+             g_str_has_prefix (uri, "recent:"));
+}
+
+static gboolean
+file_is_remote (NemoFile *file)
+{
+    g_autofree gchar *uri = NULL;
+
+    uri = nemo_file_get_uri (file);
+
+    return uri_is_remote (uri);
+}
+
+static gboolean
+too_big_to_fetch (goffset  size,
+                  gboolean remote)
+{
+    return remote && size > REMOTE_MAX_FILE_SIZE;
+}
+
 static void
 free_thumbnail_info (NemoThumbnailInfo *info)
 {
     g_free (info->image_uri);
     g_free (info->mime_type);
+    g_clear_pointer (&info->viewport, viewport_free);
     g_free (info);
 }
 
@@ -212,6 +373,112 @@ get_thumbnail_factory (void)
     return thumbnail_factory;
 }
 
+/* Any thread */
+static void
+record_thumbnail_result (NemoThumbnailInfo *info,
+                         gboolean           success,
+                         gint64             elapsed)
+{
+    MimeTypeFailures *failures;
+
+    g_mutex_lock (&failures_mutex);
+
+    if (known_failures == NULL) {
+        known_failures = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        mime_type_failures = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    }
+
+    failures = g_hash_table_lookup (mime_type_failures, info->mime_type ? info->mime_type : "");
+
+    if (failures == NULL) {
+        failures = g_new0 (MimeTypeFailures, 1);
+        g_hash_table_insert (mime_type_failures, g_strdup (info->mime_type ? info->mime_type : ""), failures);
+    }
+
+    if (success) {
+        g_hash_table_remove (known_failures, info->image_uri);
+        failures->consecutive_failures = 0;
+        g_mutex_unlock (&failures_mutex);
+        return;
+    }
+
+    if (g_hash_table_size (known_failures) >= MAX_KNOWN_FAILURES) {
+        g_hash_table_remove_all (known_failures);
+    }
+
+    g_hash_table_insert (known_failures,
+                         g_strdup (info->image_uri),
+                         GSIZE_TO_POINTER ((gsize) info->original_file_mtime));
+
+    failures->consecutive_failures += elapsed > SLOW_FAILURE_TIME * G_USEC_PER_SEC ? 2 : 1;
+
+    if (failures->consecutive_failures >= MIME_TYPE_FAILURE_LIMIT) {
+        DEBUG ("Thumbnailer for %s keeps failing, disabling it for %d seconds",
+               info->mime_type, MIME_TYPE_DISABLE_TIME);
+
+        failures->consecutive_failures = 0;
+        failures->disabled_until = g_get_monotonic_time () + MIME_TYPE_DISABLE_TIME * G_USEC_PER_SEC;
+    }
+
+    g_mutex_unlock (&failures_mutex);
+}
+
+/* Any thread */
+gboolean
+nemo_thumbnail_is_known_failure (const char *file_uri,
+                                 time_t      mtime)
+{
+    gpointer failed_mtime;
+    gboolean ret = FALSE;
+
+    g_mutex_lock (&failures_mutex);
+
+    if (known_failures != NULL &&
+        g_hash_table_lookup_extended (known_failures, file_uri, NULL, &failed_mtime)) {
+        ret = (time_t) GPOINTER_TO_SIZE (failed_mtime) == mtime;
+    }
+
+    g_mutex_unlock (&failures_mutex);
+
+    return ret;
+}
+
+/* Any thread */
+gboolean
+nemo_thumbnail_mime_type_is_disabled (const char *mime_type)
+{
+    MimeTypeFailures *failures;
+    gboolean ret = FALSE;
+
+    if (mime_type == NULL) {
+        return FALSE;
+    }
+
+    g_mutex_lock (&failures_mutex);
+
+    if (mime_type_failures != NULL &&
+        (failures = g_hash_table_lookup (mime_type_failures, mime_type)) != NULL) {
+        ret = failures->disabled_until > g_get_monotonic_time ();
+    }
+
+    g_mutex_unlock (&failures_mutex);
+
+    return ret;
+}
+
+/* Mainloop */
+void
+nemo_thumbnail_forget_failure (const char *file_uri)
+{
+    g_mutex_lock (&failures_mutex);
+
+    if (known_failures != NULL) {
+        g_hash_table_remove (known_failures, file_uri);
+    }
+
+    g_mutex_unlock (&failures_mutex);
+}
+
 static GdkPixbuf *
 nemo_get_thumbnail_frame (void)
 {
@@ -299,15 +566,53 @@ thumbnail_thread_notify_file_changed (gpointer image_uri)
     return G_SOURCE_REMOVE;
 }
 
+/* Mainloop */
+static gboolean
+thumbnail_thread_notify_existing_file_changed (gpointer image_uri)
+{
+    NemoFile *file;
+
+    /* Background thumbnails are mostly for files nobody is looking at, so
+     * don't create (and load) a NemoFile for each of them. */
+    file = nemo_file_get_existing_by_uri ((char *) image_uri);
+
+    if (file != NULL) {
+        nemo_file_set_is_thumbnailing (file, FALSE);
+        nemo_file_invalidate_attributes (file,
+                                         NEMO_FILE_ATTRIBUTE_THUMBNAIL |
+                                         NEMO_FILE_ATTRIBUTE_INFO);
+        nemo_file_unref (file);
+    }
+
+    g_free (image_uri);
+
+    return G_SOURCE_REMOVE;
+}
+
 /* Always on thumbnail thread */
 static void
 remove_from_hash_table (NemoThumbnailInfo *info)
 {
+    ThumbnailPartition *partition;
+
+    partition = &partitions[info->remote ? PARTITION_REMOTE : PARTITION_LOCAL];
+
     g_mutex_lock (&thumbnails_mutex);
     g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
     g_mutex_unlock (&thumbnails_mutex);
 
     free_thumbnail_info (info);
+
+    /* There's room in the pool now */
+    if (g_atomic_int_get (&partition->backlog_length) > 0 &&
+        !g_cancellable_is_cancelled (cancellable)) {
+        NemoThumbnailInfo *refill;
+
+        refill = g_new0 (NemoThumbnailInfo, 1);
+        refill->cmd_type = THUMBNAIL_REFILL;
+
+        g_async_queue_push (feeder_queue, refill);
+    }
 }
 
 /* Thumbnail thread */
@@ -316,10 +621,13 @@ thumbnail_thread (gpointer data,
                   gpointer user_data)
 {
     NemoThumbnailInfo *info = (NemoThumbnailInfo *) data;
-    GdkPixbuf *pixbuf;
+    GdkPixbuf *pixbuf = NULL;
     time_t current_time;
+    gint64 start_time, elapsed;
     gchar *image_uri = info->image_uri;
     gboolean free_uri = FALSE;
+    gboolean handled_by_helper = FALSE;
+    NemoThumbnailSource source = NEMO_THUMBNAIL_SOURCE_FACTORY;
 
     if (g_cancellable_is_cancelled (cancellable) || info->cancelled) {
         DEBUG ("Skipping cancelled file: %s", info->image_uri);
@@ -338,6 +646,21 @@ thumbnail_thread (gpointer data,
         /* Reschedule thumbnailing via a change notification */
         g_timeout_add_seconds (RECENT_MTIME_COOLDOWN, thumbnail_thread_notify_file_changed,
                                g_strdup (info->image_uri));
+        nemo_thumbnail_stats_skipped ();
+        remove_from_hash_table (info);
+        return;
+    }
+
+    /* Another file of the same type may have just used up its thumbnailer's
+       chances. Its views check again once the type is allowed back. */
+    if (nemo_thumbnail_mime_type_is_disabled (info->mime_type)) {
+        DEBUG ("(Thumbnail Thread) Thumbnailing %s is disabled for now, skipping: %s",
+               info->mime_type, info->image_uri);
+
+        g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+                         thumbnail_thread_notify_existing_file_changed,
+                         g_strdup (info->image_uri), NULL);
+        nemo_thumbnail_stats_skipped ();
         remove_from_hash_table (info);
         return;
     }
@@ -345,7 +668,38 @@ thumbnail_thread (gpointer data,
     /* Create the thumbnail. */
     DEBUG ("(Thumbnail Thread) Creating thumbnail: %s", info->image_uri);
 
-    if (eel_uri_is_network (info->image_uri)) {
+    start_time = g_get_monotonic_time ();
+    nemo_thumbnail_stats_started (start_time - info->add_time);
+
+    /* Photos usually carry a preview that is much cheaper to scale down than
+       decoding the whole image. */
+    if (nemo_thumbnail_preview_can_extract (info->mime_type)) {
+        GFile *file = g_file_new_for_uri (info->image_uri);
+        gchar *path = g_file_get_path (file);
+
+        if (path != NULL) {
+            pixbuf = nemo_thumbnail_preview_extract (path, LARGE_THUMBNAIL_SIZE);
+            g_free (path);
+        }
+
+        if (pixbuf != NULL) {
+            source = NEMO_THUMBNAIL_SOURCE_PREVIEW;
+        }
+
+        g_object_unref (file);
+    }
+
+    /* Thumbnailers that can stay running save a fork and exec per file */
+    if (pixbuf == NULL) {
+        pixbuf = nemo_thumbnail_helpers_generate (info->image_uri, info->mime_type,
+                                                  LARGE_THUMBNAIL_SIZE, &handled_by_helper);
+
+        if (handled_by_helper) {
+            source = NEMO_THUMBNAIL_SOURCE_HELPER;
+        }
+    }
+
+    if (pixbuf == NULL && !handled_by_helper && eel_uri_is_network (info->image_uri)) {
         GFile *file = g_file_new_for_uri (info->image_uri);
         GError *err = NULL;
         free_uri = TRUE;
@@ -367,13 +721,20 @@ thumbnail_thread (gpointer data,
      * because of that we have to convert our path from the network URI to a local file:// URI or else any
      * thumbnailers that use %i wont generate thumbnails correctly
      */
-    pixbuf = gnome_desktop_thumbnail_factory_generate_thumbnail (thumbnail_factory,
-                                                                 image_uri,
-                                                                 info->mime_type);
+    if (pixbuf == NULL && !handled_by_helper) {
+        pixbuf = gnome_desktop_thumbnail_factory_generate_thumbnail (thumbnail_factory,
+                                                                     image_uri,
+                                                                     info->mime_type);
+    }
+
     if (free_uri) {
         g_free (image_uri);
     }
 
+    elapsed = g_get_monotonic_time () - start_time;
+    record_thumbnail_result (info, pixbuf != NULL, elapsed);
+    nemo_thumbnail_stats_finished (info->mime_type, source, pixbuf != NULL, elapsed);
+
     if (pixbuf) {
         gnome_desktop_thumbnail_factory_save_thumbnail (thumbnail_factory,
                                                         pixbuf,
@@ -389,12 +750,13 @@ thumbnail_thread (gpointer data,
     /* We need to call nemo_file_changed(), but I don't think that is
        thread safe. So add an idle handler and do it from the main loop. */
     g_idle_add_full (G_PRIORITY_HIGH_IDLE,
-                     thumbnail_thread_notify_file_changed,
+                     info->background ? thumbnail_thread_notify_existing_file_changed :
+                                        thumbnail_thread_notify_file_changed,
                      g_strdup (info->image_uri), NULL);
 
 #if DEBUG_THREADS
     g_message ("%u unprocessed (Done) (%u threads free)",
-               g_thread_pool_unprocessed ((GThreadPool *) tpool),
+               g_thread_pool_unprocessed (partitions[info->remote ? PARTITION_REMOTE : PARTITION_LOCAL].pool),
                g_thread_pool_get_num_unused_threads ());
 #endif
     remove_from_hash_table (info);
@@ -410,6 +772,60 @@ feeder_task_complete (GObject      *source,
     DEBUG ("(Finalize) Feeder task done");
 }
 
+/* Backlog sort: best priority last, so it can be popped off the end */
+static gint
+backlog_sorter (gconstpointer a,
+                gconstpointer b)
+{
+    return priority_sorter (*(NemoThumbnailInfo **) b, *(NemoThumbnailInfo **) a, NULL);
+}
+
+/* Feeder thread, with thumbnails_mutex held */
+static void
+partition_refill (ThumbnailPartition *partition)
+{
+    NemoThumbnailInfo *info;
+
+    if (partition->backlog->len == 0 ||
+        g_thread_pool_unprocessed (partition->pool) >= partition->max_queued) {
+        return;
+    }
+
+    if (!partition->backlog_sorted) {
+        g_ptr_array_sort (partition->backlog, backlog_sorter);
+        partition->backlog_sorted = TRUE;
+    }
+
+    while (partition->backlog->len > 0 &&
+           g_thread_pool_unprocessed (partition->pool) < partition->max_queued) {
+        /* Cancelled ones too, the workers free them */
+        info = g_ptr_array_remove_index (partition->backlog, partition->backlog->len - 1);
+        g_thread_pool_push (partition->pool, info, NULL);
+    }
+
+    g_atomic_int_set (&partition->backlog_length, partition->backlog->len);
+}
+
+/* Feeder thread, with thumbnails_mutex held */
+static void
+partition_push (NemoThumbnailInfo *info)
+{
+    ThumbnailPartition *partition;
+
+    partition = &partitions[info->remote ? PARTITION_REMOTE : PARTITION_LOCAL];
+
+    if (partition->backlog->len == 0 &&
+        g_thread_pool_unprocessed (partition->pool) < partition->max_queued) {
+        g_thread_pool_push (partition->pool, info, NULL);
+        return;
+    }
+
+    g_ptr_array_add (partition->backlog, info);
+    partition->backlog_sorted = FALSE;
+
+    partition_refill (partition);
+}
+
 /* Feeder thread */
 static void
 feeder_thread (GTask        *task,
@@ -426,6 +842,8 @@ feeder_thread (GTask        *task,
 #endif
         NemoThumbnailInfo *feeder_info = (NemoThumbnailInfo *) data;
         NemoThumbnailInfo *existing_info = NULL;
+        GHashTableIter iter;
+        gint i;
 
         switch (feeder_info->cmd_type) {
             case THUMBNAIL_ADD:
@@ -436,20 +854,31 @@ feeder_thread (GTask        *task,
                 if (existing_info == NULL) {
                     DEBUG ("(Main Thread) Adding new file to thumbnail: %s", feeder_info->image_uri);
 #if DEBUG_THREADS
-                    g_message ("%u unprocessed (Add)", g_thread_pool_unprocessed ((GThreadPool *) tpool));
+                    g_message ("%u unprocessed (Add)", g_hash_table_size (thumbnails_to_make_hash));
 #endif
+                    feeder_info->priority = get_viewport_priority (feeder_info->image_uri,
+                                                                   feeder_info->background ? PRIORITY_OFFSCREEN :
+                                                                                             PRIORITY_UNKNOWN);
                     g_hash_table_insert (thumbnails_to_make_hash, feeder_info->image_uri, feeder_info);
-                    g_thread_pool_push ((GThreadPool *) tpool, feeder_info, NULL);
+                    partition_push (feeder_info);
+                    nemo_thumbnail_stats_queued (g_hash_table_size (thumbnails_to_make_hash));
 
                     // Don't free this later.
                     feeder_info = NULL;
-                } else {
+                } else if (!feeder_info->background) {
                     DEBUG ("(Main Thread) Updating existing file mtime and prioritizing: %s", feeder_info->image_uri);
 
                     /* The file in the queue might need a new original mtime */
                     existing_info->original_file_mtime = feeder_info->original_file_mtime;
                     existing_info->add_time = g_get_monotonic_time ();
-                    g_thread_pool_move_to_front ((GThreadPool *) tpool, existing_info);
+                    existing_info->priority = get_viewport_priority (existing_info->image_uri, 0);
+
+                    ThumbnailPartition *partition = &partitions[existing_info->remote ? PARTITION_REMOTE :
+                                                                                      PARTITION_LOCAL];
+
+                    /* Fails harmlessly if it's still in the backlog */
+                    g_thread_pool_move_to_front (partition->pool, existing_info);
+                    partition->backlog_sorted = FALSE;
                 }
                 DEBUG ("(Add thumbnail) Unlocking mutex");
                 g_mutex_unlock (&thumbnails_mutex);
@@ -466,24 +895,51 @@ feeder_thread (GTask        *task,
                     DEBUG ("(Remove from queue) Removing %s", feeder_info->image_uri);
                     g_hash_table_remove (thumbnails_to_make_hash, feeder_info->image_uri);
                     existing_info->cancelled = TRUE;
+                    nemo_thumbnail_stats_cancelled ();
                 }
                 DEBUG ("(Remove from queue) Unlocking mutex");
                 g_mutex_unlock (&thumbnails_mutex);
                 break;
-            case THUMBNAIL_BUMP:
+            case THUMBNAIL_VIEWPORT:
                 if (!thumbnails_to_make_hash)
                     break;
 
-                DEBUG ("(Prioritize) Locking mutex");
+                /* An empty one is the view withdrawing */
+                if (g_hash_table_size (feeder_info->viewport->distances) > 0) {
+                    g_hash_table_replace (viewports, (gpointer) feeder_info->viewport->owner, feeder_info->viewport);
+                    feeder_info->viewport = NULL;
+                } else {
+                    g_hash_table_remove (viewports, feeder_info->viewport->owner);
+                }
+
+                DEBUG ("(Viewport) Locking mutex");
                 g_mutex_lock (&thumbnails_mutex);
-                existing_info = g_hash_table_lookup (thumbnails_to_make_hash, feeder_info->image_uri);
 
-                if (existing_info) {
-                    DEBUG ("(Prioritize) Moving to front: %s", feeder_info->image_uri);
-                    existing_info->add_time = g_get_monotonic_time ();
-                    g_thread_pool_move_to_front ((GThreadPool *) tpool, existing_info);
+                g_hash_table_iter_init (&iter, thumbnails_to_make_hash);
+                while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &existing_info)) {
+                    existing_info->priority = get_viewport_priority (existing_info->image_uri, PRIORITY_OFFSCREEN);
                 }
-                DEBUG ("(Prioritize) Unlocking mutex");
+
+                DEBUG ("(Viewport) %u views, %u queued, resorting",
+                       g_hash_table_size (viewports),
+                       g_hash_table_size (thumbnails_to_make_hash));
+
+                for (i = 0; i < N_PARTITIONS; i++) {
+                    /* Setting the sort function resorts everything already queued */
+                    g_thread_pool_set_sort_function (partitions[i].pool, (GCompareDataFunc) priority_sorter, NULL);
+                    partitions[i].backlog_sorted = FALSE;
+                }
+
+                DEBUG ("(Viewport) Unlocking mutex");
+                g_mutex_unlock (&thumbnails_mutex);
+                break;
+            case THUMBNAIL_REFILL:
+                g_mutex_lock (&thumbnails_mutex);
+
+                for (i = 0; i < N_PARTITIONS; i++) {
+                    partition_refill (&partitions[i]);
+                }
+
                 g_mutex_unlock (&thumbnails_mutex);
                 break;
             case THUMBNAIL_THREAD_EXIT:
@@ -503,6 +959,7 @@ finalize_thumbnailer (void)
 {
     NemoThumbnailInfo *info;
     gpointer data;
+    gint i;
 
     if (feeder_queue == NULL)
         return;
@@ -518,6 +975,17 @@ finalize_thumbnailer (void)
         gtk_main_iteration ();
     }
 
+    for (i = 0; i < N_PARTITIONS; i++) {
+        // This will drain and free any remaining infos.
+        g_thread_pool_free (partitions[i].pool, FALSE, TRUE);
+
+        g_ptr_array_foreach (partitions[i].backlog, (GFunc) free_thumbnail_info, NULL);
+        g_ptr_array_free (partitions[i].backlog, TRUE);
+    }
+
+    nemo_thumbnail_helpers_shutdown ();
+
+    /* Including any refills the workers sent on their way out */
     while ((data = g_async_queue_try_pop (feeder_queue))) {
         if (!data) {
             break;
@@ -529,26 +997,42 @@ finalize_thumbnailer (void)
     g_object_unref (feeder_task);
     g_async_queue_unref (feeder_queue);
 
-    // This will drain and free any remaining infos.
-    g_thread_pool_free ((GThreadPool *) tpool, FALSE, TRUE);
-
     g_hash_table_destroy (thumbnails_to_make_hash);
+    g_hash_table_destroy (viewports);
+
+    if (DEBUGGING) {
+        gchar *stats = nemo_thumbnail_stats_dump ();
+        DEBUG ("(Finalize) Thumbnail statistics:\n%s", stats);
+        g_free (stats);
+    }
 }
 
 /* Mainloop */
-void
-nemo_create_thumbnail (NemoFile *file)
+static void
+ensure_thumbnailer (void)
 {
-    time_t file_mtime = 0;
     static gsize once_init = 0;
+    gint i;
+
     if (g_once_init_enter (&once_init)) {
         thumbnails_to_make_hash = g_hash_table_new (g_str_hash, g_str_equal);
+        viewports = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) viewport_free);
         DEBUG ("Initialize thread pool");
 
-        tpool = g_thread_pool_new ((GFunc) thumbnail_thread, NULL,
-                                   get_max_threads (),
-                                   FALSE, NULL);
-        g_thread_pool_set_sort_function ((GThreadPool *) tpool, (GCompareDataFunc) lifo_sorter, NULL);
+        partitions[PARTITION_LOCAL].pool = g_thread_pool_new ((GFunc) thumbnail_thread, NULL,
+                                                              get_max_threads (),
+                                                              FALSE, NULL);
+        partitions[PARTITION_LOCAL].max_queued = LOCAL_MAX_QUEUED;
+
+        partitions[PARTITION_REMOTE].pool = g_thread_pool_new ((GFunc) thumbnail_thread, NULL,
+                                                               MIN (REMOTE_MAX_THREADS, get_max_threads ()),
+                                                               FALSE, NULL);
+        partitions[PARTITION_REMOTE].max_queued = REMOTE_MAX_QUEUED;
+
+        for (i = 0; i < N_PARTITIONS; i++) {
+            g_thread_pool_set_sort_function (partitions[i].pool, (GCompareDataFunc) priority_sorter, NULL);
+            partitions[i].backlog = g_ptr_array_new ();
+        }
 
         feeder_queue = g_async_queue_new ();
         cancellable = g_cancellable_new ();
@@ -559,6 +1043,14 @@ nemo_create_thumbnail (NemoFile *file)
 
         g_once_init_leave (&once_init, 1);
     }
+}
+
+void
+nemo_create_thumbnail (NemoFile *file)
+{
+    time_t file_mtime = 0;
+
+    ensure_thumbnailer ();
 
     /* The gdk-pixbuf-thumbnailer tool has special hardcoded handling for recent: and trash: uris.
      * we need to find the activation uri here instead */
@@ -593,6 +1085,7 @@ nemo_create_thumbnail (NemoFile *file)
     NemoThumbnailInfo *info;
     info = g_new0 (NemoThumbnailInfo, 1);
     info->image_uri = file_uri;
+    info->remote = file_is_remote (file);
     info->mime_type = nemo_file_get_mime_type (file);
     info->original_file_mtime = file_mtime;
     info->add_time = g_get_monotonic_time ();
@@ -607,6 +1100,92 @@ nemo_create_thumbnail (NemoFile *file)
     g_async_queue_push (feeder_queue, info);
 }
 
+/* Mainloop */
+void
+nemo_thumbnail_background_begin (void)
+{
+    ensure_thumbnailer ();
+    get_thumbnail_factory ();
+}
+
+/* Any thread, after nemo_thumbnail_background_begin ()
+ *
+ * Queues @file_uri behind everything the views want, unless it already has a
+ * thumbnail (or a failed one), no thumbnailer handles it or it's too big to
+ * read over the network.  Returns whether it was queued.
+ */
+gboolean
+nemo_thumbnail_queue_background (const char *file_uri,
+                                 const char *mime_type,
+                                 time_t      mtime,
+                                 goffset     size)
+{
+    NemoThumbnailInfo *info;
+    gchar *existing;
+    gboolean remote;
+
+    g_return_val_if_fail (feeder_queue != NULL, FALSE);
+
+    remote = uri_is_remote (file_uri);
+
+    if (too_big_to_fetch (size, remote) ||
+        nemo_thumbnail_is_known_failure (file_uri, mtime) ||
+        nemo_thumbnail_mime_type_is_disabled (mime_type)) {
+        return FALSE;
+    }
+
+    existing = gnome_desktop_thumbnail_factory_lookup (thumbnail_factory, file_uri, mtime);
+
+    if (existing != NULL) {
+        g_free (existing);
+        return FALSE;
+    }
+
+    if (!gnome_desktop_thumbnail_factory_can_thumbnail (thumbnail_factory, file_uri, mime_type, mtime)) {
+        return FALSE;
+    }
+
+    info = g_new0 (NemoThumbnailInfo, 1);
+    info->image_uri = g_strdup (file_uri);
+    info->mime_type = g_strdup (mime_type);
+    info->original_file_mtime = mtime;
+    info->add_time = g_get_monotonic_time ();
+    info->cmd_type = THUMBNAIL_ADD;
+    info->background = TRUE;
+    info->remote = remote;
+
+    g_async_queue_push (feeder_queue, info);
+
+    return TRUE;
+}
+
+/* Any thread */
+guint
+nemo_thumbnail_get_n_queued (void)
+{
+    guint n_queued = 0;
+
+    if (feeder_queue == NULL) {
+        return 0;
+    }
+
+    g_mutex_lock (&thumbnails_mutex);
+    n_queued = g_hash_table_size (thumbnails_to_make_hash);
+    g_mutex_unlock (&thumbnails_mutex);
+
+    /* Adds the feeder hasn't got to yet */
+    return n_queued + MAX (0, g_async_queue_length (feeder_queue));
+}
+
+/* Any thread */
+gboolean
+nemo_thumbnail_user_is_browsing (void)
+{
+    gint last = g_atomic_int_get (&last_viewport_time);
+
+    return last != 0 && g_get_monotonic_time () / G_USEC_PER_SEC - last < BROWSING_TIMEOUT;
+}
+
 /* Mainloop */
 void
 nemo_thumbnail_remove_from_queue (const char *file_uri)
@@ -627,26 +1206,78 @@ nemo_thumbnail_remove_from_queue (const char *file_uri)
     g_async_queue_push (feeder_queue, info);
 }
 
+/* Mainloop */
+NemoThumbnailViewport *
+nemo_thumbnail_viewport_new (gconstpointer owner)
+{
+    NemoThumbnailViewport *viewport;
+
+    viewport = g_new0 (NemoThumbnailViewport, 1);
+    viewport->owner = owner;
+    viewport->distances = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    return viewport;
+}
+
 /* Mainloop */
 void
-nemo_thumbnail_prioritize (const char *file_uri)
+nemo_thumbnail_viewport_add (NemoThumbnailViewport *viewport,
+                             const char            *file_uri,
+                             gint                   distance)
 {
-    if (feeder_queue == NULL)
-        return;
+    g_return_if_fail (viewport != NULL);
+    g_return_if_fail (file_uri != NULL);
+
+    distance = CLAMP (distance, 0, PRIORITY_UNKNOWN - 1);
+
+    g_hash_table_insert (viewport->distances, g_strdup (file_uri), GINT_TO_POINTER (distance));
+}
 
+static void
+push_viewport (NemoThumbnailViewport *viewport)
+{
     NemoThumbnailInfo *info;
 
+    if (feeder_queue == NULL) {
+        viewport_free (viewport);
+        return;
+    }
+
     info = g_new0 (NemoThumbnailInfo, 1);
-    info->image_uri = g_strdup (file_uri);
-    info->cmd_type = THUMBNAIL_BUMP;
+    info->viewport = viewport;
+    info->cmd_type = THUMBNAIL_VIEWPORT;
 
 #if DEBUG_THREADS
-    g_message ("Push to feeder (Bump) %i items in feeder", g_async_queue_length (feeder_queue));
+    g_message ("Push to feeder (Viewport) %i items in feeder", g_async_queue_length (feeder_queue));
 #endif
 
     g_async_queue_push (feeder_queue, info);
 }
 
+/* Mainloop
+ *
+ * Takes ownership of @viewport.
+ */
+void
+nemo_thumbnail_viewport_publish (NemoThumbnailViewport *viewport)
+{
+    g_return_if_fail (viewport != NULL);
+
+    g_atomic_int_set (&last_viewport_time, (gint) (g_get_monotonic_time () / G_USEC_PER_SEC));
+
+    push_viewport (viewport);
+}
+
+/* Mainloop
+ *
+ * Forgets @owner's viewport, for when the view goes away.
+ */
+void
+nemo_thumbnail_viewport_withdraw (gconstpointer owner)
+{
+    push_viewport (nemo_thumbnail_viewport_new (owner));
+}
+
 gboolean
 nemo_can_thumbnail_internally (NemoFile *file)
 {
@@ -669,6 +1300,10 @@ nemo_can_thumbnail (NemoFile *file)
     mime_type = nemo_file_get_mime_type (file);
     mtime = nemo_file_get_mtime (file);
     
+    if (too_big_to_fetch (nemo_file_get_size (file), file_is_remote (file))) {
+        return FALSE;
+    }
+
     factory = get_thumbnail_factory ();
     res = gnome_desktop_thumbnail_factory_can_thumbnail (factory,
                                                          uri,
@@ -40,7 +40,37 @@ void       nemo_thumbnail_pad_top_and_bottom    (GdkPixbuf **pixbuf,
                                                  gint        extra_height);
 /* Queue handling: */
 void       nemo_thumbnail_remove_from_queue     (const char   *file_uri);
-void       nemo_thumbnail_prioritize            (const char   *file_uri);
+
+/* Views publish the files being thumbnailed on or near screen, with their
+ * distance from it, as one batch per scroll, and withdraw it when they go
+ * away. Queued files closest to any view's viewport are thumbnailed first;
+ * everything else queued is demoted. */
+typedef struct NemoThumbnailViewport NemoThumbnailViewport;
+
+NemoThumbnailViewport *nemo_thumbnail_viewport_new     (gconstpointer          owner);
+void       nemo_thumbnail_viewport_add          (NemoThumbnailViewport *viewport,
+                                                 const char            *file_uri,
+                                                 gint                   distance);
+void       nemo_thumbnail_viewport_publish      (NemoThumbnailViewport *viewport);
+void       nemo_thumbnail_viewport_withdraw     (gconstpointer          owner);
+
+/* Failures are remembered for the life of the process, so files that can't
+ * be thumbnailed aren't retried every time their folder is shown, and mime
+ * types whose thumbnailer keeps failing are left alone for a while. */
+gboolean   nemo_thumbnail_is_known_failure      (const char   *file_uri,
+                                                 time_t        mtime);
+gboolean   nemo_thumbnail_mime_type_is_disabled (const char   *mime_type);
+void       nemo_thumbnail_forget_failure        (const char   *file_uri);
+
+/* Thumbnailing files nobody is looking at yet, for
+ * nemo_file_operations_generate_thumbnails (). */
+void       nemo_thumbnail_background_begin      (void);
+gboolean   nemo_thumbnail_queue_background      (const char   *file_uri,
+                                                 const char   *mime_type,
+                                                 time_t        mtime,
+                                                 goffset       size);
+guint      nemo_thumbnail_get_n_queued          (void);
+gboolean   nemo_thumbnail_user_is_browsing      (void);
 
 gboolean   nemo_thumbnail_factory_check_status          (void);
 
@@ -0,0 +1,85 @@
+/* Nemo is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nemo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Built as nemo-odf-to-txt and nemo-epub2text - the name it's run as
+ * picks the document format.  Nemo itself doesn't run these for content
+ * search, it links the same extractor, but they're kept for helper
+ * definitions and scripts that call them directly. */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <gio/gunixoutputstream.h>
+
+#include "nemo-document-text.h"
+
+int
+main (int argc, char *argv[])
+{
+    NemoDocumentFormat format;
+    GInputStream *input;
+    GOutputStream *output;
+    GError *error;
+    GFile *file;
+    gchar *program;
+    gboolean known;
+
+    if (argc < 2) {
+        g_printerr ("Need a filename\n");
+        return 1;
+    }
+
+    program = g_path_get_basename (argv[0]);
+    known = nemo_document_format_for_program (program, &format);
+    g_free (program);
+
+    if (!known) {
+        g_printerr ("Run as nemo-odf-to-txt or nemo-epub2text\n");
+        return 1;
+    }
+
+    file = g_file_new_for_path (argv[1]);
+
+    error = NULL;
+    input = nemo_document_text_stream_new (file, format, NULL, &error);
+    g_object_unref (file);
+
+    if (input == NULL)
+    {
+        g_critical ("Could not open document: %s", error->message);
+        g_error_free (error);
+        return 1;
+    }
+
+    output = g_unix_output_stream_new (STDOUT_FILENO, FALSE);
+
+    g_output_stream_splice (output, input,
+                            G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE | G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                            NULL, &error);
+
+    g_object_unref (input);
+    g_object_unref (output);
+
+    if (error != NULL)
+    {
+        g_critical ("Could not extract text from document: %s", error->message);
+        g_error_free (error);
+        return 1;
+    }
+
+    return 0;
+}
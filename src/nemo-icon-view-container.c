@@ -1611,7 +1611,15 @@ find_empty_location (NemoIconContainer *container,
 
         if (need_new_column ||
             !nemo_placement_grid_position_is_free (grid, grid_position)) {
-            icon_position.y0 += GET_VIEW_CONSTANT (container, snap_size_y);
+            int rows_to_skip = 1;
+
+            if (!need_new_column) {
+                /* Jump straight past the occupied cells below us instead of
+                 * probing them one snap at a time. */
+                rows_to_skip = MAX (1, nemo_placement_grid_find_free_row (grid, grid_position) - grid_position.y0);
+            }
+
+            icon_position.y0 += rows_to_skip * GET_VIEW_CONSTANT (container, snap_size_y);
             icon_position.y1 = icon_position.y0 + icon_height;
 
             if (need_new_column) {
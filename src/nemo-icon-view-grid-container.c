@@ -519,9 +519,7 @@ snap_position (NemoIconContainer         *container,
         x_new = grid_rect.x;
         y_new = grid_rect.y;
     } else {
-        while (!found_empty) {
-            nemo_centered_placement_grid_get_next_position_rect (grid, &grid_rect, &grid_rect, &found_empty);
-        }
+        nemo_centered_placement_grid_get_next_free_position_rect (grid, &grid_rect, &grid_rect);
 
         x_new = grid_rect.x;
         y_new = grid_rect.y;
@@ -702,6 +700,7 @@ update_visual_selection_state (NemoIconContainer *container)
         container->details->icons = g_list_sort_with_data (container->details->icons,
                                                            order_icons_by_visual_position,
                                                            grid);
+        container->details->search_index_positions_valid = FALSE;
 
         nemo_centered_placement_grid_free (grid);
     }
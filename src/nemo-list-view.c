@@ -2336,7 +2336,7 @@ static void
 prioritize_visible_files (NemoListView *view)
 {
     NemoFile *last_file;
-    // GList *queue_list, *l;
+    NemoThumbnailViewport *viewport;
     GdkRectangle vrect;
     GtkTreeIter iter;
     GtkTreePath *path;
@@ -2358,6 +2358,7 @@ prioritize_visible_files (NemoListView *view)
 
     last_file = NULL;
     cy = end_y;
+    viewport = nemo_thumbnail_viewport_new (view);
 
     // Images that start out un-thumbnailed end up resolving in reverse
     // order, so work bottom-up here.
@@ -2379,20 +2380,31 @@ prioritize_visible_files (NemoListView *view)
 
             /* We'll catch some files twice, so filter them out */
             if (file != NULL && file != last_file) {
+                gchar *uri;
+                gint distance;
+
                 last_file = file;
 
                 if (nemo_file_get_load_deferred_attrs (file) == NEMO_FILE_LOAD_DEFERRED_ATTRS_NO) {
                     nemo_file_set_load_deferred_attrs (file, NEMO_FILE_LOAD_DEFERRED_ATTRS_YES);
                 }
 
-                if (nemo_file_is_thumbnailing (file)) {
-                    gchar *uri = nemo_file_get_uri (file);
+                if (!nemo_file_is_thumbnailing (file)) {
+                    nemo_file_invalidate_attributes (file, NEMO_FILE_DEFERRED_ATTRIBUTES);
+                }
 
-                    nemo_thumbnail_prioritize (uri);
-                    g_free (uri);
+                /* Rows on screen come first, then by how far off screen they are */
+                if (cy < bin_y) {
+                    distance = bin_y - cy;
+                } else if (cy > bin_y + vrect.height) {
+                    distance = cy - (bin_y + vrect.height);
                 } else {
-                    nemo_file_invalidate_attributes (file, NEMO_FILE_DEFERRED_ATTRIBUTES);
+                    distance = 0;
                 }
+
+                uri = nemo_file_get_uri (file);
+                nemo_thumbnail_viewport_add (viewport, uri, distance);
+                g_free (uri);
             }
 
             nemo_file_unref (file);
@@ -2400,6 +2412,8 @@ prioritize_visible_files (NemoListView *view)
 
         cy -= stepdown;
     }
+
+    nemo_thumbnail_viewport_publish (viewport);
 }
 
 static gboolean
@@ -4192,6 +4206,8 @@ nemo_list_view_dispose (GObject *object)
         list_view->details->update_visible_icons_id = 0;
     }
 
+    nemo_thumbnail_viewport_withdraw (list_view);
+
 	if (list_view->details->clipboard_handler_id != 0) {
 		g_signal_handler_disconnect (nemo_clipboard_monitor_get (),
 		                             list_view->details->clipboard_handler_id);
@@ -7266,6 +7266,32 @@ action_paste_files_into_callback (GtkAction *action,
 
 }
 
+static void
+action_generate_thumbnails_callback (GtkAction *action,
+				     gpointer callback_data)
+{
+	NemoView *view;
+	GList *selection;
+	gchar *uri;
+
+	view = NEMO_VIEW (callback_data);
+	selection = nemo_view_get_selection (view);
+	if (selection != NULL) {
+		uri = nemo_file_get_uri (NEMO_FILE (selection->data));
+		nemo_file_list_free (selection);
+	} else {
+		uri = nemo_view_get_uri (view);
+
+		if (eel_uri_is_desktop (uri)) {
+			g_free (uri);
+			uri = nemo_get_desktop_directory_uri ();
+		}
+	}
+
+	nemo_file_operations_generate_thumbnails (uri, nemo_view_get_containing_window (view));
+	g_free (uri);
+}
+
 static void
 action_open_as_root_callback (GtkAction *action,
 				  gpointer callback_data)
@@ -8356,6 +8382,10 @@ static const GtkActionEntry directory_view_entries[] = {
   /* label, accelerator */       N_("Follow link to original file"), "",
   /* tooltip */                  N_("Navigate to the original file that this symbolic link points to"),
                  G_CALLBACK (action_follow_symlink_callback) },
+  /* name, stock id */         { NEMO_ACTION_GENERATE_THUMBNAILS, NULL,
+  /* label, accelerator */       N_("Generate Thumbnails"), "",
+  /* tooltip */                  N_("Create thumbnails for everything in this folder and its subfolders"),
+                 G_CALLBACK (action_generate_thumbnails_callback) },
   /* name, stock id */         { NEMO_ACTION_OPEN_CONTAINING_FOLDER, "xsi-go-jump-symbolic",
   /* label, accelerator */       N_("Open containing folder"), "<control><alt>O",
   /* tooltip */                  N_("Navigate to the folder that the selected item is stored in"),
@@ -9797,6 +9827,14 @@ real_update_menus (NemoView *view)
                                          NEMO_ACTION_OPEN_IN_TERMINAL);
     gtk_action_set_visible (action, no_selection_or_one_dir);
 
+    action = gtk_action_group_get_action (view->details->dir_action_group,
+                                         NEMO_ACTION_GENERATE_THUMBNAILS);
+    gtk_action_set_visible (action, no_selection_or_one_dir &&
+                                    !selection_contains_recent &&
+                                    !selection_contains_favorites &&
+                                    !selection_contains_special_link &&
+                                    !showing_trash_directory (view));
+
 	action = gtk_action_group_get_action (view->details->dir_action_group,
 					      NEMO_ACTION_NEW_FOLDER);
 	gtk_action_set_sensitive (action, can_create_files);
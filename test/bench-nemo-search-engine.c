@@ -0,0 +1,581 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   bench-nemo-search-engine.c: Timings of the advanced search engine over a
+   generated tree.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin Street - Suite 500,
+   Boston, MA 02110-1335, USA.
+*/
+
+/* Builds the same tree every time from a fixed seed - deep and wide
+ * folders, lots of small text files, a few big logs and some symlink
+ * loops - then runs filename, regex and content queries over it and
+ * reports files per second, time to the first hit and peak RSS for each.
+ *
+ *   meson test --benchmark 'Search Engine benchmark'
+ *
+ * or run it by hand with --scale to grow the tree, --corpus to search an
+ * existing folder instead, and --keep to leave the generated tree behind.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <libnemo-private/nemo-global-preferences.h>
+#include <libnemo-private/nemo-search-engine.h>
+#include <libnemo-private/nemo-search-engine-advanced.h>
+
+#define CORPUS_SEED 0x6e656d6f
+
+#define SMALL_DIRS 100
+#define SMALL_FILES_PER_DIR 100
+#define WIDE_FILES 20000
+#define DEEP_LEVELS 200
+#define DEEP_FILES_PER_LEVEL 5
+#define LOG_FILES 4
+#define LOG_SIZE (16 * 1024 * 1024)
+
+/* Every this many small files has the needle in its name, or its text */
+#define NAME_NEEDLE_EVERY 1009
+#define TEXT_NEEDLE_EVERY 997
+#define NEEDLE "quokka"
+
+static const gchar *words[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+    "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+    "quebec", "romeo", "sierra", "tango", "uniform", "victor", "whiskey",
+    "xray", "yankee", "zulu", "folder", "window", "thumbnail", "desktop"
+};
+
+typedef struct {
+    const gchar *name;
+    const gchar *file_pattern;
+    const gchar *content_pattern;
+    gboolean file_regex;
+    gboolean content_regex;
+} BenchQuery;
+
+static const BenchQuery queries[] = {
+    { "filename substring", NEEDLE,                   NULL,                  FALSE, FALSE },
+    { "filename glob",      "note-*7.txt",            NULL,                  FALSE, FALSE },
+    { "filename regex",     "^note-[0-9]+3\\.txt$",   NULL,                  TRUE,  FALSE },
+    { "content literal",    "",                       NEEDLE,                FALSE, FALSE },
+    { "content regex",      "",                       NEEDLE " [a-z]+ing",   FALSE, TRUE  },
+};
+
+typedef struct {
+    GMainLoop *loop;
+    gint64 start;
+    gint64 first_hit;
+    guint hits;
+} BenchRun;
+
+static gint scale = 1;
+static gint runs = 3;
+static gchar *corpus = NULL;
+static gboolean keep = FALSE;
+
+static GOptionEntry entries[] = {
+    { "scale", 's', 0, G_OPTION_ARG_INT, &scale, "Multiply the size of the generated tree", "N" },
+    { "runs", 'r', 0, G_OPTION_ARG_INT, &runs, "Times to run each query", "N" },
+    { "corpus", 'c', 0, G_OPTION_ARG_FILENAME, &corpus, "Search this folder instead of generating one", "DIR" },
+    { "keep", 'k', 0, G_OPTION_ARG_NONE, &keep, "Leave the generated tree in place", NULL },
+    { NULL }
+};
+
+static void
+append_words (GString *text,
+              GRand   *rand,
+              gint     n_words)
+{
+    gint i;
+
+    for (i = 0; i < n_words; i++) {
+        g_string_append (text, words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))]);
+        g_string_append_c (text, (i % 12) == 11 ? '\n' : ' ');
+    }
+}
+
+static void
+write_file (const gchar *path,
+            const gchar *contents,
+            gssize       len)
+{
+    GError *error = NULL;
+
+    if (!g_file_set_contents (path, contents, len, &error)) {
+        g_error ("Could not write %s: %s", path, error->message);
+    }
+}
+
+static void
+make_dir (const gchar *path)
+{
+    if (g_mkdir_with_parents (path, 0755) < 0) {
+        g_error ("Could not create %s", path);
+    }
+}
+
+static guint
+generate_small (const gchar *root,
+                GRand       *rand)
+{
+    GString *text = g_string_new (NULL);
+    guint n = 0;
+    gint d, f;
+
+    for (d = 0; d < SMALL_DIRS * scale; d++) {
+        gchar *dir = g_strdup_printf ("%s/small/dir-%04d", root, d);
+
+        make_dir (dir);
+
+        for (f = 0; f < SMALL_FILES_PER_DIR; f++, n++) {
+            gchar *path;
+
+            g_string_truncate (text, 0);
+            append_words (text, rand, g_rand_int_range (rand, 100, 600));
+
+            if (n % TEXT_NEEDLE_EVERY == 0) {
+                g_string_append (text, NEEDLE " sighting\n");
+            }
+
+            if (n % NAME_NEEDLE_EVERY == 0) {
+                path = g_strdup_printf ("%s/" NEEDLE "-%06u.txt", dir, n);
+            } else {
+                path = g_strdup_printf ("%s/note-%06u.txt", dir, n);
+            }
+
+            write_file (path, text->str, text->len);
+            g_free (path);
+        }
+
+        g_free (dir);
+    }
+
+    g_string_free (text, TRUE);
+
+    return n;
+}
+
+static guint
+generate_wide (const gchar *root,
+               GRand       *rand)
+{
+    gchar *dir = g_strdup_printf ("%s/wide", root);
+    guint32 blob[16];
+    guint n;
+    gint i;
+
+    make_dir (dir);
+
+    for (n = 0; n < WIDE_FILES * (guint) scale; n++) {
+        gchar *path = g_strdup_printf ("%s/entry-%06u.dat", dir, n);
+
+        for (i = 0; i < (gint) G_N_ELEMENTS (blob); i++) {
+            blob[i] = g_rand_int (rand) & 0x00ffffff;
+        }
+
+        write_file (path, (const gchar *) blob, sizeof (blob));
+        g_free (path);
+    }
+
+    g_free (dir);
+
+    return n;
+}
+
+static guint
+generate_deep (const gchar *root,
+               GRand       *rand)
+{
+    GString *dir = g_string_new (root);
+    GString *text = g_string_new (NULL);
+    guint n = 0;
+    gint level, f;
+
+    g_string_append (dir, "/deep");
+
+    for (level = 0; level < DEEP_LEVELS; level++) {
+        g_string_append_printf (dir, "/level-%03d", level);
+        make_dir (dir->str);
+
+        for (f = 0; f < DEEP_FILES_PER_LEVEL; f++, n++) {
+            gchar *path = g_strdup_printf ("%s/page-%d.txt", dir->str, f);
+
+            g_string_truncate (text, 0);
+            append_words (text, rand, 50);
+            write_file (path, text->str, text->len);
+            g_free (path);
+        }
+    }
+
+    g_string_free (dir, TRUE);
+    g_string_free (text, TRUE);
+
+    return n;
+}
+
+static guint
+generate_logs (const gchar *root,
+               GRand       *rand)
+{
+    GString *line = g_string_new (NULL);
+    gchar *dir = g_strdup_printf ("%s/logs", root);
+    gint i;
+
+    make_dir (dir);
+
+    for (i = 0; i < LOG_FILES; i++) {
+        gchar *path = g_strdup_printf ("%s/service-%d.log", dir, i);
+        gsize written = 0;
+        FILE *log;
+
+        log = fopen (path, "w");
+
+        if (log == NULL) {
+            g_error ("Could not write %s", path);
+        }
+
+        while (written < (gsize) LOG_SIZE * scale) {
+            g_string_printf (line, "2024-01-01 00:00:%02u [%s] ", (guint) (written % 60),
+                             words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))]);
+            append_words (line, rand, 11);
+
+            fwrite (line->str, 1, line->len, log);
+            written += line->len;
+        }
+
+        /* The worst case for content search - the only hit at the very end */
+        if (i == 0) {
+            fputs (NEEDLE " spotted wandering\n", log);
+        }
+
+        fclose (log);
+        g_free (path);
+    }
+
+    g_free (dir);
+    g_string_free (line, TRUE);
+
+    return LOG_FILES;
+}
+
+static void
+make_link (const gchar *target,
+           gchar       *path)
+{
+    if (symlink (target, path) < 0) {
+        g_error ("Could not link %s to %s", path, target);
+    }
+
+    g_free (path);
+}
+
+static void
+generate_loops (const gchar *root)
+{
+    gchar *dir = g_strdup_printf ("%s/loops/inner", root);
+
+    make_dir (dir);
+
+    make_link (".", g_strdup_printf ("%s/loops/self", root));
+    make_link ("..", g_strdup_printf ("%s/parent", dir));
+    make_link (root, g_strdup_printf ("%s/root", dir));
+
+    g_free (dir);
+}
+
+static guint
+generate_corpus (const gchar *root)
+{
+    GRand *rand = g_rand_new_with_seed (CORPUS_SEED);
+    guint n = 0;
+
+    n += generate_small (root, rand);
+    n += generate_wide (root, rand);
+    n += generate_deep (root, rand);
+    n += generate_logs (root, rand);
+    generate_loops (root);
+
+    g_rand_free (rand);
+
+    return n;
+}
+
+/* Counts regular files without following links, for an existing corpus */
+static guint
+count_files (const gchar *path)
+{
+    const gchar *name;
+    guint n = 0;
+    GDir *dir;
+
+    dir = g_dir_open (path, 0, NULL);
+
+    if (dir == NULL) {
+        return 0;
+    }
+
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        gchar *child = g_build_filename (path, name, NULL);
+
+        if (g_file_test (child, G_FILE_TEST_IS_SYMLINK)) {
+            /* skip */
+        } else if (g_file_test (child, G_FILE_TEST_IS_DIR)) {
+            n += count_files (child);
+        } else {
+            n++;
+        }
+
+        g_free (child);
+    }
+
+    g_dir_close (dir);
+
+    return n;
+}
+
+static void
+remove_tree (const gchar *path)
+{
+    const gchar *name;
+    GDir *dir;
+
+    dir = g_dir_open (path, 0, NULL);
+
+    if (dir != NULL) {
+        while ((name = g_dir_read_name (dir)) != NULL) {
+            gchar *child = g_build_filename (path, name, NULL);
+
+            if (!g_file_test (child, G_FILE_TEST_IS_SYMLINK) && g_file_test (child, G_FILE_TEST_IS_DIR)) {
+                remove_tree (child);
+            } else {
+                g_unlink (child);
+            }
+
+            g_free (child);
+        }
+
+        g_dir_close (dir);
+    }
+
+    g_rmdir (path);
+}
+
+/* Peak RSS since the last reset, in kB.  Linux resets the high water
+ * mark when 5 is written to clear_refs; elsewhere this is the peak for
+ * the whole process. */
+static void
+reset_peak_rss (void)
+{
+    g_file_set_contents ("/proc/self/clear_refs", "5", 1, NULL);
+}
+
+static glong
+get_peak_rss (void)
+{
+    struct rusage usage;
+    gchar *status;
+
+    if (g_file_get_contents ("/proc/self/status", &status, NULL, NULL)) {
+        const gchar *hwm = strstr (status, "VmHWM:");
+        glong kb = -1;
+
+        if (hwm != NULL) {
+            kb = strtol (hwm + strlen ("VmHWM:"), NULL, 10);
+        }
+
+        g_free (status);
+
+        if (kb >= 0) {
+            return kb;
+        }
+    }
+
+    getrusage (RUSAGE_SELF, &usage);
+
+    return usage.ru_maxrss;
+}
+
+static void
+hits_added_cb (NemoSearchEngine *engine,
+               GList            *hits,
+               BenchRun         *run)
+{
+    if (run->first_hit == 0 && hits != NULL) {
+        run->first_hit = g_get_monotonic_time ();
+    }
+
+    run->hits += g_list_length (hits);
+
+    /* The results are ours, the list is the engine's */
+    g_list_foreach (hits, (GFunc) file_search_result_free, NULL);
+}
+
+static void
+finished_cb (NemoSearchEngine *engine,
+             BenchRun         *run)
+{
+    g_main_loop_quit (run->loop);
+}
+
+static void
+error_cb (NemoSearchEngine *engine,
+          const gchar      *message,
+          BenchRun         *run)
+{
+    g_printerr ("Search failed: %s\n", message);
+    g_main_loop_quit (run->loop);
+}
+
+static void
+run_query (const BenchQuery *bench,
+           const gchar      *root,
+           guint             n_files)
+{
+    gdouble total = 0, best = G_MAXDOUBLE, first_total = 0;
+    glong peak = 0;
+    guint hits = 0;
+    gchar *uri;
+    gint i;
+
+    uri = g_filename_to_uri (root, NULL, NULL);
+
+    for (i = 0; i < runs; i++) {
+        NemoSearchEngine *engine;
+        NemoQuery *query;
+        BenchRun run = { 0 };
+        gdouble elapsed;
+
+        query = nemo_query_new ();
+        nemo_query_set_location (query, uri);
+        nemo_query_set_file_pattern (query, bench->file_pattern);
+        nemo_query_set_use_file_regex (query, bench->file_regex);
+        nemo_query_set_recurse (query, TRUE);
+
+        if (bench->content_pattern != NULL) {
+            nemo_query_set_content_pattern (query, bench->content_pattern);
+            nemo_query_set_use_content_regex (query, bench->content_regex);
+        }
+
+        engine = nemo_search_engine_advanced_new ();
+        nemo_search_engine_set_query (engine, query);
+        g_object_unref (query);
+
+        run.loop = g_main_loop_new (NULL, FALSE);
+
+        g_signal_connect (engine, "hits-added", G_CALLBACK (hits_added_cb), &run);
+        g_signal_connect (engine, "finished", G_CALLBACK (finished_cb), &run);
+        g_signal_connect (engine, "error", G_CALLBACK (error_cb), &run);
+
+        reset_peak_rss ();
+        run.start = g_get_monotonic_time ();
+
+        nemo_search_engine_start (engine);
+        g_main_loop_run (run.loop);
+
+        elapsed = (g_get_monotonic_time () - run.start) / (gdouble) G_USEC_PER_SEC;
+        total += elapsed;
+        best = MIN (best, elapsed);
+
+        if (run.first_hit != 0) {
+            first_total += (run.first_hit - run.start) / (gdouble) G_USEC_PER_SEC;
+        }
+
+        peak = MAX (peak, get_peak_rss ());
+        hits = run.hits;
+
+        g_main_loop_unref (run.loop);
+        g_object_unref (engine);
+    }
+
+    g_print ("%-20s %8u hits  %9.0f files/s  best %7.3f s  mean %7.3f s  first hit %7.3f s  peak RSS %7ld kB\n",
+             bench->name, hits, n_files / best, best, total / runs,
+             hits > 0 ? first_total / runs : 0.0, peak);
+
+    g_free (uri);
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    gchar *root;
+    guint n_files;
+    guint i;
+
+    context = g_option_context_new ("- time the advanced search engine");
+    g_option_context_add_main_entries (context, entries, NULL);
+
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("%s\n", error->message);
+        return 1;
+    }
+
+    g_option_context_free (context);
+
+    scale = MAX (scale, 1);
+    runs = MAX (runs, 1);
+
+    nemo_global_preferences_init ();
+
+    if (corpus != NULL) {
+        if (g_path_is_absolute (corpus)) {
+            root = g_strdup (corpus);
+        } else {
+            gchar *cwd = g_get_current_dir ();
+
+            root = g_build_filename (cwd, corpus, NULL);
+            g_free (cwd);
+        }
+
+        n_files = count_files (root);
+    } else {
+        gint64 start = g_get_monotonic_time ();
+
+        root = g_dir_make_tmp ("nemo-search-bench-XXXXXX", &error);
+
+        if (root == NULL) {
+            g_printerr ("Could not create the corpus folder: %s\n", error->message);
+            return 1;
+        }
+
+        n_files = generate_corpus (root);
+
+        g_print ("Generated %u files in %s (%.1f s)\n", n_files, root,
+                 (g_get_monotonic_time () - start) / (gdouble) G_USEC_PER_SEC);
+    }
+
+    for (i = 0; i < G_N_ELEMENTS (queries); i++) {
+        run_query (&queries[i], root, n_files);
+    }
+
+    if (corpus == NULL && !keep) {
+        remove_tree (root);
+    }
+
+    g_free (root);
+
+    return 0;
+}